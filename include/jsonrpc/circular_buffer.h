@@ -3,11 +3,64 @@
 #include <boost/asio/buffer.hpp>
 #include <cassert>
 #include <cstddef>
+#include <cstring>
 #include <iterator>
+#include <span>
+#include <string_view>
 #include <type_traits>
 
 namespace lsplex::jsonrpc {
 
+namespace detail {
+
+constexpr std::size_t npos = std::string_view::npos;
+
+/** Index of the first C in S at or after FROM, or npos. */
+constexpr std::size_t find_char(std::span<const char> s, char c,
+                                std::size_t from) {
+  if (from >= s.size()) return npos;
+  if (std::is_constant_evaluated()) {
+    for (auto i = from; i < s.size(); ++i)
+      if (s[i] == c) return i;
+    return npos;
+  }
+  // memchr() is vectorized, and as fast as scanning gets.
+  const auto* p = std::memchr(s.data() + from, c, s.size() - from);
+  return p != nullptr
+             ? static_cast<std::size_t>(static_cast<const char*>(p) - s.data())
+             : npos;
+}
+
+/** Where NEEDLE first starts in X followed by Y, or npos.  It may
+ *  straddle the two.
+ */
+constexpr std::size_t find_split(std::span<const char> x,
+                                 std::span<const char> y,
+                                 std::string_view needle) {
+  if (needle.empty()) return 0;
+  auto total = x.size() + y.size();
+  if (needle.size() > total) return npos;
+  auto at = [&](std::size_t i) {
+    return i < x.size() ? x[i] : y[i - x.size()];
+  };
+  auto matches = [&](std::size_t i) {
+    if (i + needle.size() > total) return false;
+    for (std::size_t k = 1; k < needle.size(); ++k)
+      if (at(i + k) != needle[k]) return false;
+    return true;
+  };
+  // Only look closer where the first character is.
+  for (auto i = find_char(x, needle[0], 0); i != npos;
+       i = find_char(x, needle[0], i + 1))
+    if (matches(i)) return i;
+  for (auto i = find_char(y, needle[0], 0); i != npos;
+       i = find_char(y, needle[0], i + 1))
+    if (matches(x.size() + i)) return x.size() + i;
+  return npos;
+}
+
+}  // namespace detail
+
 template <typename T, std::size_t N> class circular_buffer {
   std::array<T, N> _data{};
   std::size_t _a{0};  // Start of the valid data
@@ -41,8 +94,8 @@ public:
       requires(is_const)
         : _buffer(&buffer), _index(index) {}
 
-    constexpr reference operator*() { return _buffer->_data.at(_index); }
-    constexpr reference operator*() const { return _buffer->_data.at(_index); }
+    constexpr reference operator*() { return _buffer->_data[_index]; }
+    constexpr reference operator*() const { return _buffer->_data[_index]; }
 
     constexpr pointer operator->() { return &(_buffer->_data[_index]); }
 
@@ -97,7 +150,8 @@ public:
     }
 
     constexpr t_iterator& operator++() {
-      *this += 1;
+      if (++_index == N) _index = 0;
+      if (_index == _buffer->_b) _index = N;
       return *this;
     }
     constexpr t_iterator& operator--() {
@@ -130,6 +184,40 @@ public:
     return const_iterator(*this, N);
   }
 
+  static constexpr std::size_t npos = detail::npos;
+
+  [[nodiscard]] static constexpr std::size_t capacity() { return N; }
+
+  /** The contents, as at most two contiguous pieces: the second is
+   *  empty unless they wrap around.
+   */
+  [[nodiscard]] constexpr std::array<std::span<const T>, 2> segments() const {
+    using span = std::span<const T>;
+    if (empty()) return {span{}, span{}};
+    if (_a < _b) return {span{_data.data() + _a, _b - _a}, span{}};
+    return {span{_data.data() + _a, N - _a}, span{_data.data(), _b}};
+  }
+
+  /** Copy the first COUNT elements, at most size(), to OUT.  Returns
+   *  how many were.
+   */
+  constexpr std::size_t peek(T* out, std::size_t count) const {
+    auto [x, y] = segments();
+    auto from_x = std::min(count, x.size());
+    auto from_y = std::min(count - from_x, y.size());
+    std::copy_n(x.begin(), from_x, out);
+    std::copy_n(y.begin(), from_y, out + from_x);
+    return from_x + from_y;
+  }
+
+  /** Where NEEDLE first starts in the contents, or npos. */
+  [[nodiscard]] constexpr std::size_t find(std::string_view needle) const
+    requires std::is_same_v<T, char>
+  {
+    auto [x, y] = segments();
+    return detail::find_split(x, y, needle);
+  }
+
   [[nodiscard]] size_t constexpr size() const {
     return (_b >= _a && !_full) ? (_b - _a) : (N - _a + _b);
   }
@@ -265,5 +353,23 @@ constexpr auto ret7 = []() {
     return *beg;
   }();
   static_assert(ret7 == 't');
+
+  constexpr auto buf8 = []() {
+    circular_buffer<char, 10> b;
+    b.grow(7);
+    b.consume(7);
+    std::string_view sv{"ab\r\n\r\ncd"};
+    std::copy(sv.begin(), sv.end(), b.begin());
+    b.grow(sv.size());
+    return b;
+  }();
+  static_assert(buf8.segments()[0].size() == 3);
+  static_assert(buf8.segments()[1].size() == 5);
+  static_assert(buf8.find("\r\n\r\n") == 2);
+  static_assert(buf8.find("\n\r") == 3);
+  static_assert(buf8.find("cd") == 6);
+  static_assert(buf8.find("dc") == circular_buffer<char, 10>::npos);
+  static_assert(circular_buffer<char, 10>{}.find("a")
+                == circular_buffer<char, 10>::npos);
 }  // namespace
 }  // namespace lsplex::jsonrpc
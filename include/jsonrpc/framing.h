@@ -0,0 +1,23 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+
+namespace lsplex::jsonrpc {
+
+/** How messages are delimited on a stream.
+ *
+ *  content_length is the LSP's own: each message is preceded by
+ *  HTTP-like headers giving its size.  ndjson is newline-delimited
+ *  JSON, one message per line, as some tools and test harnesses
+ *  speak.
+ */
+enum class framing { content_length, ndjson };
+
+constexpr std::optional<framing> framing_named(std::string_view name) {
+  if (name == "content-length") return framing::content_length;
+  if (name == "ndjson") return framing::ndjson;
+  return std::nullopt;
+}
+
+}  // namespace lsplex::jsonrpc
@@ -7,12 +7,18 @@
 #include <boost/asio/error.hpp>
 #include <boost/asio/readable_pipe.hpp>
 #include <boost/json.hpp>
-#include <memory_resource>
-#include <regex>
-#include <sstream>
+#include <cctype>
+#include <array>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
+#include <variant>
 
 #include "jsonrpc/circular_buffer.h"
+#include "jsonrpc/framing.h"
+#include "jsonrpc/shared_message.h"
 #include "lsplex/export.hpp"
 
 namespace lsplex::jsonrpc {
@@ -20,17 +26,50 @@ namespace lsplex::jsonrpc {
 namespace json = boost::json;
 namespace asio = boost::asio;
 using headerbuf_t = circular_buffer<char, 50>;
+using linebuf_t = circular_buffer<char, 8192>;
+
+// Framing policies, see below.
+struct content_length;
+struct ndjson;
+
+namespace detail {
+/** When the bytes of a stream's messages arrived, as the reads that
+ *  brought them in completed.
+ */
+struct arrival {
+  using clock = std::chrono::steady_clock;
+  clock::time_point last_read{};
+  clock::time_point first_byte{};  // Of the message being read
+  clock::duration parsing{};       // The message last read
+
+  /** A message starts.  If some of it is BUFFERED already, it came
+   *  with the last read.
+   */
+  void start(bool buffered) {
+    first_byte = buffered ? last_read : clock::time_point{};
+  }
+  void read() {
+    last_read = clock::now();
+    if (first_byte == clock::time_point{}) first_byte = last_read;
+  }
+  void parsed(clock::time_point since) { parsing = clock::now() - since; }
+};
+}  // namespace detail
 
 /** HTTP-like way to stream in JSON objects from a file descriptor.
  *
  *  See https://microsoft.github.io/language-server-protocol/
  *             specifications/lsp/3.17/specification/#headerPart
  *
+ *  Or, with the ndjson Framing, one object per line.
+ *
  * Also FIXME find better name for this.
  */
-template <typename Readable> LSPLEX_EXPORT class istream {
+template <typename Readable, typename Framing = content_length>
+LSPLEX_EXPORT class istream {
   Readable _in;
-  headerbuf_t _buf;
+  typename Framing::buffer _buf;
+  detail::arrival _arrival;
 
 public:
   LSPLEX_EXPORT Readable& handle() { return _in; }
@@ -39,6 +78,35 @@ public:
   LSPLEX_EXPORT [[nodiscard]] json::object get() {
     return async_get(asio::use_future).get();
   }
+  /** Like async_get, but also takes JSON-RPC batches, which come
+   *  whole as an array.
+   */
+  template <typename Token> LSPLEX_EXPORT auto async_get_message(Token&& tok);
+  LSPLEX_EXPORT [[nodiscard]] json::value get_message() {
+    return async_get_message(asio::use_future).get();
+  }
+  /** Read the headers of the next message and complete with its
+   *  Content-Length, leaving the body to async_get_body() or to be
+   *  read from handle() after it.  Only with content_length framing.
+   */
+  template <typename Token> LSPLEX_EXPORT auto async_get_header(Token&& tok);
+  /** Fill OUT with the next bytes of the body whose header was just
+   *  read, starting with those already buffered.
+   */
+  template <typename Token>
+  LSPLEX_EXPORT auto async_get_body(asio::mutable_buffer out, Token&& tok);
+  /** How many bytes were read ahead of what was consumed. */
+  [[nodiscard]] std::size_t buffered() const { return _buf.size(); }
+  /** When the first bytes arrived of the message last read, or
+   *  being read.
+   */
+  [[nodiscard]] std::chrono::steady_clock::time_point arrived() const {
+    return _arrival.first_byte;
+  }
+  /** How long parsing the message last read took. */
+  [[nodiscard]] std::chrono::steady_clock::duration parse_time() const {
+    return _arrival.parsing;
+  }
 };
 
 /** HTTP-like way to stream out JSON objects to a file descriptor.
@@ -46,20 +114,30 @@ public:
  *  See https://microsoft.github.io/language-server-protocol/
  *             specifications/lsp/3.17/specification/#headerPart
  *
+ *  Or, with the ndjson Framing, one object per line.
+ *
  * Also FIXME find better name for this.
  */
-template <typename Writeable> LSPLEX_EXPORT class ostream {
+template <typename Writeable, typename Framing = content_length>
+LSPLEX_EXPORT class ostream {
   Writeable _out;
+  std::string _head;
   std::string _out_buf;
 
 public:
   LSPLEX_EXPORT Writeable& handle() { return _out; }
   LSPLEX_EXPORT explicit ostream(Writeable d) : _out{std::move(d)} {}
+  /** Write message O, an object or a batch of them. */
   template <typename Token>
-  LSPLEX_EXPORT auto async_put(const json::object& o, Token&& tok);
-  LSPLEX_EXPORT void put(const json::object& o) {
+  LSPLEX_EXPORT auto async_put(const json::value& o, Token&& tok);
+  LSPLEX_EXPORT void put(const json::value& o) {
     async_put(o, asio::use_future).get();
   }
+  /** Write message M, already serialized.  Other ostreams may be
+   *  writing it at the same time.
+   */
+  template <typename Token>
+  LSPLEX_EXPORT auto async_put(shared_message m, Token&& tok);
 };
 }  // namespace lsplex::jsonrpc
 
@@ -69,17 +147,60 @@ namespace lsplex::jsonrpc::detail {
 
 namespace asio = boost::asio;
 
-template <typename Readable> class read_op {
+/** Consume the header lines in BUF, noting Content-Length in LENGTH.
+ *  Returns whether the empty line ending the headers was consumed;
+ *  if not, BUF needs more data.
+ */
+inline bool parse_headers(headerbuf_t& buf, std::size_t& length) {
+  constexpr std::string_view crlf{"\r\n"};
+  for (;;) {
+    auto eol = buf.find(crlf);
+    if (eol == headerbuf_t::npos) return false;
+
+    if (length != 0 && eol == 0) {
+      buf.consume(crlf.size());
+      return true;
+    }
+
+    // A line fits in the buffer, so it's cheap to look at in one piece
+    // even if it wraps around.
+    std::array<char, headerbuf_t::capacity()> storage{};
+    std::string_view line{storage.data(), buf.peek(storage.data(), eol)};
+    if (line.starts_with('\n')) line.remove_prefix(1);
+    if (auto colon = line.find(':'); colon != std::string_view::npos) {
+      auto name = line.substr(0, colon);
+      auto value = line.substr(colon + 1);
+      while (!name.empty()
+             && std::isspace(static_cast<unsigned char>(name.back())) != 0)
+        name.remove_suffix(1);
+      while (!value.empty()
+             && std::isspace(static_cast<unsigned char>(value.front())) != 0)
+        value.remove_prefix(1);
+      if (name == "Content-Length") {
+        size_t content_length = 0;
+        for (auto c : value) {
+          if (std::isdigit(static_cast<unsigned char>(c)) == 0) break;
+          content_length = content_length * 10 + static_cast<size_t>(c - '0');
+        }
+        length = content_length;
+      }
+    }
+    buf.consume(eol + crlf.size());
+  }
+}
+
+template <typename Readable, typename Message = json::object> class read_op {
   Readable& _in;      // NOLINT
   headerbuf_t& _buf;  // NOLINT
+  arrival& _arrival;  // NOLINT
 
   std::vector<char> _msg_buf{};  // NOLINT
   enum { starting, parse_headers, reading_body } stage = starting;
-  using it_t = headerbuf_t::iterator;
   size_t _content_length{0};
 
 public:
-  read_op(Readable& in, headerbuf_t& buf) : _in{in}, _buf{buf} {}
+  read_op(Readable& in, headerbuf_t& buf, arrival& arr)
+      : _in{in}, _buf{buf}, _arrival{arr} {}
 
   template <typename Self>
   // NOLINTBEGIN(*-qualified-auto)
@@ -90,6 +211,7 @@ public:
     switch (stage) {
       case starting: {
         stage = parse_headers;
+        _arrival.start(!_buf.empty());
       again:
         _in.async_read_some(_buf.buffer(), std::move(self));
         return;
@@ -100,55 +222,20 @@ public:
           self.complete(asio::error::misc_errors::eof, {});
           return;
         }
-        for (;;) {
-          auto beg = _buf.begin();
-          auto end = _buf.end();
-          constexpr std::string_view searcher{"\r\n"};
-          auto crlf = std::search(beg, end, searcher.begin(), searcher.end());
-          if (crlf == end) {
-            // no crlf in sight, need to get more data, possibly
-            // emptying the buffer to make space for it.
-            if (_buf.full()) _buf.clear();
-            goto again;  // NOLINT
-          }
-
-          if (_content_length != 0 && crlf == beg) {
-            _buf.consume(searcher.size());
-            break;
-          }
-
-          std::regex header_re{R"(\n?([^ ]+)\s*:\s*([^ ]+))"};
-          std::array<char, 512> buf{};
-          std::pmr::monotonic_buffer_resource resource{buf.data(), buf.size()};
-          std::pmr::polymorphic_allocator<std::sub_match<it_t>> alloc{
-              &resource};
-          std::pmr::match_results<it_t> match{alloc};
-
-          constexpr std::string_view magic{"Content-Length"};
-          size_t content_length = 0;
-          if (std::regex_match(beg, crlf, match, header_re)) {
-            if (std::equal(match[1].first, match[1].second, magic.begin())) {
-              for (auto cp = match[2].first;
-                   cp != match[2].second && static_cast<bool>(isdigit(*cp));
-                   ++cp)
-                content_length
-                    = content_length * 10 + static_cast<size_t>(*cp - '0');
-              _content_length = content_length;
-            }
-          }
-          _buf.consume(static_cast<size_t>(crlf - beg) + searcher.size());
+        _arrival.read();
+        if (!detail::parse_headers(_buf, _content_length)) {
+          // no crlf in sight, need to get more data, possibly
+          // emptying the buffer to make space for it.
+          if (_buf.full()) _buf.clear();
+          goto again;  // NOLINT
         }
 
         // We're now officially reading the message body, but there
         // may be some of the message (or all of it) in _buf.
         stage = reading_body;
         auto sz = _buf.size();
-        auto from = _buf.begin();
-        auto to = static_cast<it_t>(from)
-                  + static_cast<std::ptrdiff_t>(std::min(_content_length, sz));
         _msg_buf.resize(_content_length);
-        std::copy(from, to, _msg_buf.data());
-        _buf.consume(static_cast<size_t>(to - from));
+        _buf.consume(_buf.peek(_msg_buf.data(), _content_length));
 
         if (sz < _content_length) {
           stage = reading_body;
@@ -165,69 +252,360 @@ public:
           return;
         }
       done:
-        self.complete(
-            {}, json::parse(std::string_view{_msg_buf.data(), _msg_buf.size()})
-                    .as_object());
+        auto since = arrival::clock::now();
+        auto v = json::parse(std::string_view{_msg_buf.data(), _msg_buf.size()});
+        _arrival.parsed(since);
+        if constexpr (std::is_same_v<Message, json::object>)
+          self.complete({}, std::move(v.as_object()));
+        else
+          self.complete({}, std::move(v));
       }
     }
   }
   // NOLINTEND(*-qualified-auto)
 };
 
-template <typename Writable> class write_op {
-  Writable& _out;          // NOLINT
-  const json::object& _o;  // NOLINT
-  std::string& _out_buf;   // NOLINT
-  enum { starting, writing_header, writing_body } stage = starting;
+template <typename Readable> class header_op {
+  Readable& _in;      // NOLINT
+  headerbuf_t& _buf;  // NOLINT
+  arrival& _arrival;  // NOLINT
+  enum { starting, reading, done } stage = starting;
+  size_t _content_length{0};
+
 public:
-  write_op(Writable& out, const json::object& o, std::string& out_buf) :
-    _out{out}, _o{o}, _out_buf{out_buf} {}
+  header_op(Readable& in, headerbuf_t& buf, arrival& arr)
+      : _in{in}, _buf{buf}, _arrival{arr} {}
 
   template <typename Self>
   void operator()(Self& self, boost::system::error_code ec = {},
-                  [[maybe_unused]] size_t written = 0) {
+                  std::size_t bread = 0) {
     switch (stage) {
-      case starting: {
-        _out_buf = json::serialize(_o);
-        std::stringstream header;
-        header << "Content-Length: " << _out_buf.size() << "\r\n\r\n";
-        stage = writing_header;
-        asio::async_write(_out, asio::buffer(header.str()), std::move(self));
-        return;
-      }
-      case writing_header: {
-        if (ec) {
-          self.complete(ec);
+      case starting:
+        _arrival.start(!_buf.empty());
+        // The headers may have been read ahead already.
+        if (parse_headers(_buf, _content_length)) {
+          stage = done;
+          asio::post(std::move(self));
+          return;
+        }
+        break;
+      case reading:
+        _buf.grow(bread);
+        if (ec || bread == 0) {
+          if (!ec) ec = asio::error::misc_errors::eof;
+          self.complete(ec, 0);
           return;
         }
-        stage = writing_body;
-        asio::async_write(_out, asio::buffer(_out_buf), std::move(self));
+        _arrival.read();
+        if (parse_headers(_buf, _content_length)) {
+          self.complete({}, _content_length);
+          return;
+        }
+        break;
+      case done:
+        self.complete({}, _content_length);
         return;
-      }
-      case writing_body: {
-        if (ec) {
-          self.complete(ec);
+    }
+    if (_buf.full()) _buf.clear();
+    stage = reading;
+    _in.async_read_some(_buf.buffer(), std::move(self));
+  }
+};
+
+template <typename Readable> class body_op {
+  Readable& _in;              // NOLINT
+  headerbuf_t& _buf;          // NOLINT
+  asio::mutable_buffer _out;  // NOLINT
+  enum { starting, reading } stage = starting;
+
+public:
+  body_op(Readable& in, headerbuf_t& buf, asio::mutable_buffer out)
+      : _in{in}, _buf{buf}, _out{out} {}
+
+  template <typename Self>
+  void operator()(Self& self, boost::system::error_code ec = {},
+                  [[maybe_unused]] std::size_t bread = 0) {
+    if (stage == reading) {
+      self.complete(ec);
+      return;
+    }
+    auto take = _buf.peek(static_cast<char*>(_out.data()), _out.size());
+    _buf.consume(take);
+    _out += take;
+    stage = reading;
+    if (_out.size() == 0)
+      asio::post(std::move(self));
+    else
+      asio::async_read(_in, _out, std::move(self));
+  }
+};
+
+/** Read the next non-blank line of BUF and IN as a message. */
+template <typename Readable, typename Message = json::object>
+class line_read_op {
+  Readable& _in;      // NOLINT
+  linebuf_t& _buf;    // NOLINT
+  arrival& _arrival;  // NOLINT
+  std::string _line{};
+  enum { starting, reading, done } stage = starting;
+
+  // Move up to the next newline from _buf to _line.  Returns whether
+  // a line with something on it is complete.
+  bool take_line() {
+    for (;;) {
+      auto eol = _buf.find("\n");
+      auto n = eol == linebuf_t::npos ? _buf.size() : eol;
+      auto at = _line.size();
+      _line.resize(at + n);
+      _buf.consume(_buf.peek(_line.data() + at, n));
+      if (eol == linebuf_t::npos) return false;
+      _buf.consume(1);
+      if (_line.ends_with('\r')) _line.pop_back();
+      if (_line.find_first_not_of(" \t") != std::string::npos) return true;
+      _line.clear();
+    }
+  }
+
+public:
+  line_read_op(Readable& in, linebuf_t& buf, arrival& arr)
+      : _in{in}, _buf{buf}, _arrival{arr} {}
+
+  template <typename Self>
+  void operator()(Self& self, boost::system::error_code ec = {},
+                  std::size_t bread = 0) {
+    switch (stage) {
+      case starting:
+        _arrival.start(!_buf.empty());
+        // The line may have been read ahead already.
+        if (take_line()) {
+          stage = done;
+          asio::post(std::move(self));
           return;
         }
-        self.complete({});
+        stage = reading;
+        _in.async_read_some(_buf.buffer(), std::move(self));
         return;
-      }
+      case reading:
+        _buf.grow(bread);
+        if (ec || bread == 0) {
+          if (!ec) ec = asio::error::misc_errors::eof;
+          self.complete(ec, {});
+          return;
+        }
+        _arrival.read();
+        if (!take_line()) {
+          _in.async_read_some(_buf.buffer(), std::move(self));
+          return;
+        }
+        break;
+      case done:
+        break;
+    }
+    auto since = arrival::clock::now();
+    auto v = json::parse(_line);
+    _arrival.parsed(since);
+    if constexpr (std::is_same_v<Message, json::object>)
+      self.complete({}, std::move(v.as_object()));
+    else
+      self.complete({}, std::move(v));
+  }
+};
+
+template <typename Writable, typename Keep = std::monostate> class write_op {
+  Writable& _out;                             // NOLINT
+  std::array<asio::const_buffer, 3> _pieces;  // NOLINT
+  Keep _keep;  // What the pieces point into, if it isn't the ostream's
+  bool _started{false};  // NOLINT
+
+public:
+  // PIECES are header, serialized message and trailer.
+  write_op(Writable& out, std::array<asio::const_buffer, 3> pieces,
+           Keep keep = {})
+      : _out{out}, _pieces{pieces}, _keep{std::move(keep)} {}
+
+  template <typename Self>
+  void operator()(Self& self, boost::system::error_code ec = {},
+                  [[maybe_unused]] size_t written = 0) {
+    if (!_started) {
+      // All in one go, so a message is one write(2) whenever the pipe
+      // has room for it.
+      _started = true;
+      asio::async_write(_out, _pieces, std::move(self));
+      return;
     }
+    self.complete(ec);
   }
 };
 }  // namespace lsplex::jsonrpc::detail
 
 namespace lsplex::jsonrpc {
-template <typename Readable> template <typename Token>
-[[nodiscard]] auto istream<Readable>::async_get(Token&& tok) {
+
+/** Framing as the LSP specifies it: HTTP-like headers, then the
+ *  message.
+ */
+struct content_length {
+  using buffer = headerbuf_t;
+  template <typename Readable, typename Message>
+  using read_op = detail::read_op<Readable, Message>;
+
+  /** What goes before a message of LENGTH bytes. */
+  static std::string header(std::size_t length) {
+    return fmt::format("Content-Length: {}\r\n\r\n", length);
+  }
+  static std::string_view header(const shared_message& m) {
+    return m.header();
+  }
+  /** What goes after any message. */
+  static constexpr std::string_view trailer{};
+};
+
+/** Newline-delimited JSON.  Serialized JSON never has a raw newline
+ *  in it, so one ends each message.  Blank lines are skipped and a
+ *  CR before the newline is tolerated.
+ */
+struct ndjson {
+  using buffer = linebuf_t;
+  template <typename Readable, typename Message>
+  using read_op = detail::line_read_op<Readable, Message>;
+
+  static std::string header(std::size_t /*length*/) { return {}; }
+  static std::string_view header(const shared_message& /*m*/) { return {}; }
+  static constexpr std::string_view trailer{"\n"};
+};
+
+template <typename Readable, typename Framing> template <typename Token>
+[[nodiscard]] auto istream<Readable, Framing>::async_get(Token&& tok) {
   return asio::async_compose<Token, void(boost::system::error_code,
                                          boost::json::object)>(
-      detail::read_op{_in, _buf}, tok, _in);
+      typename Framing::template read_op<Readable, json::object>{_in, _buf,
+                                                                 _arrival},
+      tok, _in);
+}
+template <typename Readable, typename Framing> template <typename Token>
+[[nodiscard]] auto istream<Readable, Framing>::async_get_message(Token&& tok) {
+  return asio::async_compose<Token, void(boost::system::error_code,
+                                         boost::json::value)>(
+      typename Framing::template read_op<Readable, json::value>{_in, _buf,
+                                                                _arrival},
+      tok, _in);
 }
-template <typename Writable> template <typename Token>
-[[nodiscard]] auto ostream<Writable>::async_put(const json::object& o,
-                                                Token&& tok) {
+template <typename Readable, typename Framing> template <typename Token>
+[[nodiscard]] auto istream<Readable, Framing>::async_get_header(Token&& tok) {
+  static_assert(std::is_same_v<Framing, content_length>,
+                "Only Content-Length framing has headers");
+  return asio::async_compose<Token, void(boost::system::error_code,
+                                         std::size_t)>(
+      detail::header_op{_in, _buf, _arrival}, tok, _in);
+}
+template <typename Readable, typename Framing> template <typename Token>
+[[nodiscard]] auto istream<Readable, Framing>::async_get_body(
+    asio::mutable_buffer out, Token&& tok) {
+  static_assert(std::is_same_v<Framing, content_length>,
+                "Only Content-Length framing has headers");
+  return asio::async_compose<Token, void(boost::system::error_code)>(
+      detail::body_op{_in, _buf, out}, tok, _in);
+}
+template <typename Writable, typename Framing> template <typename Token>
+[[nodiscard]] auto ostream<Writable, Framing>::async_put(const json::value& o,
+                                                         Token&& tok) {
+  // Serialized now, so O needn't outlive the call.
+  _out_buf = json::serialize(o);
+  _head = Framing::header(_out_buf.size());
+  return asio::async_compose<Token, void(boost::system::error_code)>(
+      detail::write_op<Writable>{_out,
+                                 {asio::buffer(_head), asio::buffer(_out_buf),
+                                  asio::buffer(Framing::trailer)}},
+      tok, _out);
+}
+template <typename Writable, typename Framing> template <typename Token>
+[[nodiscard]] auto ostream<Writable, Framing>::async_put(shared_message m,
+                                                         Token&& tok) {
+  std::array<asio::const_buffer, 3> pieces{asio::buffer(Framing::header(m)),
+                                           asio::buffer(m.body()),
+                                           asio::buffer(Framing::trailer)};
+  // The write holds on to M until it's done.
   return asio::async_compose<Token, void(boost::system::error_code)>(
-      detail::write_op{_out, o, _out_buf}, tok, _out);
+      detail::write_op<Writable, shared_message>{_out, pieces, std::move(m)},
+      tok, _out);
 }
+
+/** An istream whose framing is chosen at run time, between the ones
+ *  compiled in.  That costs one branch per message; the reading
+ *  itself is all the statically framed istream's.
+ */
+template <typename Readable> class any_istream {
+  using variant = std::variant<istream<Readable, content_length>,
+                               istream<Readable, ndjson>>;
+  variant _s;
+
+  static variant make(Readable d, framing f) {
+    if (f == framing::ndjson)
+      return variant{std::in_place_index<1>, std::move(d)};
+    return variant{std::in_place_index<0>, std::move(d)};
+  }
+
+public:
+  any_istream(Readable d, framing f) : _s{make(std::move(d), f)} {}
+
+  Readable& handle() {
+    return std::visit([](auto& s) -> Readable& { return s.handle(); }, _s);
+  }
+  template <typename Token> auto async_get(Token&& tok) {
+    return std::visit(
+        [&](auto& s) { return s.async_get(std::forward<Token>(tok)); }, _s);
+  }
+  template <typename Token> auto async_get_message(Token&& tok) {
+    return std::visit(
+        [&](auto& s) { return s.async_get_message(std::forward<Token>(tok)); },
+        _s);
+  }
+  [[nodiscard]] std::chrono::steady_clock::time_point arrived() const {
+    return std::visit([](const auto& s) { return s.arrived(); }, _s);
+  }
+  [[nodiscard]] std::chrono::steady_clock::duration parse_time() const {
+    return std::visit([](const auto& s) { return s.parse_time(); }, _s);
+  }
+  /** The istream, if it's framed with Framing. */
+  template <typename Framing> istream<Readable, Framing>* get_if() {
+    return std::get_if<istream<Readable, Framing>>(&_s);
+  }
+};
+
+/** An ostream whose framing is chosen at run time, see any_istream. */
+template <typename Writeable> class any_ostream {
+  using variant = std::variant<ostream<Writeable, content_length>,
+                               ostream<Writeable, ndjson>>;
+  variant _s;
+
+  static variant make(Writeable d, framing f) {
+    if (f == framing::ndjson)
+      return variant{std::in_place_index<1>, std::move(d)};
+    return variant{std::in_place_index<0>, std::move(d)};
+  }
+
+public:
+  any_ostream(Writeable d, framing f) : _s{make(std::move(d), f)} {}
+
+  Writeable& handle() {
+    return std::visit([](auto& s) -> Writeable& { return s.handle(); }, _s);
+  }
+  template <typename Token>
+  auto async_put(const json::value& o, Token&& tok) {
+    return std::visit(
+        [&](auto& s) { return s.async_put(o, std::forward<Token>(tok)); },
+        _s);
+  }
+  void put(const json::value& o) { async_put(o, asio::use_future).get(); }
+  template <typename Token> auto async_put(shared_message m, Token&& tok) {
+    return std::visit(
+        [&](auto& s) {
+          return s.async_put(std::move(m), std::forward<Token>(tok));
+        },
+        _s);
+  }
+  /** The ostream, if it's framed with Framing. */
+  template <typename Framing> ostream<Writeable, Framing>* get_if() {
+    return std::get_if<ostream<Writeable, Framing>>(&_s);
+  }
+};
 }  // namespace lsplex::jsonrpc
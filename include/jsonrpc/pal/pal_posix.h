@@ -1,6 +1,7 @@
 #pragma once
 
 #include <fcntl.h>
+#include <sys/types.h>
 #include <unistd.h>
 
 #include <boost/asio/buffer.hpp>
@@ -9,6 +10,9 @@
 #include <boost/asio/readable_pipe.hpp>
 #include <boost/asio/writable_pipe.hpp>
 #include <boost/asio/write.hpp>
+#include <csignal>
+#include <cstddef>
+#include <fstream>
 #include <stdexcept>
 #include <string>
 #include <thread>
@@ -52,6 +56,29 @@ namespace detail {
 
 }  // namespace detail
 
+/** Make writes to a pipe whose reader died fail with EPIPE instead of
+ *  killing us, so a crashed child can be told from a crashed proxy.
+ */
+inline void ignore_sigpipe() { (void)::signal(SIGPIPE, SIG_IGN); }
+
+/** Freeze process PID where it is, memory and all, until resume(). */
+inline bool suspend(int pid) { return ::kill(pid, SIGSTOP) == 0; }
+inline bool resume(int pid) { return ::kill(pid, SIGCONT) == 0; }
+
+/** How much of process PID's memory is resident, or 0 if unknown. */
+inline std::size_t resident_bytes(int pid) {
+#if defined(__linux__)
+  std::ifstream statm{"/proc/" + std::to_string(pid) + "/statm"};
+  std::size_t size = 0;
+  std::size_t resident = 0;
+  if (!(statm >> size >> resident)) return 0;
+  return resident * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+#else
+  (void)pid;
+  return 0;
+#endif
+}
+
 class readable_file : public readable_pipe {
   writable_pipe _wp;
   detail::fd _file_fd;
@@ -35,6 +35,14 @@ namespace detail {
   }
 }  // namespace detail
 
+// No SIGPIPE here: writes to a broken pipe just fail.
+inline void ignore_sigpipe() {}
+
+// Nor SIGSTOP: processes can't be frozen and thawed as simply.
+inline bool suspend(int /*pid*/) { return false; }
+inline bool resume(int /*pid*/) { return false; }
+inline std::size_t resident_bytes(int /*pid*/) { return 0; }
+
 struct readable_file : stream_file {
   template <typename Executor>
   readable_file(Executor&& ex, const std::string& path)
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <cstddef>
+#include <optional>
+#include <string_view>
+
+#if defined(__linux__)
+#  include <fcntl.h>
+#  include <sys/ioctl.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+
+#  include <boost/asio/posix/stream_descriptor.hpp>
+#  include <stdexcept>
+#endif
+
+namespace lsplex::jsonrpc {
+
+namespace asio = boost::asio;
+
+/** What the first bytes of a message's body say about it.
+ *
+ *  Members are empty when not found.  Only messages whose `id` and
+ *  `method` come before their payload, as most implementations write
+ *  them, can be told apart this way.
+ */
+struct envelope {
+  std::string_view id;       // As JSON text, e.g. `3` or `"a"`
+  std::string_view method;   // Unquoted
+  std::string_view payload;  // "params", "result" or "error"
+};
+
+namespace detail {
+
+constexpr bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+constexpr std::size_t skip_space(std::string_view s, std::size_t at) {
+  while (at < s.size() && is_space(s[at])) ++at;
+  return at;
+}
+
+/** Index past the string starting with the quote at S[AT], or npos if
+ *  S ends first.  ESCAPED tells whether it has backslashes.
+ */
+constexpr std::size_t skip_string(std::string_view s, std::size_t at,
+                                  bool& escaped) {
+  escaped = false;
+  for (auto i = at + 1; i < s.size(); ++i) {
+    if (s[i] == '\\') {
+      escaped = true;
+      ++i;
+    } else if (s[i] == '"') {
+      return i + 1;
+    }
+  }
+  return std::string_view::npos;
+}
+
+/** Index past the number, `true`, `false` or `null` at S[AT]. */
+constexpr std::size_t skip_scalar(std::string_view s, std::size_t at) {
+  while (at < s.size() && s[at] != ',' && s[at] != '}' && !is_space(s[at]))
+    ++at;
+  return at < s.size() ? at : std::string_view::npos;
+}
+
+}  // namespace detail
+
+/** Find the envelope of the message whose body starts with HEAD,
+ *  without parsing any of its payload.  Gives up on anything unusual:
+ *  HEAD ending before the payload, escaped keys or methods, nested
+ *  values before the payload, or no payload at all.
+ */
+constexpr std::optional<envelope> sniff(std::string_view head) {
+  constexpr auto npos = std::string_view::npos;
+  envelope e;
+  auto at = detail::skip_space(head, 0);
+  if (at >= head.size() || head[at] != '{') return std::nullopt;
+  ++at;
+  for (;;) {
+    at = detail::skip_space(head, at);
+    if (at >= head.size() || head[at] != '"') return std::nullopt;
+    bool escaped = false;
+    auto end = detail::skip_string(head, at, escaped);
+    if (end == npos || escaped) return std::nullopt;
+    auto key = head.substr(at + 1, end - at - 2);
+    at = detail::skip_space(head, end);
+    if (at >= head.size() || head[at] != ':') return std::nullopt;
+    at = detail::skip_space(head, at + 1);
+    if (at >= head.size()) return std::nullopt;
+    if (key == "params" || key == "result" || key == "error") {
+      e.payload = key;
+      return e;
+    }
+
+    auto start = at;
+    if (head[at] == '"')
+      at = detail::skip_string(head, at, escaped);
+    else if (head[at] == '{' || head[at] == '[')
+      return std::nullopt;
+    else
+      at = detail::skip_scalar(head, at);
+    if (at == npos) return std::nullopt;
+    auto value = head.substr(start, at - start);
+    if (key == "id") {
+      e.id = value;
+    } else if (key == "method") {
+      if (value.front() != '"' || escaped) return std::nullopt;
+      e.method = value.substr(1, value.size() - 2);
+    }
+    at = detail::skip_space(head, at);
+    if (at >= head.size() || head[at] != ',') return std::nullopt;
+    ++at;
+  }
+}
+
+#if defined(__linux__)
+
+/** Moves bytes from one pipe to another with splice(2), so that they
+ *  never enter user space.
+ *
+ *  For forwarding message bodies that needn't be looked at.  Reading
+ *  from the source and writing to the sink otherwise, e.g. through an
+ *  istream and an ostream, is fine between moves.
+ */
+class splicer {
+  // Duplicates of the two ends, only for waiting until they're ready:
+  // the originals belong to someone else.
+  asio::posix::stream_descriptor _from;
+  asio::posix::stream_descriptor _to;
+
+  static int duplicate(int fd) {
+    auto copy = ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (copy == -1) throw std::runtime_error("::fcntl() failed");
+    return copy;
+  }
+
+  class move_op {
+    splicer& _s;           // NOLINT
+    std::size_t _left;     // NOLINT
+    bool _started{false};  // NOLINT
+
+  public:
+    move_op(splicer& s, std::size_t n) : _s{s}, _left{n} {}
+
+    template <typename Self>
+    void operator()(Self& self, boost::system::error_code ec = {}) {
+      if (!_started) {
+        // Don't complete from within async_move().
+        _started = true;
+        asio::post(std::move(self));
+        return;
+      }
+      if (ec) {
+        self.complete(ec);
+        return;
+      }
+      while (_left > 0) {
+        auto n = ::splice(_s._from.native_handle(), nullptr,
+                          _s._to.native_handle(), nullptr, _left,
+                          SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE);
+        if (n > 0) {
+          _left -= static_cast<std::size_t>(n);
+          continue;
+        }
+        if (n == 0) {
+          self.complete(asio::error::misc_errors::eof);
+          return;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN) {
+          self.complete({errno, boost::system::system_category()});
+          return;
+        }
+        // Either the source is empty or the sink is full.
+        int ready = 0;
+        if (::ioctl(_s._from.native_handle(), FIONREAD, &ready) == 0
+            && ready == 0)
+          _s._from.async_wait(asio::posix::stream_descriptor::wait_read,
+                              std::move(self));
+        else
+          _s._to.async_wait(asio::posix::stream_descriptor::wait_write,
+                            std::move(self));
+        return;
+      }
+      self.complete({});
+    }
+  };
+
+public:
+  /** Move from the pipe FROM to the pipe TO, both file descriptors. */
+  template <typename Executor>
+  splicer(const Executor& ex, int from, int to)
+      : _from{ex, duplicate(from)}, _to{ex, duplicate(to)} {}
+
+  /** Whether bytes can be spliced from FROM to TO: both must be
+   *  pipes.
+   */
+  static bool possible(int from, int to) {
+    struct stat a {};
+    struct stat b {};
+    return ::fstat(from, &a) == 0 && ::fstat(to, &b) == 0
+           && S_ISFIFO(a.st_mode) && S_ISFIFO(b.st_mode);
+  }
+
+  /** Move exactly N bytes. */
+  template <typename Token> auto async_move(std::size_t n, Token&& tok) {
+    return asio::async_compose<Token, void(boost::system::error_code)>(
+        move_op{*this, n}, tok, _from, _to);
+  }
+};
+
+#endif
+
+}  // namespace lsplex::jsonrpc
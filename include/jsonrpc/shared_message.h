@@ -0,0 +1,47 @@
+#pragma once
+
+#include <fmt/core.h>
+
+#include <boost/json.hpp>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace lsplex::jsonrpc {
+
+namespace json = boost::json;
+
+/** A message serialized once, for writing to any number of sinks.
+ *
+ *  The serialized text and its Content-Length header are immutable
+ *  and refcounted: copies are cheap, each write in progress holds a
+ *  reference, and whoever lets go last frees them.
+ */
+class shared_message {
+  struct text {
+    std::string header;
+    std::string body;
+  };
+  std::shared_ptr<const text> _text;
+
+  static std::shared_ptr<const text> make(const json::value& msg) {
+    auto body = json::serialize(msg);
+    auto header = fmt::format("Content-Length: {}\r\n\r\n", body.size());
+    return std::make_shared<const text>(
+        text{std::move(header), std::move(body)});
+  }
+
+public:
+  shared_message() = default;
+  explicit shared_message(const json::value& msg) : _text{make(msg)} {}
+
+  explicit operator bool() const { return _text != nullptr; }
+
+  /** The Content-Length header, blank line included. */
+  [[nodiscard]] std::string_view header() const { return _text->header; }
+  [[nodiscard]] std::string_view body() const { return _text->body; }
+  /** How many copies there are, writes in progress included. */
+  [[nodiscard]] long use_count() const { return _text.use_count(); }
+};
+
+}  // namespace lsplex::jsonrpc
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <boost/json.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "lsplex/export.hpp"
+#include "lsplex/lsp.h"
+
+namespace lsplex {
+
+/** Score how well PATTERN fuzzy-matches CANDIDATE, higher is better.
+ *
+ *  PATTERN must be a case-insensitive subsequence of CANDIDATE, else
+ *  returns nullopt.  Matches at the start of CANDIDATE, at word or
+ *  camelCase boundaries and runs of consecutive matches score more.
+ */
+LSPLEX_EXPORT std::optional<int> fuzzy_score(std::string_view pattern,
+                                             std::string_view candidate);
+
+/** The identifier characters of LINE that end at byte COLUMN. */
+LSPLEX_EXPORT std::string_view word_prefix(std::string_view line,
+                                           std::size_t column);
+
+/** Remembers the last complete `CompletionList` of each document.
+ *
+ *  A later completion request in the same word whose typed prefix
+ *  extends the one the list was computed for is answered from the
+ *  cache by fuzzy-filtering the stored items, ties broken by their
+ *  `sortText`.  Edit ranges that ended at the first request's position
+ *  are stretched over what was typed since.  Lists the server flagged
+ *  `isIncomplete` are never stored.
+ */
+class LSPLEX_EXPORT completion_cache {
+  struct entry {
+    std::size_t line{0};
+    std::size_t word_start{0};  // in position-encoding units
+    std::string prefix;
+    boost::json::array items;
+    boost::json::object defaults;  // The list's `itemDefaults`, if any
+
+    // Filter texts, flattened for locality: item I's text is
+    // texts[offsets[I], offsets[I+1]).  masks[I] has a bit for every
+    // character class present in it, for a cheap first rejection.
+    std::string texts;
+    std::vector<std::uint32_t> offsets;
+    std::vector<std::uint64_t> masks;
+
+    // Survivors of the previous lookup.  Matches of a longer pattern
+    // are a subset of matches of its prefix, so typing narrows these.
+    std::string last_prefix;
+    std::vector<std::uint32_t> last_matches;
+  };
+  std::unordered_map<std::string, entry> _entries;
+
+public:
+  /** Remember RESULT, the server's answer to a completion at AT in
+   *  URI, where PREFIX was the word being typed.
+   */
+  void store(std::string_view uri, lsp::position at, std::string_view prefix,
+             const boost::json::value& result);
+
+  /** A `CompletionList` for AT in URI with PREFIX typed, if cached. */
+  std::optional<boost::json::object> lookup(std::string_view uri,
+                                            lsp::position at,
+                                            std::string_view prefix);
+
+  /** Drop the entry for the document of a `didChange` PARAMS unless
+   *  all changes stay within its line.
+   */
+  void did_change(const boost::json::object& params);
+
+  void invalidate(std::string_view uri);
+
+  [[nodiscard]] std::size_t size() const { return _entries.size(); }
+};
+
+}  // namespace lsplex
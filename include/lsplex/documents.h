@@ -0,0 +1,89 @@
+#pragma once
+
+#include <boost/json/object.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "lsplex/export.hpp"
+#include "lsplex/lsp.h"
+#include "lsplex/rope.h"
+
+namespace lsplex {
+
+/** Byte offset into LINE of the position UNITS UTF-16 code units in.
+ *  Clamps to the end of LINE, like LSP says servers should.
+ */
+LSPLEX_EXPORT std::size_t utf16_to_byte(std::string_view line,
+                                        std::size_t units);
+/** UTF-16 code units in the first BYTES bytes of LINE, clamped to the
+ *  end of it.
+ */
+LSPLEX_EXPORT std::size_t byte_to_utf16(std::string_view line,
+                                        std::size_t bytes);
+
+/** Authoritative mirror of the documents the client has open, kept
+ *  up to date from `textDocument/did{Open,Change,Close}`.
+ *
+ *  Texts are ropes sharing one chunk_pool, so edits are O(log n) and
+ *  content common to several documents is stored once.
+ */
+class LSPLEX_EXPORT document_store {
+public:
+  struct document {
+    rope text;
+    std::int64_t version{0};
+    std::string language_id;
+  };
+
+  document_store() = default;
+  // Ropes point into _pool.
+  document_store(const document_store&) = delete;
+  document_store(document_store&&) = delete;
+  document_store& operator=(const document_store&) = delete;
+  document_store& operator=(document_store&&) = delete;
+  ~document_store() = default;
+
+  // Each takes the `params` of the notification of the same name.
+  void did_open(const boost::json::object& params);
+  void did_change(const boost::json::object& params);
+  /** Like did_change(PARAMS), but BEFORE sees the range of each change
+   *  just before it's applied, against the text as it is then, and may
+   *  rewrite it.
+   */
+  void did_change(
+      boost::json::object& params,
+      const std::function<void(boost::json::object& range)>& before);
+  void did_close(const boost::json::object& params);
+
+  [[nodiscard]] const document* find(std::string_view uri) const;
+
+  /** Text of line LINE of URI, without its terminator. */
+  [[nodiscard]] std::optional<std::string> line(std::string_view uri,
+                                                std::size_t line) const;
+  [[nodiscard]] std::optional<std::int64_t> version(
+      std::string_view uri) const;
+  /** Byte offset of AT in URI, clamped to the end of its line. */
+  [[nodiscard]] std::optional<std::size_t> offset(std::string_view uri,
+                                                  lsp::position at) const;
+
+  template <typename F> void for_each(F&& f) const {
+    for (const auto& [uri, doc] : _docs) f(uri, doc);
+  }
+  [[nodiscard]] std::size_t size() const { return _docs.size(); }
+  [[nodiscard]] const chunk_pool& pool() const { return _pool; }
+
+private:
+  chunk_pool _pool;
+  std::unordered_map<std::string, document> _docs;
+
+  document* find_mut(std::string_view uri);
+  template <typename Params, typename Before>
+  void apply(Params& params, const Before& before);
+};
+
+}  // namespace lsplex
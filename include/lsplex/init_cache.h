@@ -0,0 +1,39 @@
+#pragma once
+
+#include <boost/json.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "lsplex/export.hpp"
+
+namespace lsplex {
+
+/** `InitializeResult`s of past sessions, one file each in a directory.
+ *
+ *  Entries are keyed by a string identifying the server (executable,
+ *  arguments, binary modification time) and the workspace root, so a
+ *  rebuilt server or a different project never sees a stale entry.
+ *  Unreadable or corrupt entries are treated as absent.
+ */
+class LSPLEX_EXPORT init_cache {
+  std::string _dir;
+
+  [[nodiscard]] std::string path_of(std::string_view key) const;
+
+public:
+  explicit init_cache(std::string dir) : _dir{std::move(dir)} {}
+
+  /** Key for SERVER, as above, serving the workspace at ROOT. */
+  static std::string key(std::string_view server, std::string_view root);
+
+  [[nodiscard]] std::optional<boost::json::value> load(
+      std::string_view key) const;
+  /** Remember RESULT under KEY.  Failures are only logged: the cache
+   *  is an optimization.
+   */
+  void store(std::string_view key, const boost::json::value& result) const;
+  void erase(std::string_view key) const;
+};
+
+}  // namespace lsplex
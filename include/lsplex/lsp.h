@@ -0,0 +1,112 @@
+#pragma once
+
+#include <boost/json.hpp>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace lsplex::lsp {
+
+namespace json = boost::json;
+
+/** A zero-based LSP position.  CHARACTER is counted in whatever
+ *  position encoding was negotiated (UTF-16 code units by default).
+ */
+struct position {
+  std::size_t line{0};
+  std::size_t character{0};
+  auto operator<=>(const position&) const = default;
+};
+
+// Non-throwing accessors.  Messages come from the wire, so a missing
+// or mistyped member must never take the proxy down.
+
+inline const json::object* get_object(const json::object& o,
+                                      std::string_view key) {
+  const auto* v = o.if_contains(key);
+  return v != nullptr ? v->if_object() : nullptr;
+}
+
+inline const json::array* get_array(const json::object& o,
+                                    std::string_view key) {
+  const auto* v = o.if_contains(key);
+  return v != nullptr ? v->if_array() : nullptr;
+}
+
+inline std::optional<std::string_view> get_string(const json::object& o,
+                                                  std::string_view key) {
+  const auto* v = o.if_contains(key);
+  if (v == nullptr || !v->is_string()) return std::nullopt;
+  return std::string_view{v->get_string()};
+}
+
+inline std::optional<std::int64_t> get_int(const json::object& o,
+                                           std::string_view key) {
+  const auto* v = o.if_contains(key);
+  if (v == nullptr) return std::nullopt;
+  if (v->is_int64()) return v->get_int64();
+  if (v->is_uint64()) return static_cast<std::int64_t>(v->get_uint64());
+  return std::nullopt;
+}
+
+inline std::optional<position> get_position(const json::object& o,
+                                            std::string_view key) {
+  const auto* p = get_object(o, key);
+  if (p == nullptr) return std::nullopt;
+  auto line = get_int(*p, "line");
+  auto character = get_int(*p, "character");
+  if (!line || !character || *line < 0 || *character < 0) return std::nullopt;
+  return position{static_cast<std::size_t>(*line),
+                  static_cast<std::size_t>(*character)};
+}
+
+/** The `params.textDocument.uri` of a document request or notification. */
+inline std::optional<std::string_view> document_uri(
+    const json::object& params) {
+  const auto* td = get_object(params, "textDocument");
+  return td != nullptr ? get_string(*td, "uri") : std::nullopt;
+}
+
+/** Key for a JSON-RPC id, which may be a number or a string. */
+inline std::string id_key(const json::value& id) {
+  return json::serialize(id);
+}
+
+inline json::object make_request(const json::value& id,
+                                 std::string_view method,
+                                 json::value params) {
+  return json::object{{"jsonrpc", "2.0"},
+                      {"id", id},
+                      {"method", method},
+                      {"params", params}};
+}
+
+inline json::object make_notification(std::string_view method,
+                                      json::value params) {
+  return json::object{
+      {"jsonrpc", "2.0"}, {"method", method}, {"params", params}};
+}
+
+inline json::object make_response(const json::value& id, json::value result) {
+  return json::object{{"jsonrpc", "2.0"}, {"id", id}, {"result", result}};
+}
+
+inline json::object make_error(const json::value& id, std::int64_t code,
+                               std::string_view message) {
+  return json::object{{"jsonrpc", "2.0"},
+                      {"id", id},
+                      {"error", {{"code", code}, {"message", message}}}};
+}
+
+// Error codes, from JSON-RPC and LSP
+constexpr std::int64_t invalid_request = -32600;
+constexpr std::int64_t method_not_found = -32601;
+constexpr std::int64_t request_failed = -32803;
+constexpr std::int64_t server_cancelled = -32802;
+constexpr std::int64_t content_modified = -32801;
+constexpr std::int64_t request_cancelled = -32800;
+
+}  // namespace lsplex::lsp
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <chrono>
 #include <string>
 #include <vector>
 
+#include "jsonrpc/framing.h"
 #include "lsplex/export.hpp"
 
 namespace lsplex {
@@ -20,11 +22,103 @@ private:
   std::vector<std::string> _args;
 };
 
+struct LsOptions {
+  /** How many times a server that dies on its own is respawned. */
+  unsigned max_restarts{3};
+  /** Root directories, each served by its own server instance.
+   *  Documents elsewhere go to a default instance.
+   */
+  std::vector<std::string> shards;
+  /** Instances of the server per shard.  Document changes go to all
+   *  of them, read-only requests to the least busy one.
+   */
+  unsigned replicas{1};
+  /** How long a read-only request may go unanswered before it's also
+   *  sent to another replica.  Zero never does.
+   */
+  std::chrono::milliseconds hedge_delay{150};
+  /** Directory keeping each server's last `InitializeResult`, so the
+   *  client's `initialize` can be answered without waiting for the
+   *  server to boot.  Empty disables this.
+   */
+  std::string init_cache;
+  /** File where to keep responses about whole documents (symbols,
+   *  folding ranges, semantic tokens, links) across sessions, keyed by
+   *  the document's contents.  Empty disables this.
+   */
+  std::string response_cache;
+  /** Size past which the response cache file gets compacted. */
+  std::size_t response_cache_max_bytes{std::size_t{256} << 20U};
+  /** How messages are delimited to and from the client, and to and
+   *  from the servers.  They needn't match: the proxy translates.
+   */
+  jsonrpc::framing client_framing{jsonrpc::framing::content_length};
+  jsonrpc::framing server_framing{jsonrpc::framing::content_length};
+  /** Methods whose requests from the client are answered with
+   *  MethodNotFound instead of reaching the servers.
+   */
+  std::vector<std::string> deny_methods;
+  /** Most verbose `window/logMessage` type forwarded from the servers:
+   *  1 is errors, 2 warnings, 3 info, 4 log and 5 (all) debug.
+   */
+  unsigned server_log_level{5};
+  /** How long a backend may go without traffic before it's put to
+   *  sleep until the next request for it.  Zero never does.
+   */
+  std::chrono::seconds hibernate_after{0};
+  /** Put backends to sleep with SIGSTOP, keeping their state, rather
+   *  than shutting them down and respawning them when needed.
+   */
+  bool hibernate_stop{false};
+  /** Methods, among those in `prefetchable`, that the proxy asks the
+   *  servers about a document as soon as it's opened or saved, to
+   *  answer the client's own requests at once.  Empty doesn't.
+   */
+  std::vector<std::string> prefetch;
+  /** How many prefetching requests may be in flight at a time. */
+  unsigned prefetch_concurrency{2};
+  /** Have clients that can count columns in UTF-8 bytes do so, and
+   *  translate for servers that only count UTF-16 code units.
+   */
+  bool utf8_positions{false};
+  /** Most results per `$/progress` notification, when a client asks
+   *  for partial results and a server answers with a long list.  Zero
+   *  sends lists whole.
+   */
+  std::size_t partial_results{0};
+  /** Take out of what goes to the client the fields its capabilities
+   *  say it can't use, and keep completion items' documentation aside
+   *  until they're resolved.
+   */
+  bool slim{false};
+  /** Fields slimming leaves alone, like `documentation`. */
+  std::vector<std::string> slim_keep;
+  /** How long the client's `workspace/didChangeWatchedFiles` are held
+   *  back, to go to the servers as one, with each file's events netted
+   *  out.  Anything else from the client sends them right away.  Zero
+   *  forwards each as it comes.
+   */
+  std::chrono::milliseconds watched_files_window{0};
+  /** File where to write the timelines of the client's latest
+   *  requests, as Chrome trace-event JSON, at exit and on SIGUSR1.
+   *  Empty doesn't trace.
+   */
+  std::string trace;
+  /** How many of the latest requests are traced. */
+  std::size_t trace_window{10000};
+  /** How late the event loop may get to what's due before that's
+   *  logged as a stall, with what held it up.  Lag percentiles are
+   *  logged at exit and on SIGUSR1.  Zero doesn't watch.
+   */
+  std::chrono::milliseconds stall_threshold{0};
+};
+
 LSPLEX_EXPORT class LsPlex {
   std::vector<LsContact> _contacts;
+  LsOptions _options;
 
 public:
-  explicit LsPlex(std::vector<LsContact> contacts);
+  explicit LsPlex(std::vector<LsContact> contacts, LsOptions options = {});
 
   void start();
 };
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace lsplex::lsp {
+
+enum class kind : std::uint8_t { request, notification };
+
+/** Who sends a message.  `both` is for the `$/` ones. */
+enum class direction : std::uint8_t { to_server, to_client, both };
+
+/** How urgently a message wants handling, most urgent first. */
+enum class priority : std::uint8_t {
+  lifecycle,    // Handshake, shutdown and cancellation
+  sync,         // State changes; their order matters
+  interactive,  // Someone is staring at the screen, waiting
+  background    // Decorations, diagnostics, logs
+};
+
+// The LSP 3.17 methods: identifier, name, kind, direction, whether
+// sending it twice is harmless, whether its params carry
+// `textDocument.uri`, and priority.
+// clang-format off
+#define LSPLEX_LSP_METHODS(X)                                                              \
+  X(initialize,                         "initialize",                          request,      to_server, false, false, lifecycle)   \
+  X(initialized,                        "initialized",                         notification, to_server, false, false, lifecycle)   \
+  X(shutdown,                           "shutdown",                            request,      to_server, false, false, lifecycle)   \
+  X(exit,                               "exit",                                notification, to_server, false, false, lifecycle)   \
+  X(cancel_request,                     "$/cancelRequest",                     notification, both,      true,  false, lifecycle)   \
+  X(progress,                           "$/progress",                          notification, both,      false, false, background)  \
+  X(set_trace,                          "$/setTrace",                          notification, to_server, true,  false, background)  \
+  X(log_trace,                          "$/logTrace",                          notification, to_client, true,  false, background)  \
+  X(register_capability,                "client/registerCapability",           request,      to_client, false, false, sync)        \
+  X(unregister_capability,              "client/unregisterCapability",         request,      to_client, false, false, sync)        \
+  X(show_message,                       "window/showMessage",                  notification, to_client, true,  false, background)  \
+  X(show_message_request,               "window/showMessageRequest",           request,      to_client, false, false, interactive) \
+  X(show_document,                      "window/showDocument",                 request,      to_client, false, false, interactive) \
+  X(log_message,                        "window/logMessage",                   notification, to_client, true,  false, background)  \
+  X(work_done_progress_create,          "window/workDoneProgress/create",      request,      to_client, false, false, background)  \
+  X(work_done_progress_cancel,          "window/workDoneProgress/cancel",      notification, to_server, true,  false, lifecycle)   \
+  X(telemetry_event,                    "telemetry/event",                     notification, to_client, true,  false, background)  \
+  X(did_open,                           "textDocument/didOpen",                notification, to_server, false, true,  sync)        \
+  X(did_change,                         "textDocument/didChange",              notification, to_server, false, true,  sync)        \
+  X(will_save,                          "textDocument/willSave",               notification, to_server, false, true,  sync)        \
+  X(will_save_wait_until,               "textDocument/willSaveWaitUntil",      request,      to_server, false, true,  sync)        \
+  X(did_save,                           "textDocument/didSave",                notification, to_server, false, true,  sync)        \
+  X(did_close,                          "textDocument/didClose",               notification, to_server, false, true,  sync)        \
+  X(notebook_did_open,                  "notebookDocument/didOpen",            notification, to_server, false, false, sync)        \
+  X(notebook_did_change,                "notebookDocument/didChange",          notification, to_server, false, false, sync)        \
+  X(notebook_did_save,                  "notebookDocument/didSave",            notification, to_server, false, false, sync)        \
+  X(notebook_did_close,                 "notebookDocument/didClose",           notification, to_server, false, false, sync)        \
+  X(declaration,                        "textDocument/declaration",            request,      to_server, true,  true,  interactive) \
+  X(definition,                         "textDocument/definition",             request,      to_server, true,  true,  interactive) \
+  X(type_definition,                    "textDocument/typeDefinition",         request,      to_server, true,  true,  interactive) \
+  X(implementation,                     "textDocument/implementation",         request,      to_server, true,  true,  interactive) \
+  X(references,                         "textDocument/references",             request,      to_server, true,  true,  interactive) \
+  X(prepare_call_hierarchy,             "textDocument/prepareCallHierarchy",   request,      to_server, true,  true,  interactive) \
+  X(incoming_calls,                     "callHierarchy/incomingCalls",         request,      to_server, true,  false, interactive) \
+  X(outgoing_calls,                     "callHierarchy/outgoingCalls",         request,      to_server, true,  false, interactive) \
+  X(prepare_type_hierarchy,             "textDocument/prepareTypeHierarchy",   request,      to_server, true,  true,  interactive) \
+  X(supertypes,                         "typeHierarchy/supertypes",            request,      to_server, true,  false, interactive) \
+  X(subtypes,                           "typeHierarchy/subtypes",              request,      to_server, true,  false, interactive) \
+  X(document_highlight,                 "textDocument/documentHighlight",      request,      to_server, true,  true,  interactive) \
+  X(document_link,                      "textDocument/documentLink",           request,      to_server, true,  true,  background)  \
+  X(document_link_resolve,              "documentLink/resolve",                request,      to_server, true,  false, background)  \
+  X(hover,                              "textDocument/hover",                  request,      to_server, true,  true,  interactive) \
+  X(code_lens,                          "textDocument/codeLens",               request,      to_server, true,  true,  background)  \
+  X(code_lens_resolve,                  "codeLens/resolve",                    request,      to_server, true,  false, background)  \
+  X(code_lens_refresh,                  "workspace/codeLens/refresh",          request,      to_client, true,  false, background)  \
+  X(folding_range,                      "textDocument/foldingRange",           request,      to_server, true,  true,  background)  \
+  X(selection_range,                    "textDocument/selectionRange",         request,      to_server, true,  true,  interactive) \
+  X(document_symbol,                    "textDocument/documentSymbol",         request,      to_server, true,  true,  background)  \
+  X(semantic_tokens_full,               "textDocument/semanticTokens/full",    request,      to_server, true,  true,  background)  \
+  X(semantic_tokens_full_delta,         "textDocument/semanticTokens/full/delta", request,   to_server, false, true,  background)  \
+  X(semantic_tokens_range,              "textDocument/semanticTokens/range",   request,      to_server, true,  true,  background)  \
+  X(semantic_tokens_refresh,            "workspace/semanticTokens/refresh",    request,      to_client, true,  false, background)  \
+  X(inline_value,                       "textDocument/inlineValue",            request,      to_server, true,  true,  background)  \
+  X(inline_value_refresh,               "workspace/inlineValue/refresh",       request,      to_client, true,  false, background)  \
+  X(inlay_hint,                         "textDocument/inlayHint",              request,      to_server, true,  true,  background)  \
+  X(inlay_hint_resolve,                 "inlayHint/resolve",                   request,      to_server, true,  false, background)  \
+  X(inlay_hint_refresh,                 "workspace/inlayHint/refresh",         request,      to_client, true,  false, background)  \
+  X(moniker,                            "textDocument/moniker",                request,      to_server, true,  true,  background)  \
+  X(completion,                         "textDocument/completion",             request,      to_server, true,  true,  interactive) \
+  X(completion_resolve,                 "completionItem/resolve",              request,      to_server, true,  false, interactive) \
+  X(publish_diagnostics,                "textDocument/publishDiagnostics",     notification, to_client, true,  false, background)  \
+  X(document_diagnostic,                "textDocument/diagnostic",             request,      to_server, true,  true,  background)  \
+  X(workspace_diagnostic,               "workspace/diagnostic",                request,      to_server, true,  false, background)  \
+  X(diagnostic_refresh,                 "workspace/diagnostic/refresh",        request,      to_client, true,  false, background)  \
+  X(signature_help,                     "textDocument/signatureHelp",          request,      to_server, true,  true,  interactive) \
+  X(code_action,                        "textDocument/codeAction",             request,      to_server, true,  true,  interactive) \
+  X(code_action_resolve,                "codeAction/resolve",                  request,      to_server, true,  false, interactive) \
+  X(document_color,                     "textDocument/documentColor",          request,      to_server, true,  true,  background)  \
+  X(color_presentation,                 "textDocument/colorPresentation",      request,      to_server, true,  true,  interactive) \
+  X(formatting,                         "textDocument/formatting",             request,      to_server, true,  true,  interactive) \
+  X(range_formatting,                   "textDocument/rangeFormatting",        request,      to_server, true,  true,  interactive) \
+  X(on_type_formatting,                 "textDocument/onTypeFormatting",       request,      to_server, true,  true,  interactive) \
+  X(rename,                             "textDocument/rename",                 request,      to_server, true,  true,  interactive) \
+  X(prepare_rename,                     "textDocument/prepareRename",          request,      to_server, true,  true,  interactive) \
+  X(linked_editing_range,               "textDocument/linkedEditingRange",     request,      to_server, true,  true,  interactive) \
+  X(workspace_symbol,                   "workspace/symbol",                    request,      to_server, true,  false, interactive) \
+  X(workspace_symbol_resolve,           "workspaceSymbol/resolve",             request,      to_server, true,  false, interactive) \
+  X(configuration,                      "workspace/configuration",             request,      to_client, true,  false, sync)        \
+  X(did_change_configuration,           "workspace/didChangeConfiguration",    notification, to_server, false, false, sync)        \
+  X(workspace_folders,                  "workspace/workspaceFolders",          request,      to_client, true,  false, sync)        \
+  X(did_change_workspace_folders,       "workspace/didChangeWorkspaceFolders", notification, to_server, false, false, sync)        \
+  X(will_create_files,                  "workspace/willCreateFiles",           request,      to_server, false, false, sync)        \
+  X(did_create_files,                   "workspace/didCreateFiles",            notification, to_server, false, false, sync)        \
+  X(will_rename_files,                  "workspace/willRenameFiles",           request,      to_server, false, false, sync)        \
+  X(did_rename_files,                   "workspace/didRenameFiles",            notification, to_server, false, false, sync)        \
+  X(will_delete_files,                  "workspace/willDeleteFiles",           request,      to_server, false, false, sync)        \
+  X(did_delete_files,                   "workspace/didDeleteFiles",            notification, to_server, false, false, sync)        \
+  X(did_change_watched_files,           "workspace/didChangeWatchedFiles",     notification, to_server, false, false, sync)        \
+  X(execute_command,                    "workspace/executeCommand",            request,      to_server, false, false, interactive) \
+  X(apply_edit,                         "workspace/applyEdit",                 request,      to_client, false, false, interactive)
+// clang-format on
+
+/** Every LSP 3.17 method, densely numbered, then `unknown`. */
+enum class method : std::uint8_t {
+#define LSPLEX_X(id, ...) id,
+  LSPLEX_LSP_METHODS(LSPLEX_X)
+#undef LSPLEX_X
+      unknown
+};
+
+struct method_traits {
+  std::string_view name;
+  lsp::kind kind;
+  lsp::direction direction;
+  bool idempotent;    // Sending it twice is harmless
+  bool document_uri;  // Params carry `textDocument.uri`
+  lsp::priority priority;
+};
+
+inline constexpr std::array method_table{
+#define LSPLEX_X(id, name, k, d, idem, uri, prio)                  \
+  method_traits{name, kind::k, direction::d, idem, uri, priority::prio},
+    LSPLEX_LSP_METHODS(LSPLEX_X)
+#undef LSPLEX_X
+        // What's assumed of a method nobody told us about
+        method_traits{{}, kind::request, direction::both, false, false,
+                      priority::interactive}};
+
+constexpr const method_traits& traits(method m) {
+  return method_table[static_cast<std::size_t>(m)];
+}
+
+namespace detail {
+
+constexpr std::uint32_t method_hash(std::uint32_t seed,
+                                    std::string_view s) {
+  // FNV-1a with a murmur finalizer, so that the low bits are good
+  // enough to index with.
+  std::uint32_t h = 2166136261U ^ seed;
+  for (auto c : s) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 16777619U;
+  }
+  h ^= h >> 16U;
+  h *= 0x85ebca6bU;
+  h ^= h >> 13U;
+  h *= 0xc2b2ae35U;
+  h ^= h >> 16U;
+  return h;
+}
+
+/** Perfect hash of the method names, found at compile time by "hash
+ *  and displace": names are put in buckets by one hash, then each
+ *  bucket, fullest first, gets the first seed that sends all its names
+ *  to free slots.  A lookup is two hashes and one string comparison.
+ */
+struct method_index {
+  static constexpr std::size_t known = method_table.size() - 1;
+  static constexpr std::size_t buckets = 64;
+  static constexpr std::size_t slots = 256;
+  static constexpr std::uint8_t empty = 0xFF;
+  static_assert(known < empty && (buckets & (buckets - 1)) == 0
+                && (slots & (slots - 1)) == 0);
+
+  std::array<std::uint32_t, buckets> seeds{};
+  std::array<std::uint8_t, slots> slot{};
+  bool ok{false};
+
+  static constexpr std::size_t bucket_of(std::string_view s) {
+    return method_hash(0, s) & (buckets - 1);
+  }
+  static constexpr std::size_t slot_of(std::uint32_t seed,
+                                       std::string_view s) {
+    return method_hash(seed, s) & (slots - 1);
+  }
+
+  static constexpr method_index build() {
+    method_index ix;
+    ix.slot.fill(empty);
+    std::array<std::array<std::uint8_t, known>, buckets> members{};
+    std::array<std::size_t, buckets> sizes{};
+    for (std::size_t m = 0; m < known; ++m) {
+      auto b = bucket_of(method_table[m].name);
+      members[b][sizes[b]++] = static_cast<std::uint8_t>(m);
+    }
+    std::array<std::size_t, buckets> order{};
+    for (std::size_t b = 0; b < buckets; ++b) order[b] = b;
+    std::sort(order.begin(), order.end(), [&sizes](auto x, auto y) {
+      return sizes[x] > sizes[y];
+    });
+
+    for (auto b : order) {
+      if (sizes[b] == 0) break;
+      std::uint32_t seed = 1;
+      for (; seed < 100000; ++seed) {
+        // Try SEED on a copy of the slots, so a failure leaves no trace.
+        auto slot = ix.slot;
+        std::size_t i = 0;
+        for (; i < sizes[b]; ++i) {
+          auto& s = slot[slot_of(seed, method_table[members[b][i]].name)];
+          if (s != empty) break;
+          s = members[b][i];
+        }
+        if (i < sizes[b]) continue;
+        ix.seeds[b] = seed;
+        ix.slot = slot;
+        break;
+      }
+      if (seed == 100000) return ix;
+    }
+    ix.ok = true;
+    return ix;
+  }
+};
+
+inline constexpr method_index method_index_v = method_index::build();
+static_assert(method_index_v.ok, "No perfect hash for the LSP methods");
+
+}  // namespace detail
+
+/** The method called NAME, or `method::unknown`.  No allocation, and
+ *  at most one string comparison.
+ */
+constexpr method classify(std::string_view name) {
+  using detail::method_index;
+  const auto& ix = detail::method_index_v;
+  auto seed = ix.seeds[method_index::bucket_of(name)];
+  auto m = ix.slot[method_index::slot_of(seed, name)];
+  if (m == method_index::empty || method_table[m].name != name)
+    return method::unknown;
+  return static_cast<method>(m);
+}
+
+static_assert(classify("textDocument/hover") == method::hover);
+static_assert(classify("$/cancelRequest") == method::cancel_request);
+static_assert(classify("textDocument/hovers") == method::unknown);
+static_assert(classify("") == method::unknown);
+
+/** Traits of the method called NAME.  Unknown (e.g. custom) methods
+ *  get conservative ones: never idempotent, and whether they carry a
+ *  document must be checked on the params.
+ */
+constexpr const method_traits& traits(std::string_view name) {
+  return traits(classify(name));
+}
+
+}  // namespace lsplex::lsp
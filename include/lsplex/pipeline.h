@@ -0,0 +1,106 @@
+#pragma once
+
+#include <boost/json.hpp>
+#include <concepts>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+#include "lsplex/lsp.h"
+#include "lsplex/methods.h"
+
+namespace lsplex {
+
+namespace json = boost::json;
+
+/** What a pipeline stage did with a message. */
+enum class verdict : std::uint8_t {
+  pass,    // Possibly changed in place: on to the next stage
+  drop,    // Gone
+  answer,  // Replaced by the reply, which goes back to the sender
+};
+
+/** A stage sees each message in turn, as a mutable reference: it may
+ *  change it in place, or turn it into the reply to its sender.
+ */
+template <typename S>
+concept stage = std::move_constructible<S>
+                && requires(S& s, json::object& msg) {
+                     { s(msg) } -> std::same_as<verdict>;
+                   };
+
+/** Stages run one after the other until one doesn't pass the message
+ *  on.  The composition is all static, so calls are inlined and an
+ *  empty pipeline costs nothing at all.
+ */
+template <stage... Stages> class pipeline {
+  std::tuple<Stages...> _stages;
+
+public:
+  static constexpr bool empty = sizeof...(Stages) == 0;
+
+  explicit pipeline(Stages... stages) : _stages{std::move(stages)...} {}
+
+  verdict operator()(json::object& msg) {
+    auto v = verdict::pass;
+    std::apply(
+        [&](auto&... s) { (void)(((v = s(msg)) == verdict::pass) && ...); },
+        _stages);
+    return v;
+  }
+};
+
+/** Drops the servers' `window/logMessage` notifications more verbose
+ *  than a MessageType: 1 is errors, 2 warnings, 3 info, 4 log and 5
+ *  debug.
+ */
+class log_filter {
+  std::int64_t _max_type;
+
+public:
+  explicit log_filter(std::int64_t max_type) : _max_type{max_type} {}
+
+  verdict operator()(json::object& msg) const {
+    auto method = lsp::get_string(msg, "method");
+    if (!method || lsp::classify(*method) != lsp::method::log_message)
+      return verdict::pass;
+    const auto* params = lsp::get_object(msg, "params");
+    auto type = params != nullptr ? lsp::get_int(*params, "type")
+                                  : std::nullopt;
+    return type && *type > _max_type ? verdict::drop : verdict::pass;
+  }
+};
+
+/** Keeps the client's requests for some methods away from the
+ *  servers: they're answered with MethodNotFound, and notifications
+ *  dropped.
+ */
+class method_filter {
+  std::set<std::string, std::less<>> _denied;
+
+public:
+  explicit method_filter(std::set<std::string, std::less<>> denied)
+      : _denied{std::move(denied)} {}
+
+  verdict operator()(json::object& msg) const {
+    auto method = lsp::get_string(msg, "method");
+    if (!method || !_denied.contains(*method)) return verdict::pass;
+    const auto* id = msg.if_contains("id");
+    if (id == nullptr) return verdict::drop;
+    msg = lsp::make_error(*id, lsp::method_not_found,
+                          std::string{*method} + " is disabled");
+    return verdict::answer;
+  }
+};
+
+// The variants compiled in, picked from the options at startup.
+using plain_pipeline = pipeline<>;
+using client_pipeline = pipeline<method_filter>;
+using server_pipeline = pipeline<log_filter>;
+
+}  // namespace lsplex
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <boost/json.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "lsplex/documents.h"
+#include "lsplex/export.hpp"
+
+namespace lsplex {
+
+/** Have a client whose `initialize` PARAMS offer UTF-8 positions
+ *  count columns that way, when the server's `InitializeResult` RESULT
+ *  only does UTF-16: RESULT is rewritten to say so.  Returns whether
+ *  it was, so that the proxy must translate.
+ */
+LSPLEX_EXPORT bool negotiate_utf8(const boost::json::value& params,
+                                  boost::json::value& result);
+
+/** Rewrites the positions in messages between a client counting
+ *  columns in UTF-8 bytes and servers counting UTF-16 code units, the
+ *  LSP's default `positionEncoding`.
+ *
+ *  Lines come from the mirror of the client's documents, found by the
+ *  rope's line index, or from disk for files the client doesn't have
+ *  open.  Those are read once and kept, up to a number of them, until
+ *  they're said to change; their ASCII lines, where columns are the
+ *  same either way, are marked as read and left alone.  The line looked
+ *  up last is kept, as positions come in runs on the same one.  Members
+ *  named `data` or `arguments` are opaque: the servers get them back as
+ *  they were.
+ */
+class LSPLEX_EXPORT position_translator {
+public:
+  enum class direction : std::uint8_t { to_server, to_client };
+
+  explicit position_translator(const document_store& docs,
+                               std::size_t max_files = 64)
+      : _docs{docs}, _max_files{std::max<std::size_t>(max_files, 1)} {}
+
+  /** Rewrite the positions in V, going in direction D.  They're in
+   *  document URI, unless V says otherwise with a `uri` or the like.
+   */
+  void translate(boost::json::value& v, std::string_view uri, direction d);
+  void translate(boost::json::object& o, std::string_view uri, direction d);
+  /** Rewrite DATA, the relative encoding of `SemanticTokens` of URI. */
+  void translate_tokens(boost::json::array& data, std::string_view uri,
+                        direction d);
+
+  /** URI may have changed on disk: read it again when next needed. */
+  void forget(std::string_view uri);
+
+private:
+  struct file {
+    std::string text;
+    std::vector<std::size_t> starts;  // Of each line
+    std::vector<bool> wide;           // Lines with other than ASCII
+  };
+
+  const document_store& _docs;
+  std::size_t _max_files;
+  // The line looked up last
+  std::string _uri;
+  std::size_t _line_no{0};
+  std::optional<std::string> _line;
+  bool _cached{false};
+  // Files read from disk, or found missing
+  std::unordered_map<std::string, std::optional<file>> _files;
+  std::deque<std::string> _order;  // Keys in _files, oldest first
+
+  void reset();
+  const std::optional<file>& read(std::string_view uri);
+  const std::string* line_text(std::string_view uri, std::size_t line);
+  std::int64_t column(std::string_view uri, std::size_t line,
+                      std::int64_t character, direction d);
+  void walk(boost::json::value& v, std::string_view uri, direction d);
+  void walk(boost::json::object& o, std::string_view uri, direction d);
+};
+
+}  // namespace lsplex
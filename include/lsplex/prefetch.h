@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <boost/json.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "lsplex/export.hpp"
+
+namespace lsplex {
+
+/** Requests about a whole document that clients send as soon as they
+ *  open one, and that the proxy can send on their behalf.
+ */
+constexpr std::array<std::string_view, 5> prefetchable{
+    "textDocument/documentSymbol", "textDocument/semanticTokens/full",
+    "textDocument/foldingRange",   "textDocument/inlayHint",
+    "textDocument/codeLens",
+};
+
+/** Answers the client's first questions about a document before it
+ *  asks them.
+ *
+ *  When a document is opened or saved, requests for the allowed
+ *  methods about it are queued, to be sent a few at a time while its
+ *  backend has nothing else to do.  Results are kept by method, URI
+ *  and version for a short while, and taken by the first request of
+ *  the client's that matches, params and all; one that comes while the
+ *  result is on its way waits for it.
+ */
+class LSPLEX_EXPORT prefetcher {
+public:
+  using clock = std::chrono::steady_clock;
+
+  struct job {
+    std::string method;
+    std::string uri;
+    std::int64_t version{0};
+    boost::json::object params;
+    std::size_t backend{0};  // Once started
+  };
+
+  /** What take() found. */
+  struct found {
+    enum { nothing, pending, ready } what{nothing};
+    std::size_t backend{0};      // Pending: where it was sent
+    boost::json::value result{};  // Ready
+  };
+
+  prefetcher(std::vector<std::string> methods, std::size_t max_running,
+             clock::duration ttl = std::chrono::seconds{30});
+
+  [[nodiscard]] bool wants(std::string_view method) const;
+
+  /** URI was opened or saved, and is at VERSION with LINES lines. */
+  void queue(std::string_view uri, std::int64_t version, std::size_t lines,
+             clock::time_point now);
+  /** URI changed or was closed: nothing queued or kept for it is of use
+   *  anymore.
+   */
+  void forget(std::string_view uri);
+
+  /** The next job to send, if fewer than the maximum are running.
+   *  IDLE tells which backend a URI's jobs go to, or nullopt if that
+   *  one is busy: the queue then waits.
+   */
+  std::optional<job> start(
+      const std::function<std::optional<std::size_t>(std::string_view)>&
+          idle);
+  /** JOB is over, with RESULT unless it failed.  Returns the keys of
+   *  the client's requests waiting for it.  If there were none, RESULT
+   *  is kept until NOW plus the ttl.
+   */
+  std::vector<std::string> finish(const job& j,
+                                  std::optional<boost::json::value> result,
+                                  clock::time_point now);
+  /** Backend B forgot what it was asked: its jobs won't finish. */
+  void abandon(std::size_t b);
+
+  /** The client's request KEY asks METHOD about URI at VERSION, with
+   *  PARAMS.  If they are the ones the prefetch sent, a ready result
+   *  is handed over; if it's pending, KEY waits for it.
+   */
+  found take(std::string_view method, std::string_view uri,
+             std::int64_t version, const boost::json::object& params,
+             const std::string& key, clock::time_point now);
+
+  [[nodiscard]] std::size_t running() const { return _running; }
+  [[nodiscard]] std::size_t queued() const { return _queue.size(); }
+
+private:
+  struct entry {
+    std::string uri;
+    boost::json::object params;
+    std::size_t backend{0};
+    bool ready{false};
+    bool stale{false};  // Its document changed: not to be kept
+    boost::json::value result;
+    std::vector<std::string> waiters;  // Client request keys
+    clock::time_point expires;
+  };
+
+  std::vector<std::string> _methods;
+  std::size_t _max_running;
+  clock::duration _ttl;
+  std::size_t _running{0};
+  std::deque<job> _queue;
+  std::unordered_map<std::string, entry> _entries;
+
+  static std::string key_of(std::string_view method, std::string_view uri,
+                            std::int64_t version);
+  static boost::json::object params_for(std::string_view method,
+                                        std::string_view uri,
+                                        std::size_t lines);
+};
+
+}  // namespace lsplex
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <boost/json.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "lsplex/export.hpp"
+
+namespace lsplex {
+
+/** A hash of document contents, the same from run to run. */
+LSPLEX_EXPORT std::uint64_t content_hash(std::string_view text);
+
+/** Responses kept on disk across sessions, in one append-only file.
+ *
+ *  The file is a header followed by records, each a small fixed
+ *  header, the key and the serialized response.  It's memory-mapped,
+ *  and only an index of keys to offsets lives in memory, so a lookup
+ *  parses nothing but the response it hits.  A new response for a key
+ *  is appended and shadows the old one.  When the file outgrows its
+ *  cap, it's rewritten with the newest live records only.  A torn
+ *  record at the end (say, from a crash mid-append) is cut off when
+ *  the file is opened.
+ *
+ *  Several processes may share the file: appends and compaction take
+ *  an exclusive lock, and a process notices when another one replaced
+ *  the file by compacting it.
+ *
+ *  Only POSIX systems are supported.  Elsewhere, the cache is never
+ *  ok() and stores nothing.
+ */
+class LSPLEX_EXPORT response_cache {
+  struct record {
+    std::size_t offset;
+    std::size_t size;  // Header, key and value
+  };
+
+  std::string _path;
+  std::size_t _max_bytes;
+  int _fd{-1};
+  const char* _map{nullptr};
+  std::size_t _mapped{0};
+  std::size_t _end{0};  // Of the last valid record seen
+  std::size_t _live{0};
+  std::unordered_map<std::string, record> _index;
+
+  void open();
+  void close();
+  void scan();
+  bool map(std::size_t size);
+  bool replaced() const;
+  bool compact_locked();
+
+public:
+  response_cache(std::string path, std::size_t max_bytes);
+  ~response_cache();
+  response_cache(const response_cache&) = delete;
+  response_cache& operator=(const response_cache&) = delete;
+  response_cache(response_cache&&) = delete;
+  response_cache& operator=(response_cache&&) = delete;
+
+  [[nodiscard]] bool ok() const { return _fd != -1; }
+
+  /** Key for the response to METHOD on the document at URI, whose
+   *  contents hash to HASH, as given by SERVER.
+   */
+  static std::string key(std::string_view method, std::string_view uri,
+                         std::uint64_t hash, std::string_view server);
+
+  [[nodiscard]] std::optional<boost::json::value> lookup(
+      std::string_view key);
+  void store(std::string_view key, const boost::json::value& response);
+
+  /** Rewrite the file with only the newest live records, filling at
+   *  most half the cap.
+   */
+  void compact();
+
+  [[nodiscard]] std::size_t entries() const { return _index.size(); }
+  [[nodiscard]] std::size_t file_size() const { return _end; }
+};
+
+}  // namespace lsplex
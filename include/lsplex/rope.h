@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+#include "lsplex/export.hpp"
+
+namespace lsplex {
+
+/** Interning table for rope chunks.
+ *
+ *  Ropes built against the same pool share the memory of identical
+ *  chunks, so two documents with common content (a file opened
+ *  twice, a vendored copy, the unchanged bulk of a buffer after an
+ *  edit) cost that content once.  Chunks unregister themselves when
+ *  the last rope referencing them lets go.
+ */
+class LSPLEX_EXPORT chunk_pool {
+public:
+  using chunk = std::shared_ptr<const std::string>;
+
+  chunk_pool();
+  chunk intern(std::string_view text);
+
+  /** Bytes currently held by live chunks. */
+  [[nodiscard]] std::size_t bytes() const;
+  [[nodiscard]] std::size_t chunks() const;
+
+private:
+  struct table {
+    std::unordered_map<std::string_view, std::weak_ptr<const std::string>>
+        chunks;
+    std::size_t bytes{0};
+  };
+  std::shared_ptr<table> _table;
+};
+
+/** Immutable-node, height-balanced rope of bytes with a newline index.
+ *
+ *  Edits and line lookups are O(log n).  Copies are O(1) and share
+ *  structure, so snapshots of a document are cheap.
+ */
+class LSPLEX_EXPORT rope {
+  struct node;
+  using node_ptr = std::shared_ptr<const node>;
+
+  node_ptr _root;
+  chunk_pool* _pool{nullptr};
+
+  static node_ptr concat(node_ptr l, node_ptr r);
+  static node_ptr balance(node_ptr l, node_ptr r);
+  node_ptr leaf(std::string_view text) const;
+  node_ptr build(std::string_view text) const;
+  node_ptr join(const node_ptr& l, const node_ptr& r) const;
+  std::pair<node_ptr, node_ptr> split(const node_ptr& n,
+                                      std::size_t pos) const;
+
+public:
+  static constexpr std::size_t min_chunk = 256;
+  static constexpr std::size_t max_chunk = 2048;
+
+  rope() = default;
+  /** A rope for TEXT whose chunks are interned in POOL, if given. */
+  explicit rope(std::string_view text, chunk_pool* pool = nullptr);
+
+  [[nodiscard]] std::size_t size() const;
+  [[nodiscard]] bool empty() const { return size() == 0; }
+  /** Number of lines, i.e. newlines plus one. */
+  [[nodiscard]] std::size_t lines() const;
+
+  /** Replace bytes [FROM, TO) with TEXT. */
+  void replace(std::size_t from, std::size_t to, std::string_view text);
+
+  /** Byte offset where line LINE starts, or npos if there's no such
+   *  line.
+   */
+  [[nodiscard]] std::size_t line_start(std::size_t line) const;
+  /** Text of line LINE without its terminator, empty if none. */
+  [[nodiscard]] std::string line(std::size_t line) const;
+
+  [[nodiscard]] std::string substr(std::size_t pos,
+                                   std::size_t len = std::string::npos) const;
+  [[nodiscard]] std::string str() const { return substr(0); }
+};
+
+}  // namespace lsplex
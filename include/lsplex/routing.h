@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lsplex/export.hpp"
+
+namespace lsplex {
+
+/** `file://` URI for PATH, percent-encoding as needed.  Strings that
+ *  already look like URIs are returned as they are.
+ */
+LSPLEX_EXPORT std::string path_to_uri(std::string_view path);
+
+/** Path of the file at URI, undoing percent-encoding, or nullopt if
+ *  it isn't a `file://` URI.
+ */
+LSPLEX_EXPORT std::optional<std::string> uri_to_path(std::string_view uri);
+
+/** Which server instance, or shard, owns which documents.
+ *
+ *  Shard 0 is the default and owns everything not claimed by one of
+ *  the configured roots.  Root I is owned by shard I+1.  When roots
+ *  nest, the longest one wins.
+ */
+class LSPLEX_EXPORT shard_map {
+  std::vector<std::string> _roots;  // As URIs, without trailing '/'
+
+public:
+  shard_map() = default;
+  /** ROOTS are directories, as paths or URIs. */
+  explicit shard_map(const std::vector<std::string>& roots);
+
+  [[nodiscard]] std::size_t size() const { return _roots.size() + 1; }
+
+  /** The shard owning the document at URI. */
+  [[nodiscard]] std::size_t shard_of(std::string_view uri) const;
+
+  /** Root URI of SHARD, empty for the default one. */
+  [[nodiscard]] std::string_view root(std::size_t shard) const;
+};
+
+}  // namespace lsplex
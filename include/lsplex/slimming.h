@@ -0,0 +1,99 @@
+#pragma once
+
+#include <boost/json.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "lsplex/export.hpp"
+#include "lsplex/methods.h"
+
+namespace lsplex {
+
+/** Takes out of what goes to the client what it has no use for.
+ *
+ *  Fields of completion items, diagnostics and document symbols that
+ *  the client's `initialize` capabilities don't declare support for
+ *  are removed, and so are members of those that are null, which mean
+ *  the same as absent ones.  The `documentation` and `data` of
+ *  completion items are kept aside instead, by list, behind a token in
+ *  `data`, and brought back by `completionItem/resolve`: only the items
+ *  the client looks at cost their documentation.  Fields named in the
+ *  keep list are left alone, and so are `data` and `arguments`
+ *  elsewhere, which are the servers' own.
+ */
+class LSPLEX_EXPORT slimmer {
+public:
+  slimmer(const boost::json::object& client_capabilities,
+          const std::set<std::string, std::less<>>& keep,
+          std::size_t max_lists = 16);
+
+  /** The client's request KEY for M, with PARAMS, is on its way.  A
+   *  completion item to resolve gets what was kept aside back.  False
+   *  if it's for the proxy to answer, with PARAMS: servers that don't
+   *  resolve items have the client ask anyway, for documentation.
+   *  Tokens of lists no longer kept go to the server as they are.
+   */
+  bool request(const std::string& key, lsp::method m,
+               boost::json::object& params);
+
+  /** Slim MSG, on its way to the client.  Requests go as they are,
+   *  and so do responses to requests it wasn't told of.  Items already
+   *  slimmed keep their tokens: a list served again from a cache costs
+   *  nothing more.
+   */
+  void slim(boost::json::object& msg);
+
+  /** Completion lists with items kept aside. */
+  [[nodiscard]] std::size_t kept() const { return _lists.size(); }
+
+private:
+  struct kept_item {
+    std::optional<boost::json::value> data;  // Else the list's default
+    std::optional<boost::json::value> documentation;
+  };
+  struct kept_list {
+    std::optional<boost::json::value> data;  // From `itemDefaults`
+    std::vector<kept_item> items;
+  };
+  struct asked {
+    lsp::method method;
+    std::optional<boost::json::value> documentation;  // Resolving
+  };
+
+  // Fields the client doesn't support
+  std::vector<std::string> _item_fields;
+  std::vector<std::string> _diagnostic_fields;
+  std::vector<std::string> _symbol_fields;
+  bool _keep_documentation;
+  bool _keep_data;
+  bool _server_resolves{false};
+
+  // Items' fields, by the numbers of their list and of the item in it,
+  // in their token.  List numbers are consecutive, so the oldest lists
+  // go first when there are too many.
+  std::unordered_map<std::uint64_t, kept_list> _lists;
+  std::uint64_t _next{0};
+  std::uint64_t _oldest{0};
+  std::size_t _max_lists;
+
+  std::unordered_map<std::string, asked> _asked;
+
+  void initialized(boost::json::value& result);
+  void completion(boost::json::value& result);
+  void keep_aside(boost::json::object& item, kept_list& list,
+                  std::uint64_t number);
+  [[nodiscard]] bool known(const boost::json::value& data) const;
+  void resolved(boost::json::value& result,
+                std::optional<boost::json::value> documentation);
+  void diagnostics(boost::json::value* list);
+  void symbols(boost::json::value& result);
+};
+
+}  // namespace lsplex
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <boost/json.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "lsplex/export.hpp"
+
+namespace lsplex {
+
+/** Timelines of the client's requests through the proxy, for finding
+ *  out where the time goes.
+ *
+ *  Each request is followed from when its bytes start arriving to
+ *  when its response is written back, correlated by id.  The last
+ *  so many complete timelines are kept, and can be written out as
+ *  Chrome trace-event JSON, for chrome://tracing or Perfetto.
+ *  Marking a point is a hash lookup, cheap enough to leave on.
+ */
+class LSPLEX_EXPORT tracer {
+public:
+  using clock = std::chrono::steady_clock;
+
+  /** Where a request can be seen, in order. */
+  enum class point : std::uint8_t {
+    received,  // Its first bytes arrived from the client
+    parsed,    // It's been read whole and parsed
+    sent,      // It's been written to a server
+    answered,  // The first bytes of the response arrived from it
+    replied,   // The response has been written to the client
+  };
+
+  explicit tracer(std::size_t window);
+
+  /** Start the timelines of the requests in MSG, a message or batch
+   *  from the client, which started arriving at RECEIVED and was
+   *  parsed at PARSED.
+   */
+  void received(const boost::json::value& msg, clock::time_point received,
+                clock::time_point parsed);
+  /** MSG reached P at T: requests can be sent, and responses can be
+   *  answered or replied.  Other messages are ignored.
+   */
+  void mark(const boost::json::value& msg, point p, clock::time_point t);
+  /** Request KEY (as from lsp::id_key()) reached P at T. */
+  void mark(const std::string& key, point p, clock::time_point t);
+
+  /** How many complete timelines are kept. */
+  [[nodiscard]] std::size_t size() const { return _done.size(); }
+
+  /** The complete timelines, as Chrome trace-event JSON. */
+  [[nodiscard]] std::string chrome_json() const;
+  /** Write chrome_json() to PATH.  Returns whether it could. */
+  bool write(const std::string& path) const;
+
+private:
+  static constexpr std::size_t points = 5;
+
+  struct timeline {
+    std::uint64_t serial;
+    std::string key;
+    std::string method;
+    std::array<clock::time_point, points> at{};
+  };
+
+  std::size_t _window;
+  clock::time_point _epoch;
+  std::uint64_t _serial{0};
+  std::unordered_map<std::string, timeline> _open;
+  std::deque<std::string> _order;  // Keys in _open, oldest first
+  std::deque<timeline> _done;
+
+  void start(const boost::json::object& msg, clock::time_point received,
+             clock::time_point parsed);
+  void mark_one(const boost::json::object& msg, point p,
+                clock::time_point t);
+};
+
+}  // namespace lsplex
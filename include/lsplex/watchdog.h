@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lsplex/export.hpp"
+
+namespace lsplex {
+
+/** Notices when the event loop is held up, and by what.
+ *
+ *  A timer due every so often probes the loop: how late it fires is
+ *  the lag everything else due then suffered too.  Meanwhile, what
+ *  runs between waits is timed by `busy` scopes, and the longest run
+ *  since the previous probe gets the blame for a lag past the
+ *  threshold.  The latest lags are kept for percentiles.
+ */
+class LSPLEX_EXPORT stall_watch {
+public:
+  using clock = std::chrono::steady_clock;
+
+  /** Times what runs until it goes out of scope, if there's a watch.
+   *  WHAT and WHERE must outlive the watch: they're meant to be
+   *  literals, or method names from the method table.
+   */
+  class busy {
+  public:
+    busy(stall_watch* w, std::string_view what, std::string_view where)
+        : _w{w}, _what{what}, _where{where} {
+      if (_w != nullptr) _start = clock::now();
+    }
+    ~busy() {
+      if (_w != nullptr) _w->ran(_what, _where, clock::now() - _start);
+    }
+    busy(const busy&) = delete;
+    busy& operator=(const busy&) = delete;
+    busy(busy&&) = delete;
+    busy& operator=(busy&&) = delete;
+
+  private:
+    stall_watch* _w;
+    std::string_view _what;
+    std::string_view _where;
+    clock::time_point _start;
+  };
+
+  explicit stall_watch(clock::duration threshold, std::size_t window = 4096);
+
+  /** WHAT, coming from WHERE, kept the loop for TOOK. */
+  void ran(std::string_view what, std::string_view where,
+           clock::duration took);
+  /** A probe due at DUE fired at NOW.  What to log, if that's late
+   *  enough to be a stall.
+   */
+  std::optional<std::string> probe(clock::time_point due,
+                                   clock::time_point now);
+
+  /** The lag that fraction P of the latest probes didn't exceed. */
+  [[nodiscard]] clock::duration percentile(double p) const;
+  /** The usual lag percentiles, and the worst lag of all. */
+  [[nodiscard]] std::string summary() const;
+  [[nodiscard]] std::size_t probes() const { return _probes; }
+
+private:
+  clock::duration _threshold;
+  std::vector<clock::duration> _lags;  // The latest, as a ring
+  std::size_t _window;
+  std::size_t _probes{0};
+  clock::duration _worst{};
+  // The longest run since the previous probe
+  std::string_view _what;
+  std::string_view _where;
+  clock::duration _longest{};
+};
+
+}  // namespace lsplex
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <boost/json.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "lsplex/export.hpp"
+
+namespace lsplex {
+
+/** Changes to watched files, as the client reported them, netted out
+ *  per URI.
+ *
+ *  A file created then deleted is no news at all, and one deleted then
+ *  created was just changed.  A change adds nothing to a creation, and
+ *  otherwise the latest event stands.  URIs keep the order they first
+ *  came in.  Events of types the LSP doesn't have are left out.
+ */
+class LSPLEX_EXPORT watched_changes {
+public:
+  // `FileChangeType`s
+  static constexpr std::int64_t created = 1;
+  static constexpr std::int64_t changed = 2;
+  static constexpr std::int64_t deleted = 3;
+
+  /** Take in CHANGES, the `FileEvent`s of a `didChangeWatchedFiles`. */
+  void add(const boost::json::array& changes);
+  /** The net events, leaving none. */
+  boost::json::array take();
+
+  [[nodiscard]] bool empty() const { return _net == 0; }
+  [[nodiscard]] std::size_t size() const { return _net; }
+
+private:
+  struct event {
+    std::string uri;
+    std::int64_t type{0};  // Zero if it came to nothing
+  };
+  std::vector<event> _events;
+  std::unordered_map<std::string, std::size_t> _index;  // Into _events
+  std::size_t _net{0};
+};
+
+}  // namespace lsplex
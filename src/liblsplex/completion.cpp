@@ -0,0 +1,272 @@
+#include "lsplex/completion.h"
+
+#include <algorithm>
+#include <boost/json.hpp>
+#include <utility>
+
+namespace json = boost::json;
+
+namespace lsplex {
+
+namespace {
+  constexpr bool is_upper(char c) { return c >= 'A' && c <= 'Z'; }
+  constexpr bool is_lower(char c) { return c >= 'a' && c <= 'z'; }
+  constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
+  constexpr bool is_word(char c) {
+    return is_upper(c) || is_lower(c) || is_digit(c) || c == '_';
+  }
+  constexpr char to_lower(char c) {
+    return is_upper(c) ? static_cast<char>(c - 'A' + 'a') : c;
+  }
+
+  // One bit per case-folded letter, digit and '_'.  Other characters
+  // contribute nothing, so they never cause a false rejection.
+  constexpr std::uint64_t char_bit(char c) {
+    c = to_lower(c);
+    if (is_lower(c)) return std::uint64_t{1} << static_cast<unsigned>(c - 'a');
+    if (is_digit(c))
+      return std::uint64_t{1} << static_cast<unsigned>(26 + c - '0');
+    if (c == '_') return std::uint64_t{1} << 36U;
+    return 0;
+  }
+
+  constexpr std::uint64_t char_mask(std::string_view s) {
+    std::uint64_t m = 0;
+    for (auto c : s) m |= char_bit(c);
+    return m;
+  }
+
+  constexpr bool is_boundary(std::string_view s, std::size_t i) {
+    if (i == 0) return true;
+    auto prev = s[i - 1];
+    auto cur = s[i];
+    return !is_word(prev) || (prev == '_' && cur != '_')
+           || (is_lower(prev) && is_upper(cur))
+           || (!is_digit(prev) && is_digit(cur));
+  }
+
+  std::string_view filter_text(const json::object& item) {
+    auto text = lsp::get_string(item, "filterText");
+    if (!text) text = lsp::get_string(item, "label");
+    if (!text) return {};
+    auto sv = *text;
+    // clangd pads labels with a space or a bullet to mark insertions.
+    while (!sv.empty() && !is_word(sv.front())
+           && static_cast<unsigned char>(sv.front()) < 0x80)
+      sv.remove_prefix(1);
+    return sv;
+  }
+
+  // What clients sort ITEM by, among items of the same score.
+  std::string_view sort_text(const json::value& item) {
+    const auto* o = item.if_object();
+    if (o == nullptr) return {};
+    auto text = lsp::get_string(*o, "sortText");
+    if (!text) text = lsp::get_string(*o, "label");
+    return text.value_or(std::string_view{});
+  }
+
+  // Move the end of RANGE right by DELTA if it was at or past FROM, on
+  // LINE: the characters typed since went in before it.
+  void stretch(json::value* range, std::size_t line, std::size_t from,
+               std::size_t delta) {
+    auto* r = range != nullptr ? range->if_object() : nullptr;
+    auto* end = r != nullptr ? r->if_contains("end") : nullptr;
+    auto* e = end != nullptr ? end->if_object() : nullptr;
+    if (e == nullptr) return;
+    auto at = lsp::get_position(*r, "end");
+    if (!at || at->line != line || at->character < from) return;
+    e->insert_or_assign("character",
+                         static_cast<std::int64_t>(at->character + delta));
+  }
+
+  // The same for an edit: a `Range` or an `InsertReplaceEdit`'s two.
+  void stretch_edit(json::object& edit, std::string_view range,
+                    std::size_t line, std::size_t from, std::size_t delta) {
+    stretch(edit.if_contains(range), line, from, delta);
+    stretch(edit.if_contains("insert"), line, from, delta);
+    stretch(edit.if_contains("replace"), line, from, delta);
+  }
+
+  // Like fuzzy_score, but with PATTERN's mask precomputed.
+  std::optional<int> score_masked(std::string_view pattern,
+                                  std::uint64_t pattern_mask,
+                                  std::string_view candidate,
+                                  std::uint64_t candidate_mask) {
+    if ((pattern_mask & ~candidate_mask) != 0) return std::nullopt;
+    return fuzzy_score(pattern, candidate);
+  }
+}  // namespace
+
+std::optional<int> fuzzy_score(std::string_view pattern,
+                               std::string_view candidate) {
+  if (pattern.size() > candidate.size()) return std::nullopt;
+  int score = 0;
+  std::size_t ci = 0;
+  bool consecutive = false;
+  for (auto p : pattern) {
+    auto lp = to_lower(p);
+    for (;; ++ci) {
+      if (ci == candidate.size()) return std::nullopt;
+      if (to_lower(candidate[ci]) == lp) break;
+      consecutive = false;
+    }
+    score += 1;
+    if (ci == 0)
+      score += 8;
+    else if (is_boundary(candidate, ci))
+      score += 6;
+    if (consecutive) score += 5;
+    if (candidate[ci] == p) score += 1;
+    consecutive = true;
+    ++ci;
+  }
+  // Among equals, prefer the shorter candidate.
+  score -= static_cast<int>((candidate.size() - pattern.size()) / 8);
+  return score;
+}
+
+std::string_view word_prefix(std::string_view line, std::size_t column) {
+  column = std::min(column, line.size());
+  auto start = column;
+  while (start > 0 && is_word(line[start - 1])) --start;
+  return line.substr(start, column - start);
+}
+
+void completion_cache::store(std::string_view uri, lsp::position at,
+                             std::string_view prefix,
+                             const json::value& result) {
+  const json::array* items = result.if_array();
+  if (const auto* list = result.if_object()) {
+    const auto* incomplete = list->if_contains("isIncomplete");
+    if (incomplete != nullptr && incomplete->is_bool()
+        && incomplete->get_bool()) {
+      invalidate(uri);
+      return;
+    }
+    items = lsp::get_array(*list, "items");
+  }
+  if (items == nullptr || at.character < prefix.size()) {
+    invalidate(uri);
+    return;
+  }
+
+  entry e{at.line, at.character - prefix.size(), std::string{prefix}, *items,
+          {}};
+  if (const auto* list = result.if_object())
+    if (const auto* defaults = lsp::get_object(*list, "itemDefaults"))
+      e.defaults = *defaults;
+  e.offsets.reserve(e.items.size() + 1);
+  e.masks.reserve(e.items.size());
+  e.offsets.push_back(0);
+  for (const auto& v : e.items) {
+    const auto* item = v.if_object();
+    auto text = item != nullptr ? filter_text(*item) : std::string_view{};
+    e.texts.append(text);
+    e.offsets.push_back(static_cast<std::uint32_t>(e.texts.size()));
+    e.masks.push_back(char_mask(text));
+  }
+  _entries.insert_or_assign(std::string{uri}, std::move(e));
+}
+
+std::optional<json::object> completion_cache::lookup(std::string_view uri,
+                                                     lsp::position at,
+                                                     std::string_view prefix) {
+  auto it = _entries.find(std::string{uri});
+  if (it == _entries.end()) return std::nullopt;
+  auto& e = it->second;
+  if (at.line != e.line || at.character < prefix.size()
+      || at.character - prefix.size() != e.word_start
+      || !prefix.starts_with(e.prefix))
+    return std::nullopt;
+
+  auto text = [&e](std::uint32_t i) {
+    return std::string_view{e.texts}.substr(e.offsets[i],
+                                            e.offsets[i + 1] - e.offsets[i]);
+  };
+
+  std::vector<std::uint32_t> matches;
+  std::vector<std::pair<int, std::uint32_t>> scored;
+  auto pmask = char_mask(prefix);
+  auto consider = [&](std::uint32_t i) {
+    if (auto s = score_masked(prefix, pmask, text(i), e.masks[i])) {
+      matches.push_back(i);
+      scored.emplace_back(*s, i);
+    }
+  };
+  if (!e.last_prefix.empty() && prefix.starts_with(e.last_prefix)) {
+    scored.reserve(e.last_matches.size());
+    for (auto i : e.last_matches) consider(i);
+  } else {
+    auto n = static_cast<std::uint32_t>(e.items.size());
+    scored.reserve(n);
+    for (std::uint32_t i = 0; i < n; ++i) consider(i);
+  }
+  e.last_prefix = prefix;
+  e.last_matches = std::move(matches);
+
+  std::stable_sort(scored.begin(), scored.end(),
+                   [&e](const auto& a, const auto& b) {
+                     if (a.first != b.first) return a.first > b.first;
+                     return sort_text(e.items[a.second])
+                            < sort_text(e.items[b.second]);
+                   });
+
+  // Edits must take in the position asked about, which is further on
+  // by what was typed since the list was computed.
+  auto from = e.word_start + e.prefix.size();
+  auto delta = at.character - from;
+  json::array items;
+  items.reserve(scored.size());
+  for (auto [score, i] : scored) {
+    auto& item = items.emplace_back(e.items[i]);
+    auto* o = item.if_object();
+    auto* edit = o != nullptr ? o->if_contains("textEdit") : nullptr;
+    if (delta > 0 && edit != nullptr && edit->is_object())
+      stretch_edit(edit->get_object(), "range", e.line, from, delta);
+  }
+  json::object list{{"isIncomplete", false}, {"items", std::move(items)}};
+  if (!e.defaults.empty()) {
+    auto defaults = e.defaults;
+    // A `Range`, or insert and replace ones
+    if (auto* range = defaults.if_contains("editRange");
+        delta > 0 && range != nullptr && range->is_object()) {
+      stretch(range, e.line, from, delta);
+      stretch_edit(range->get_object(), "range", e.line, from, delta);
+    }
+    list.insert_or_assign("itemDefaults", std::move(defaults));
+  }
+  return list;
+}
+
+void completion_cache::did_change(const json::object& params) {
+  auto uri = lsp::document_uri(params);
+  if (!uri) return;
+  auto it = _entries.find(std::string{*uri});
+  if (it == _entries.end()) return;
+  const auto* changes = lsp::get_array(params, "contentChanges");
+  if (changes == nullptr) return;
+  for (const auto& c : *changes) {
+    const auto* change = c.if_object();
+    const auto* range
+        = change != nullptr ? lsp::get_object(*change, "range") : nullptr;
+    auto start = range != nullptr ? lsp::get_position(*range, "start")
+                                  : std::nullopt;
+    auto end
+        = range != nullptr ? lsp::get_position(*range, "end") : std::nullopt;
+    auto text = change != nullptr ? lsp::get_string(*change, "text")
+                                  : std::nullopt;
+    if (!start || !end || !text || start->line != it->second.line
+        || end->line != it->second.line
+        || text->find('\n') != std::string_view::npos) {
+      _entries.erase(it);
+      return;
+    }
+  }
+}
+
+void completion_cache::invalidate(std::string_view uri) {
+  _entries.erase(std::string{uri});
+}
+
+}  // namespace lsplex
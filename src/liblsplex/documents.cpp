@@ -0,0 +1,155 @@
+#include "lsplex/documents.h"
+
+#include <algorithm>
+#include <boost/json.hpp>
+#include <cstring>
+
+namespace json = boost::json;
+
+namespace lsplex {
+
+namespace {
+  // Length of the ASCII prefix of S, where bytes and UTF-16 units are
+  // one and the same.  Looked at eight bytes at a time: most source
+  // lines are all ASCII.
+  std::size_t ascii_prefix(std::string_view s) {
+    constexpr std::uint64_t high_bits = 0x8080808080808080U;
+    std::size_t i = 0;
+    for (; i + sizeof(std::uint64_t) <= s.size(); i += sizeof(std::uint64_t)) {
+      std::uint64_t word = 0;
+      std::memcpy(&word, s.data() + i, sizeof word);
+      if ((word & high_bits) != 0) break;
+    }
+    while (i < s.size() && static_cast<unsigned char>(s[i]) < 0x80) ++i;
+    return i;
+  }
+}  // namespace
+
+std::size_t utf16_to_byte(std::string_view line, std::size_t units) {
+  auto i = ascii_prefix(line.substr(0, units));
+  if (i == units) return i;
+  units -= i;
+  while (i < line.size() && units > 0) {
+    auto c = static_cast<unsigned char>(line[i]);
+    std::size_t len = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+    // Four-byte sequences are surrogate pairs: two UTF-16 units.
+    std::size_t width = len == 4 ? 2 : 1;
+    if (width > units) break;
+    units -= width;
+    i += len;
+  }
+  return std::min(i, line.size());
+}
+
+std::size_t byte_to_utf16(std::string_view line, std::size_t bytes) {
+  line = line.substr(0, bytes);
+  auto i = ascii_prefix(line);
+  auto units = i;
+  for (; i < line.size(); ++i) {
+    auto c = static_cast<unsigned char>(line[i]);
+    // Count lead bytes, four-byte ones twice: surrogate pairs.
+    if ((c & 0xC0U) != 0x80U) units += c >= 0xF0 ? 2 : 1;
+  }
+  return units;
+}
+
+namespace {
+  // Byte offset of AT in TEXT.  Positions past the last line clamp
+  // to the end of the text.
+  std::size_t offset_of(const rope& text, lsp::position at) {
+    auto start = text.line_start(at.line);
+    if (start == std::string::npos) return text.size();
+    return start + utf16_to_byte(text.line(at.line), at.character);
+  }
+}  // namespace
+
+document_store::document* document_store::find_mut(std::string_view uri) {
+  auto it = _docs.find(std::string{uri});
+  return it == _docs.end() ? nullptr : &it->second;
+}
+
+const document_store::document* document_store::find(
+    std::string_view uri) const {
+  auto it = _docs.find(std::string{uri});
+  return it == _docs.end() ? nullptr : &it->second;
+}
+
+void document_store::did_open(const json::object& params) {
+  const auto* td = lsp::get_object(params, "textDocument");
+  if (td == nullptr) return;
+  auto uri = lsp::get_string(*td, "uri");
+  auto text = lsp::get_string(*td, "text");
+  if (!uri || !text) return;
+  _docs.insert_or_assign(
+      std::string{*uri},
+      document{rope{*text, &_pool}, lsp::get_int(*td, "version").value_or(0),
+               std::string{lsp::get_string(*td, "languageId").value_or("")}});
+}
+
+template <typename Params, typename Before>
+void document_store::apply(Params& params, const Before& before) {
+  const auto* td = lsp::get_object(params, "textDocument");
+  auto* changes = params.if_contains("contentChanges");
+  if (td == nullptr || changes == nullptr || !changes->is_array()) return;
+  auto uri = lsp::get_string(*td, "uri");
+  auto* doc = uri ? find_mut(*uri) : nullptr;
+  if (doc == nullptr) return;
+
+  for (auto& c : changes->get_array()) {
+    auto* change = c.if_object();
+    if (change == nullptr) continue;
+    auto text = lsp::get_string(*change, "text");
+    if (!text) continue;
+    auto* r = change->if_contains("range");
+    auto* range = r != nullptr ? r->if_object() : nullptr;
+    if (range == nullptr) {
+      doc->text = rope{*text, &_pool};
+      continue;
+    }
+    before(*range);
+    auto start = lsp::get_position(*range, "start");
+    auto end = lsp::get_position(*range, "end");
+    if (!start || !end) continue;
+    auto from = offset_of(doc->text, *start);
+    auto to = std::max(from, offset_of(doc->text, *end));
+    doc->text.replace(from, to, *text);
+  }
+  if (auto v = lsp::get_int(*td, "version")) doc->version = *v;
+}
+
+void document_store::did_change(const json::object& params) {
+  apply(params, [](const json::object&) {});
+}
+
+void document_store::did_change(
+    json::object& params,
+    const std::function<void(json::object& range)>& before) {
+  apply(params, before);
+}
+
+void document_store::did_close(const json::object& params) {
+  if (auto uri = lsp::document_uri(params)) _docs.erase(std::string{*uri});
+}
+
+std::optional<std::string> document_store::line(std::string_view uri,
+                                                std::size_t line) const {
+  const auto* doc = find(uri);
+  if (doc == nullptr || line >= doc->text.lines()) return std::nullopt;
+  return doc->text.line(line);
+}
+
+std::optional<std::int64_t> document_store::version(
+    std::string_view uri) const {
+  const auto* doc = find(uri);
+  if (doc == nullptr) return std::nullopt;
+  return doc->version;
+}
+
+std::optional<std::size_t> document_store::offset(std::string_view uri,
+                                                  lsp::position at) const {
+  const auto* doc = find(uri);
+  if (doc == nullptr) return std::nullopt;
+  return offset_of(doc->text, at);
+}
+
+}  // namespace lsplex
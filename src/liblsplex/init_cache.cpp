@@ -0,0 +1,75 @@
+#include "lsplex/init_cache.h"
+
+#include <fmt/core.h>
+
+#include <boost/filesystem.hpp>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+
+namespace fs = boost::filesystem;
+namespace json = boost::json;
+
+namespace lsplex {
+
+std::string init_cache::key(std::string_view server, std::string_view root) {
+  return fmt::format("{}\n{}", server, root);
+}
+
+std::string init_cache::path_of(std::string_view key) const {
+  // FNV-1a, which unlike std::hash is the same from run to run
+  std::uint64_t h = 14695981039346656037ULL;
+  for (auto c : key) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 1099511628211ULL;
+  }
+  return (fs::path{_dir} / fmt::format("init-{:016x}.json", h)).string();
+}
+
+std::optional<json::value> init_cache::load(std::string_view key) const {
+  std::ifstream file{path_of(key), std::ios::binary};
+  if (!file) return std::nullopt;
+  std::stringstream text;
+  text << file.rdbuf();
+  boost::system::error_code ec;
+  auto entry = json::parse(text.str(), ec);
+  // The key is stored too: file names are hashes, and may collide.
+  const auto* o = entry.if_object();
+  if (ec || o == nullptr) return std::nullopt;
+  const auto* k = o->if_contains("key");
+  const auto* result = o->if_contains("result");
+  if (k == nullptr || result == nullptr || !k->is_string()
+      || k->get_string() != key)
+    return std::nullopt;
+  return *result;
+}
+
+void init_cache::store(std::string_view key, const json::value& result) const {
+  boost::system::error_code ec;
+  fs::create_directories(_dir, ec);
+  auto path = path_of(key);
+  auto tmp = fmt::format("{}.{}.tmp", path, fs::unique_path().string());
+  {
+    std::ofstream file{tmp, std::ios::binary | std::ios::trunc};
+    file << json::serialize(json::object{{"key", json::string_view{key}},
+                                         {"result", result}});
+    if (!file) {
+      fmt::println(stderr, "Can't write '{}'", tmp);
+      fs::remove(tmp, ec);
+      return;
+    }
+  }
+  // Readers see the old entry or the new one, never half of one.
+  fs::rename(tmp, path, ec);
+  if (ec) {
+    fmt::println(stderr, "Can't write '{}': {}", path, ec.message());
+    fs::remove(tmp, ec);
+  }
+}
+
+void init_cache::erase(std::string_view key) const {
+  boost::system::error_code ec;
+  fs::remove(path_of(key), ec);
+}
+
+}  // namespace lsplex
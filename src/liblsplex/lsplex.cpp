@@ -12,54 +12,368 @@
 #include <boost/json/serialize.hpp>
 #include <boost/process/v2.hpp>
 #include <boost/process/v2/environment.hpp>
+#include <algorithm>
+#include <array>
+#include <csignal>
+#include <optional>
 #include <stdexcept>
+#include <string>
+#include <variant>
+#include <vector>
 
 #include "jsonrpc/jsonrpc.h"
 #include "jsonrpc/pal/pal.h"
+#include "jsonrpc/passthrough.h"
+#include "lsplex/pipeline.h"
+#include "session.h"
 
 namespace asio = boost::asio;
 namespace bp2 = boost::process::v2;
 namespace fs = boost::filesystem;
+namespace json = boost::json;
 
 namespace lsplex {
 
-LsPlex::LsPlex(std::vector<LsContact> contacts)
-    : _contacts(std::move(contacts)) {}
+LsPlex::LsPlex(std::vector<LsContact> contacts, LsOptions options)
+    : _contacts(std::move(contacts)), _options{options} {}
+
+namespace {
+
+/** A running instance of the server program. */
+struct server {
+  server_in_t in;
+  server_out_t out;
+  bp2::process proc;
+
+  server(asio::io_context& ioc, const fs::path& exe,
+         const std::vector<std::string>& args, jsonrpc::framing framing)
+      : in{asio::readable_pipe{ioc}, framing},
+        out{asio::writable_pipe{ioc}, framing},
+        proc{ioc, exe, args,
+             bp2::process_stdio{out.handle(), in.handle(), {}}} {}
+};
 
 enum class direction { client2server, server2client };
 
-template <direction d, typename Source, typename Sink>
-asio::awaitable<void> transfer(Source& source, Sink& sink) {
-  const auto* dir = d==direction::client2server?"client2server":"server2client";
+/** Move messages from SOURCE into the session: from the client or,
+ *  for server2client, from backend B.
+ */
+template <direction d> constexpr const char* name_of() {
+  return d == direction::client2server ? "client2server" : "server2client";
+}
+
+/** Who sends what goes in direction D, for the stall watch. */
+template <direction d> constexpr std::string_view sender_of() {
+  return d == direction::client2server ? "the client" : "a server";
+}
+
+/** What MSG is, for the stall watch: its method, if the LSP has it. */
+std::string_view what_of(const json::value& msg) {
+  const auto* o = msg.if_object();
+  if (o == nullptr) return "a batch";
+  auto name = lsp::get_string(*o, "method");
+  if (!name) return "a response";
+  auto known = lsp::traits(*name).name;
+  return known.empty() ? "a custom method" : known;
+}
+
+/** Run MSG through pipeline P, then hand it to the session. */
+template <direction d, typename Pipeline>
+void dispatch(json::value msg, session& s, std::size_t b, Pipeline& p) {
+  // Answers to the client's batch, which go back in its own
+  std::vector<json::object> answered;
+  // Whether O goes on to the session.  Answers go back where O came
+  // from, bypassing the session: it never saw the question.  Those to
+  // a batch are for the session to put in the batch's response.
+  auto admit = [&](json::object& o, bool batched) {
+    switch (p(o)) {
+      case verdict::pass:
+        return true;
+      case verdict::drop:
+        return false;
+      case verdict::answer:
+        if constexpr (d == direction::client2server) {
+          if (batched)
+            answered.push_back(std::move(o));
+          else
+            s.to_client().post(std::move(o));
+        } else {
+          s.to_server(b).post(std::move(o));
+        }
+        return false;
+    }
+    return false;
+  };
+  if (auto* batch = msg.if_array()) {
+    auto size = batch->size();
+    batch->erase(std::remove_if(batch->begin(), batch->end(),
+                                [&](json::value& v) {
+                                  auto* o = v.if_object();
+                                  return o != nullptr && !admit(*o, true);
+                                }),
+                 batch->end());
+    if constexpr (d == direction::client2server) {
+      if (size == 0 || !batch->empty() || !answered.empty())
+        s.from_client_batch(std::move(*batch), std::move(answered));
+    } else {
+      for (auto& v : *batch)
+        if (auto* o = v.if_object()) s.from_server(b, std::move(*o));
+    }
+  } else if (auto* object = msg.if_object()) {
+    if (!admit(*object, false)) return;
+    if constexpr (d == direction::client2server)
+      s.from_client(std::move(*object));
+    else
+      s.from_server(b, std::move(*object));
+  } else {
+    fmt::println(stderr, "Ignoring a non-message in direction {}",
+                 name_of<d>());
+  }
+}
+
+template <direction d, typename Source, typename Pipeline>
+asio::awaitable<void> transfer(Source& source, session& s, Pipeline& p,
+                               std::size_t b = 0) {
+  const auto* dir = name_of<d>();
   try {
     for (;;) {
-      auto object = co_await source.async_get(boost::asio::use_awaitable);
-      co_await sink.async_put(object, boost::asio::use_awaitable);
-      fmt::println(stderr, "One object successfully transferred direction {}", dir);
+      auto msg
+          = co_await source.async_get_message(boost::asio::use_awaitable);
+      auto* w = s.watching();
+      if (w != nullptr) w->ran("parsing", sender_of<d>(), source.parse_time());
+      stall_watch::busy busy{w, what_of(msg), sender_of<d>()};
+      if (auto* t = s.tracing()) {
+        if constexpr (d == direction::client2server)
+          t->received(msg, source.arrived(), tracer::clock::now());
+        else
+          t->mark(msg, tracer::point::answered, source.arrived());
+      }
+      dispatch<d>(std::move(msg), s, b, p);
     }
   } catch (std::exception& e) {
     fmt::println(stderr, "Exception in direction {}: {}", dir, e.what());
   }
-  // In theory, we should be able to wait on the two 'transfer' calls
-  // as well as the child process in some sort of && chain, but we
-  // can't because per-op cancellation is _not_ supported on Windows
-  // for asio::windows::basic_object_handle (according to Klemens
-  // Morgenstern).  So we close the sink's handle which should be
-  // enough to convince the process to kill itself.
-  sink.handle().close();
+  if constexpr (d == direction::client2server) s.client_closed();
 }
 
-asio::awaitable<void> doit(auto& our_stdin, auto& our_stdout, auto& child_stdin,
-                           auto& child_stdout, auto& child_proc) {
+#if defined(__linux__)
+/** Like transfer() from backend B, but the bodies of big messages
+ *  the session needn't look into are spliced from the server's pipe
+ *  to the client's: they never enter user space.  Both must use
+ *  Content-Length framing, as bodies may have newlines in them, and
+ *  there must be no pipeline stages for them to skip.
+ */
+asio::awaitable<void> relay(server& srv, session& s, std::size_t b) {
+  constexpr std::size_t splice_min = 64 * 1024;  // Smaller isn't worth it
+  constexpr std::size_t head_size = 256;         // Enough for the envelope
+  plain_pipeline none;
+  auto& client = s.to_client();
+  auto& in = *srv.in.get_if<jsonrpc::content_length>();
+  jsonrpc::splicer splicer{in.handle().get_executor(),
+                           in.handle().native_handle(),
+                           client.sink()->handle().native_handle()};
+  try {
+    for (;;) {
+      auto length = co_await in.async_get_header(asio::use_awaitable);
+      auto arrived = in.arrived();
+      // Also take whatever was read ahead, so what's left of the
+      // body is all in the pipe.
+      std::string body(
+          length < splice_min
+              ? length
+              : std::min(length, std::max(head_size, in.buffered())),
+          '\0');
+      co_await in.async_get_body(asio::buffer(body), asio::use_awaitable);
+      auto left = length - body.size();
+      auto head = left > 0 ? jsonrpc::sniff(body) : std::nullopt;
+      if (head && s.pass_through(b, *head)) {
+        auto* t = head->method.empty() ? s.tracing() : nullptr;
+        if (t != nullptr)
+          t->mark(std::string{head->id}, tracer::point::answered, arrived);
+        auto* sink = co_await client.seize();
+        if (sink == nullptr) {
+          // The client is gone: just skip it.
+          body.resize(left);
+          co_await in.async_get_body(asio::buffer(body), asio::use_awaitable);
+          continue;
+        }
+        auto header = jsonrpc::content_length::header(length);
+        boost::system::error_code ec;
+        co_await asio::async_write(
+            sink->handle(),
+            std::array{asio::buffer(header), asio::buffer(body)},
+            asio::redirect_error(asio::use_awaitable, ec));
+        if (!ec)
+          co_await splicer.async_move(
+              left, asio::redirect_error(asio::use_awaitable, ec));
+        client.release();
+        if (ec) throw boost::system::system_error{ec};
+        if (t != nullptr)
+          t->mark(std::string{head->id}, tracer::point::replied,
+                  tracer::clock::now());
+        continue;
+      }
+      body.resize(length);
+      co_await in.async_get_body(
+          asio::buffer(body.data() + (length - left), left),
+          asio::use_awaitable);
+      auto* w = s.watching();
+      auto since = stall_watch::clock::now();
+      auto msg = json::parse(body);
+      if (w != nullptr)
+        w->ran("parsing", "a server", stall_watch::clock::now() - since);
+      stall_watch::busy busy{w, what_of(msg), "a server"};
+      if (auto* t = s.tracing())
+        t->mark(msg, tracer::point::answered, arrived);
+      dispatch<direction::server2client>(std::move(msg), s, b, none);
+    }
+  } catch (std::exception& e) {
+    fmt::println(stderr, "Exception in direction {}: {}",
+                 name_of<direction::server2client>(), e.what());
+  }
+}
+#endif
 
-  using namespace asio::experimental::awaitable_operators;  // NOLINT
-  asio::co_spawn(co_await asio::this_coro::executor, transfer<direction::client2server>(our_stdin, child_stdin), asio::detached);
-  asio::co_spawn(co_await asio::this_coro::executor, transfer<direction::server2client>(child_stdout, our_stdout), asio::detached);
+/** Write the session's trace to PATH, and log the event loop's lag,
+ *  each time SIGNALS fires.
+ */
+asio::awaitable<void> report(asio::signal_set& signals, session& s,
+                             std::string path) {
+  for (;;) {
+    boost::system::error_code ec;
+    co_await signals.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+    if (ec) co_return;
+    if (auto* t = s.tracing(); t != nullptr && t->write(path))
+      fmt::println(stderr, "Wrote {} request timelines to '{}'", t->size(),
+                   path);
+    if (auto* w = s.watching()) fmt::println(stderr, "{}", w->summary());
+  }
+}
 
-  auto ret = co_await child_proc.async_wait(boost::asio::use_awaitable);
-  fmt::println(stderr, "Process exited with '{}'", ret);
+/** Probe the event loop with TIMER, due EVERY so often, for W.  Runs
+ *  until the timer's cancelled.
+ */
+asio::awaitable<void> probe_lag(asio::steady_timer& timer, stall_watch& w,
+                                stall_watch::clock::duration every) {
+  for (;;) {
+    auto due = stall_watch::clock::now() + every;
+    timer.expires_at(due);
+    boost::system::error_code ec;
+    co_await timer.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+    if (ec) co_return;
+    if (auto stall = w.probe(due, stall_watch::clock::now()))
+      fmt::println(stderr, "{}", *stall);
+  }
+}
+
+template <typename Pipeline>
+asio::awaitable<void> read_server(server& srv, session& s, Pipeline& p,
+                                  std::size_t b) {
+#if defined(__linux__)
+  auto* client = s.to_client().sink();
+  if (Pipeline::empty && client != nullptr
+      && srv.in.get_if<jsonrpc::content_length>() != nullptr
+      && client->get_if<jsonrpc::content_length>() != nullptr
+      && jsonrpc::splicer::possible(srv.in.handle().native_handle(),
+                                    client->handle().native_handle())) {
+    co_await relay(srv, s, b);
+  } else {
+    co_await transfer<direction::server2client>(srv.in, s, p, b);
+  }
+#else
+  co_await transfer<direction::server2client>(srv.in, s, p, b);
+#endif
+  // A server that can't talk to us is of no use, even if alive.
+  boost::system::error_code ec;
+  srv.proc.terminate(ec);
+}
+
+asio::awaitable<int> wait_server(server& srv, session& s, std::size_t b) {
+  auto ret = co_await srv.proc.async_wait(boost::asio::use_awaitable);
+  s.server_exited(b);
+  co_return ret;
+}
+
+/** Put backend B to sleep whenever it's been idle long enough, and
+ *  wake it up when it's needed.  Runs until cancelled.
+ */
+asio::awaitable<void> doze(server& srv, session& s, const LsOptions& options,
+                           std::size_t b) {
+  asio::steady_timer timer{co_await asio::this_coro::executor};
+  auto pid = static_cast<int>(srv.proc.id());
+  for (;;) {
+    auto quiet = s.quiet_for(b);
+    if (quiet < options.hibernate_after) {
+      timer.expires_after(options.hibernate_after - quiet);
+      co_await timer.async_wait(asio::use_awaitable);
+      continue;
+    }
+    auto resident = jsonrpc::pal::resident_bytes(pid);
+    if (options.hibernate_stop && jsonrpc::pal::suspend(pid)) {
+      s.hibernate(b, true, resident);
+      co_await s.until_needed(b);
+      jsonrpc::pal::resume(pid);
+      s.resumed(b, jsonrpc::pal::resident_bytes(pid));
+      continue;
+    }
+    // Shut down: wait for the process to exit, and be cancelled.
+    s.hibernate(b, false, resident);
+    timer.expires_at(asio::steady_timer::time_point::max());
+    co_await timer.async_wait(asio::use_awaitable);
+  }
 }
 
+/** Run backend B, respawning it as long as the session needs it and
+ *  the restart budget allows.  Its messages go through pipeline P.
+ */
+template <typename Pipeline>
+asio::awaitable<void> supervise(asio::io_context& ioc, const fs::path& exe,
+                                const LsContact& contact,
+                                const LsOptions& options, session& s,
+                                Pipeline& p, std::size_t b) {
+  using namespace asio::experimental::awaitable_operators;  // NOLINT
+  unsigned restarts = 0;
+  bool respawned = false;
+  for (;;) {
+    std::optional<server> srv;
+    try {
+      srv.emplace(ioc, exe, contact.args(), options.server_framing);
+    } catch (std::exception& e) {
+      fmt::println(stderr, "Can't start '{}': {}", contact.exe(), e.what());
+      break;
+    }
+    s.server_started(b, srv->out, respawned);
+    auto serve = read_server(*srv, s, p, b) && s.to_server(b).drain()
+                 && wait_server(*srv, s, b);
+    int ret = 0;
+    if (options.hibernate_after.count() > 0)
+      ret = std::get<0>(
+          co_await (std::move(serve) || doze(*srv, s, options, b)));
+    else
+      ret = co_await std::move(serve);
+    fmt::println(stderr, "Process exited with '{}'", ret);
+    respawned = true;
+    if (s.asleep(b)) {
+      // Hibernating: doesn't count as a restart.
+      co_await s.until_needed(b);
+      if (!s.wants_restart()) break;
+      fmt::println(stderr, "Respawning '{}' on demand", contact.exe());
+      continue;
+    }
+    if (!s.wants_restart()) break;
+    if (restarts == options.max_restarts) {
+      fmt::println(stderr, "Giving up after {} restarts", restarts);
+      break;
+    }
+    ++restarts;
+    fmt::println(stderr, "Restarting '{}' ({} of {})", contact.exe(),
+                 restarts, options.max_restarts);
+  }
+  s.server_stopped(b);
+}
+
+}  // namespace
+
 void LsPlex::start() {
   if (_contacts.size() == 0)
     throw std::runtime_error("Got to have some contacts!");
@@ -67,11 +381,14 @@ void LsPlex::start() {
   if (_contacts.size() > 1)
     throw std::runtime_error("Currently support only one contact!!");
 
+  jsonrpc::pal::ignore_sigpipe();
   asio::io_context ioc;
   auto contact = _contacts[0];
 
-  jsonrpc::istream our_stdin{jsonrpc::pal::asio_stdin{ioc}};
-  jsonrpc::ostream our_stdout{jsonrpc::pal::asio_stdout{ioc}};
+  client_in_t our_stdin{jsonrpc::pal::asio_stdin{ioc},
+                        _options.client_framing};
+  client_out_t our_stdout{jsonrpc::pal::asio_stdout{ioc},
+                          _options.client_framing};
 
   fs::path resolved{};
 
@@ -86,16 +403,67 @@ void LsPlex::start() {
   if (resolved.empty())
     throw std::runtime_error(fmt::format("Can't find '{}'", contact.exe()));
 
-  jsonrpc::istream child_out{asio::readable_pipe{ioc}};
-  jsonrpc::ostream child_in{asio::writable_pipe{ioc}};
+  // What the server's initialize result depends on, besides the
+  // workspace: a rebuilt binary may have other capabilities.
+  boost::system::error_code ec;
+  auto server = fmt::format("{}\n{}", resolved.string(),
+                            fs::last_write_time(resolved, ec));
+  for (const auto& a : contact.args()) server += "\n" + a;
+
+  // Pick the pipeline variants once: from then on, messages go
+  // through statically composed stages.
+  std::variant<plain_pipeline, client_pipeline> from_client;
+  if (!_options.deny_methods.empty())
+    from_client.emplace<client_pipeline>(method_filter{
+        {_options.deny_methods.begin(), _options.deny_methods.end()}});
+  std::variant<plain_pipeline, server_pipeline> from_servers;
+  if (_options.server_log_level < 5)
+    from_servers.emplace<server_pipeline>(
+        log_filter{_options.server_log_level});
 
-  bp2::process proc{
-      ioc, resolved, contact.args(),
-      bp2::process_stdio{child_in.handle(), child_out.handle(), {}}};
+  session s{ioc.get_executor(), our_stdout, _options, std::move(server)};
+  asio::co_spawn(ioc, s.to_client().drain(), asio::detached);
+  std::visit(
+      [&](auto& p) {
+        for (std::size_t b = 0; b < s.backends(); ++b)
+          asio::co_spawn(ioc,
+                         supervise(ioc, resolved, contact, _options, s, p, b),
+                         asio::detached);
+      },
+      from_servers);
 
-  asio::co_spawn(ioc, doit(our_stdin, our_stdout, child_in, child_out, proc),
-                 asio::detached);
+  // Traces and lags are reported on demand, and the loop probed, for
+  // as long as the client's there.
+  asio::signal_set dump{ioc};
+#if defined(SIGUSR1)
+  if (s.tracing() != nullptr || s.watching() != nullptr) {
+    dump.add(SIGUSR1);
+    asio::co_spawn(ioc, report(dump, s, _options.trace), asio::detached);
+  }
+#endif
+  asio::steady_timer probe{ioc};
+  if (auto* w = s.watching()) {
+    // Often enough that stalls well past the threshold can't fall
+    // between two probes.
+    auto every = std::clamp<stall_watch::clock::duration>(
+        _options.stall_threshold / 4, std::chrono::milliseconds{1},
+        std::chrono::milliseconds{50});
+    asio::co_spawn(ioc, probe_lag(probe, *w, every), asio::detached);
+  }
+  std::visit(
+      [&](auto& p) {
+        asio::co_spawn(ioc,
+                       transfer<direction::client2server>(our_stdin, s, p),
+                       [&dump, &probe](const std::exception_ptr&) {
+                         boost::system::error_code ec;
+                         dump.cancel(ec);
+                         probe.cancel();
+                       });
+      },
+      from_client);
   ioc.run();
+  if (auto* t = s.tracing()) t->write(_options.trace);
+  if (auto* w = s.watching()) fmt::println(stderr, "{}", w->summary());
 }
 
 }  // namespace lsplex
@@ -0,0 +1,213 @@
+#include "lsplex/positions.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#include "lsplex/lsp.h"
+#include "lsplex/routing.h"
+
+namespace json = boost::json;
+
+namespace lsplex {
+
+namespace {
+
+std::int64_t number(const json::value& v) {
+  if (v.is_int64()) return v.get_int64();
+  if (v.is_uint64()) return static_cast<std::int64_t>(v.get_uint64());
+  return 0;
+}
+
+}  // namespace
+
+bool negotiate_utf8(const json::value& params, json::value& result) {
+  const auto* init = params.if_object();
+  const auto* caps = init != nullptr ? lsp::get_object(*init, "capabilities")
+                                     : nullptr;
+  const auto* general = caps != nullptr ? lsp::get_object(*caps, "general")
+                                        : nullptr;
+  const auto* offered = general != nullptr
+                            ? lsp::get_array(*general, "positionEncodings")
+                            : nullptr;
+  if (offered == nullptr
+      || std::find(offered->begin(), offered->end(), json::value("utf-8"))
+             == offered->end())
+    return false;
+  auto* r = result.if_object();
+  auto* c = r != nullptr ? r->if_contains("capabilities") : nullptr;
+  auto* server = c != nullptr ? c->if_object() : nullptr;
+  if (server == nullptr
+      || lsp::get_string(*server, "positionEncoding").value_or("utf-16")
+             != "utf-16")
+    return false;
+  server->insert_or_assign("positionEncoding", "utf-8");
+  // Token deltas are against what the server sent, before translation.
+  if (auto* st = server->if_contains("semanticTokensProvider");
+      st != nullptr && st->is_object())
+    if (auto* full = st->get_object().if_contains("full");
+        full != nullptr && full->is_object())
+      *full = true;
+  return true;
+}
+
+void position_translator::reset() { _cached = false; }
+
+void position_translator::forget(std::string_view uri) {
+  reset();
+  auto it = _files.find(std::string{uri});
+  if (it == _files.end()) return;
+  _files.erase(it);
+  std::erase(_order, uri);
+}
+
+const std::optional<position_translator::file>& position_translator::read(
+    std::string_view uri) {
+  auto [it, fresh] = _files.try_emplace(std::string{uri});
+  auto& f = it->second;
+  if (!fresh) return f;
+  auto path = uri_to_path(uri);
+  std::ifstream in{path.value_or(""), std::ios::binary};
+  if (path && in) {
+    f.emplace();
+    f->text.assign(std::istreambuf_iterator<char>{in}, {});
+    f->starts.push_back(0);
+    bool wide = false;
+    for (std::size_t i = 0; i < f->text.size(); ++i) {
+      auto c = static_cast<unsigned char>(f->text[i]);
+      if (c >= 0x80) wide = true;
+      if (c != '\n') continue;
+      f->wide.push_back(wide);
+      f->starts.push_back(i + 1);
+      wide = false;
+    }
+    f->wide.push_back(wide);
+  }
+  _order.push_back(it->first);
+  while (_order.size() > _max_files) {
+    // Never the one just read: the bound is at least one.
+    _files.erase(_order.front());
+    _order.pop_front();
+  }
+  return f;
+}
+
+const std::string* position_translator::line_text(std::string_view uri,
+                                                  std::size_t line) {
+  if (_cached && line == _line_no && uri == _uri)
+    return _line ? &*_line : nullptr;
+  _cached = true;
+  _uri = uri;
+  _line_no = line;
+  _line = _docs.line(uri, line);
+  if (_line || _docs.find(uri) != nullptr) return _line ? &*_line : nullptr;
+
+  // Not open in the client: what it'll see is what's on disk.
+  const auto& f = read(uri);
+  // Columns on ASCII lines are the same either way.
+  if (!f || line >= f->starts.size() || !f->wide[line]) return nullptr;
+  auto from = f->starts[line];
+  auto to = line + 1 < f->starts.size() ? f->starts[line + 1] - 1
+                                        : f->text.size();
+  std::string_view text{f->text.data() + from, to - from};
+  if (text.ends_with('\r')) text.remove_suffix(1);
+  _line = std::string{text};
+  return &*_line;
+}
+
+std::int64_t position_translator::column(std::string_view uri,
+                                         std::size_t line,
+                                         std::int64_t character,
+                                         direction d) {
+  const auto* text = character > 0 ? line_text(uri, line) : nullptr;
+  if (text == nullptr) return character;
+  auto c = static_cast<std::size_t>(character);
+  return static_cast<std::int64_t>(d == direction::to_server
+                                       ? byte_to_utf16(*text, c)
+                                       : utf16_to_byte(*text, c));
+}
+
+void position_translator::translate(json::value& v, std::string_view uri,
+                                    direction d) {
+  reset();
+  walk(v, uri, d);
+}
+
+void position_translator::translate(json::object& o, std::string_view uri,
+                                    direction d) {
+  reset();
+  walk(o, uri, d);
+}
+
+void position_translator::walk(json::value& v, std::string_view uri,
+                               direction d) {
+  if (auto* o = v.if_object()) {
+    walk(*o, uri, d);
+  } else if (auto* a = v.if_array()) {
+    for (auto& e : *a)
+      if (e.is_object() || e.is_array()) walk(e, uri, d);
+  }
+}
+
+void position_translator::walk(json::object& o, std::string_view uri,
+                               direction d) {
+  auto line_no = lsp::get_int(o, "line");
+  auto character = lsp::get_int(o, "character");
+  if (o.size() == 2 && line_no && character && *line_no >= 0) {
+    o["character"] = column(uri, static_cast<std::size_t>(*line_no),
+                            *character, d);
+    return;
+  }
+  // Folding ranges have their own.
+  for (auto [l, c] : {std::pair{"startLine", "startCharacter"},
+                      std::pair{"endLine", "endCharacter"}}) {
+    auto at = lsp::get_int(o, l);
+    auto ch = lsp::get_int(o, c);
+    if (at && ch && *at >= 0)
+      o[c] = column(uri, static_cast<std::size_t>(*at), *ch, d);
+  }
+
+  // Positions are in the document named closest to them.
+  auto here = lsp::get_string(o, "uri");
+  if (!here) here = lsp::document_uri(o);
+  if (here) uri = *here;
+  auto target = lsp::get_string(o, "targetUri");
+  for (auto& [key, v] : o) {
+    if (key == "data" || key == "arguments") continue;
+    if (key == "changes" && v.is_object()) {
+      // WorkspaceEdit: text edits by document
+      for (auto& [doc, edits] : v.get_object()) walk(edits, doc, d);
+      continue;
+    }
+    bool in_target = key == "targetRange" || key == "targetSelectionRange";
+    walk(v, in_target && target ? *target : uri, d);
+  }
+}
+
+void position_translator::translate_tokens(json::array& data,
+                                           std::string_view uri,
+                                           direction d) {
+  reset();
+  // Each token is 5 numbers: line and start relative to the previous
+  // token's, length, type and modifiers.
+  std::size_t line_no = 0;
+  std::int64_t start = 0;
+  std::int64_t previous = 0;  // Start of the previous token, translated
+  for (std::size_t i = 0; i + 5 <= data.size(); i += 5) {
+    auto delta_line = number(data[i]);
+    if (delta_line > 0) {
+      line_no += static_cast<std::size_t>(delta_line);
+      start = number(data[i + 1]);
+      previous = 0;
+    } else {
+      start += number(data[i + 1]);
+    }
+    auto from = column(uri, line_no, start, d);
+    auto to = column(uri, line_no, start + number(data[i + 2]), d);
+    data[i + 1] = from - previous;
+    data[i + 2] = to - from;
+    previous = from;
+  }
+}
+
+}  // namespace lsplex
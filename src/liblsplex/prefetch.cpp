@@ -0,0 +1,147 @@
+#include "lsplex/prefetch.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+
+namespace json = boost::json;
+
+namespace lsplex {
+
+prefetcher::prefetcher(std::vector<std::string> methods,
+                       std::size_t max_running, clock::duration ttl)
+    : _methods{std::move(methods)},
+      _max_running{std::max<std::size_t>(max_running, 1)},
+      _ttl{ttl} {}
+
+std::string prefetcher::key_of(std::string_view method, std::string_view uri,
+                               std::int64_t version) {
+  return fmt::format("{}\n{}\n{}", method, uri, version);
+}
+
+/** What the client would send: inlay hints are asked for a range, here
+ *  the whole document.
+ */
+json::object prefetcher::params_for(std::string_view method,
+                                    std::string_view uri, std::size_t lines) {
+  json::object params{{"textDocument", {{"uri", uri}}}};
+  if (method == "textDocument/inlayHint")
+    params["range"] = {{"start", {{"line", 0}, {"character", 0}}},
+                       {"end",
+                        {{"line", static_cast<std::int64_t>(lines)},
+                         {"character", 0}}}};
+  return params;
+}
+
+/** Whether the client's PARAMS ask what the prefetch's OURS did.  How
+ *  it wants progress reported doesn't matter.
+ */
+static bool same_question(const json::object& ours,
+                          const json::object& params) {
+  auto size = params.size();
+  for (auto token : {"workDoneToken", "partialResultToken"})
+    if (params.contains(token)) --size;
+  if (size != ours.size()) return false;
+  return std::all_of(ours.begin(), ours.end(), [&](const auto& kv) {
+    const auto* v = params.if_contains(kv.key());
+    return v != nullptr && *v == kv.value();
+  });
+}
+
+bool prefetcher::wants(std::string_view method) const {
+  return std::find(_methods.begin(), _methods.end(), method)
+         != _methods.end();
+}
+
+void prefetcher::queue(std::string_view uri, std::int64_t version,
+                       std::size_t lines, clock::time_point now) {
+  // Nobody came for these.
+  std::erase_if(_entries, [now](const auto& kv) {
+    return kv.second.ready && kv.second.expires <= now;
+  });
+  std::erase_if(_queue, [uri](const job& j) { return j.uri == uri; });
+  for (const auto& m : _methods)
+    if (!_entries.contains(key_of(m, uri, version)))
+      _queue.push_back(
+          {m, std::string{uri}, version, params_for(m, uri, lines), 0});
+}
+
+void prefetcher::forget(std::string_view uri) {
+  std::erase_if(_queue, [uri](const job& j) { return j.uri == uri; });
+  std::erase_if(_entries, [uri](const auto& kv) {
+    return kv.second.ready && kv.second.uri == uri;
+  });
+  // Pending ones may have requests waiting: they go when answered, and
+  // aren't kept if there are none.
+  for (auto& [_, e] : _entries)
+    if (e.uri == uri) e.stale = true;
+}
+
+std::optional<prefetcher::job> prefetcher::start(
+    const std::function<std::optional<std::size_t>(std::string_view)>&
+        idle) {
+  if (_running >= _max_running || _queue.empty()) return std::nullopt;
+  auto b = idle(_queue.front().uri);
+  if (!b) return std::nullopt;
+  auto j = std::move(_queue.front());
+  _queue.pop_front();
+  j.backend = *b;
+  _entries.insert_or_assign(key_of(j.method, j.uri, j.version),
+                            entry{j.uri, j.params, j.backend, false, false,
+                                  {}, {}, {}});
+  ++_running;
+  return j;
+}
+
+std::vector<std::string> prefetcher::finish(
+    const job& j, std::optional<json::value> result, clock::time_point now) {
+  auto it = _entries.find(key_of(j.method, j.uri, j.version));
+  if (it == _entries.end() || it->second.ready) return {};
+  --_running;
+  auto& e = it->second;
+  auto waiters = std::move(e.waiters);
+  if (!waiters.empty() || !result || e.stale) {
+    _entries.erase(it);
+    return waiters;
+  }
+  e.ready = true;
+  e.result = std::move(*result);
+  e.expires = now + _ttl;
+  return {};
+}
+
+void prefetcher::abandon(std::size_t b) {
+  _running -= static_cast<std::size_t>(
+      std::erase_if(_entries, [b](const auto& kv) {
+        return !kv.second.ready && kv.second.backend == b;
+      }));
+}
+
+prefetcher::found prefetcher::take(std::string_view method,
+                                   std::string_view uri, std::int64_t version,
+                                   const json::object& params,
+                                   const std::string& key,
+                                   clock::time_point now) {
+  auto it = _entries.find(key_of(method, uri, version));
+  if (it == _entries.end()) {
+    // Too late to be of help: the client's request goes to the
+    // server, and this one needn't.
+    std::erase_if(_queue, [&](const job& j) {
+      return j.method == method && j.uri == uri && j.version == version;
+    });
+    return {};
+  }
+  auto& e = it->second;
+  // Asked about some other range, say: the server has to answer.
+  if (!same_question(e.params, params)) return {};
+  if (!e.ready) {
+    e.waiters.push_back(key);
+    return {found::pending, e.backend, {}};
+  }
+  found f{found::ready, e.backend, std::move(e.result)};
+  bool fresh = e.expires > now;
+  _entries.erase(it);
+  return fresh ? f : found{};
+}
+
+}  // namespace lsplex
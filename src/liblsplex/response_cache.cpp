@@ -0,0 +1,329 @@
+#include "lsplex/response_cache.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <vector>
+
+#if !defined(_WIN32)
+#  include <fcntl.h>
+#  include <sys/file.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace json = boost::json;
+
+namespace lsplex {
+
+namespace {
+
+constexpr std::string_view file_magic{"LSPXRC01"};
+constexpr std::uint32_t record_tag = 0x4345524CU;  // "LREC"
+
+// tag, checksum, key length, value length
+constexpr std::size_t record_header = 4 * sizeof(std::uint32_t);
+
+std::uint32_t checksum(std::string_view key, std::string_view value) {
+  std::uint32_t h = 2166136261U;
+  for (auto part : {key, value})
+    for (auto c : part) {
+      h ^= static_cast<unsigned char>(c);
+      h *= 16777619U;
+    }
+  return h;
+}
+
+std::uint32_t read_u32(const char* p) {
+  std::uint32_t v = 0;
+  std::memcpy(&v, p, sizeof v);
+  return v;
+}
+
+void append_u32(std::string& out, std::uint32_t v) {
+  std::array<char, sizeof v> bytes{};
+  std::memcpy(bytes.data(), &v, sizeof v);
+  out.append(bytes.data(), bytes.size());
+}
+
+std::string make_record(std::string_view key, std::string_view value) {
+  std::string r;
+  r.reserve(record_header + key.size() + value.size());
+  append_u32(r, record_tag);
+  append_u32(r, checksum(key, value));
+  append_u32(r, static_cast<std::uint32_t>(key.size()));
+  append_u32(r, static_cast<std::uint32_t>(value.size()));
+  r += key;
+  r += value;
+  return r;
+}
+
+#if !defined(_WIN32)
+bool write_all(int fd, std::string_view data) {
+  while (!data.empty()) {
+    auto n = ::write(fd, data.data(), data.size());
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    data.remove_prefix(static_cast<std::size_t>(n));
+  }
+  return true;
+}
+
+/** flock() for as long as it lives. */
+class file_lock {
+  int _fd;
+
+public:
+  explicit file_lock(int fd) : _fd{fd} { (void)::flock(_fd, LOCK_EX); }
+  ~file_lock() { (void)::flock(_fd, LOCK_UN); }
+  file_lock(const file_lock&) = delete;
+  file_lock& operator=(const file_lock&) = delete;
+  file_lock(file_lock&&) = delete;
+  file_lock& operator=(file_lock&&) = delete;
+};
+#endif
+
+}  // namespace
+
+std::uint64_t content_hash(std::string_view text) {
+  std::uint64_t h = 14695981039346656037ULL;
+  for (auto c : text) {
+    h ^= static_cast<unsigned char>(c);
+    h *= 1099511628211ULL;
+  }
+  // Mix in the length, so that collisions need the same size as well.
+  return h ^ (text.size() * 0x9E3779B97F4A7C15ULL);
+}
+
+std::string response_cache::key(std::string_view method, std::string_view uri,
+                                std::uint64_t hash, std::string_view server) {
+  return fmt::format("{}\n{}\n{:016x}\n{}", method, uri, hash, server);
+}
+
+response_cache::response_cache(std::string path, std::size_t max_bytes)
+    : _path{std::move(path)}, _max_bytes{max_bytes} {
+  open();
+}
+
+response_cache::~response_cache() { close(); }
+
+#if defined(_WIN32)
+
+void response_cache::open() {
+  fmt::println(stderr, "The response cache isn't supported here");
+}
+void response_cache::close() {}
+void response_cache::scan() {}
+bool response_cache::map(std::size_t) { return false; }
+bool response_cache::replaced() const { return false; }
+bool response_cache::compact_locked() { return false; }
+void response_cache::compact() {}
+std::optional<json::value> response_cache::lookup(std::string_view) {
+  return std::nullopt;
+}
+void response_cache::store(std::string_view, const json::value&) {}
+
+#else
+
+void response_cache::open() {
+  _fd = ::open(_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (_fd == -1) {
+    fmt::println(stderr, "Can't open response cache '{}'", _path);
+    return;
+  }
+  file_lock lock{_fd};
+  struct stat st {};
+  if (::fstat(_fd, &st) == -1) {
+    close();
+    return;
+  }
+  auto size = static_cast<std::size_t>(st.st_size);
+  if (size < file_magic.size()
+      || (map(size)
+          && std::string_view{_map, file_magic.size()} != file_magic)) {
+    // New, or not ours: start over.
+    map(0);
+    if (::ftruncate(_fd, 0) == -1 || ::lseek(_fd, 0, SEEK_SET) == -1
+        || !write_all(_fd, file_magic)) {
+      close();
+      return;
+    }
+  }
+  scan();
+}
+
+void response_cache::close() {
+  if (_map != nullptr) ::munmap(const_cast<char*>(_map), _mapped);  // NOLINT
+  _map = nullptr;
+  _mapped = 0;
+  if (_fd != -1) ::close(_fd);
+  _fd = -1;
+  _index.clear();
+  _end = 0;
+  _live = 0;
+}
+
+bool response_cache::map(std::size_t size) {
+  if (size <= _mapped && _map != nullptr) return true;
+  if (_map != nullptr) ::munmap(const_cast<char*>(_map), _mapped);  // NOLINT
+  _map = nullptr;
+  _mapped = 0;
+  if (size == 0) return false;
+  void* p = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, _fd, 0);
+  if (p == MAP_FAILED) return false;
+  _map = static_cast<const char*>(p);
+  _mapped = size;
+  return true;
+}
+
+/** Index the records after _end, e.g. appended by another process.
+ *  Call with the lock held.
+ */
+void response_cache::scan() {
+  struct stat st {};
+  if (::fstat(_fd, &st) == -1) return;
+  auto size = static_cast<std::size_t>(st.st_size);
+  if (_end == 0) _end = file_magic.size();
+  if (size <= _end || !map(size)) return;
+
+  auto at = _end;
+  while (at + record_header <= size) {
+    const char* p = _map + at;
+    auto key_len = std::size_t{read_u32(p + 8)};
+    auto value_len = std::size_t{read_u32(p + 12)};
+    auto total = record_header + key_len + value_len;
+    if (read_u32(p) != record_tag || at + total > size) break;
+    std::string_view key{p + record_header, key_len};
+    std::string_view value{p + record_header + key_len, value_len};
+    if (read_u32(p + 4) != checksum(key, value)) break;
+    auto [it, fresh] = _index.insert_or_assign(std::string{key},
+                                               record{at, total});
+    if (!fresh) _live -= it->second.size;
+    _live += total;
+    at += total;
+  }
+  _end = at;
+  if (at < size) {
+    fmt::println(stderr, "Dropping {} bytes of torn records from '{}'",
+                 size - at, _path);
+    (void)::ftruncate(_fd, static_cast<off_t>(at));
+  }
+}
+
+/** Whether another process compacted the file, replacing it. */
+bool response_cache::replaced() const {
+  struct stat mine {};
+  struct stat theirs {};
+  if (::fstat(_fd, &mine) == -1 || ::stat(_path.c_str(), &theirs) == -1)
+    return true;
+  return mine.st_ino != theirs.st_ino || mine.st_dev != theirs.st_dev;
+}
+
+std::optional<json::value> response_cache::lookup(std::string_view key) {
+  if (!ok()) return std::nullopt;
+  auto it = _index.find(std::string{key});
+  if (it == _index.end()) return std::nullopt;
+  auto [offset, size] = it->second;
+  if (!map(offset + size)) return std::nullopt;
+  const char* p = _map + offset;
+  auto key_len = std::size_t{read_u32(p + 8)};
+  std::string_view value{p + record_header + key_len,
+                         size - record_header - key_len};
+  boost::system::error_code ec;
+  auto v = json::parse(value, ec);
+  if (ec) return std::nullopt;
+  return v;
+}
+
+void response_cache::store(std::string_view key, const json::value& response) {
+  if (!ok()) return;
+  if (replaced()) {
+    close();
+    open();
+    if (!ok()) return;
+  }
+  auto rec = make_record(key, json::serialize(response));
+  bool compacted = false;
+  {
+    file_lock lock{_fd};
+    scan();  // Catch up with other processes, so _end is the end
+    if (::lseek(_fd, static_cast<off_t>(_end), SEEK_SET) == -1
+        || !write_all(_fd, rec)) {
+      fmt::println(stderr, "Can't write response cache '{}'", _path);
+      return;
+    }
+    auto [it, fresh] = _index.insert_or_assign(std::string{key},
+                                               record{_end, rec.size()});
+    if (!fresh) _live -= it->second.size;
+    _live += rec.size();
+    _end += rec.size();
+    // Over the cap, or mostly shadowed records
+    if (_end > _max_bytes || _end - _live > _max_bytes / 2)
+      compacted = compact_locked();
+  }
+  if (compacted) {
+    close();
+    open();
+  }
+}
+
+void response_cache::compact() {
+  if (!ok()) return;
+  bool compacted = false;
+  {
+    file_lock lock{_fd};
+    scan();
+    compacted = compact_locked();
+  }
+  if (compacted) {
+    close();
+    open();
+  }
+}
+
+/** Write the records to keep to a new file, and put it in place of
+ *  the current one.  Returns whether it did, in which case the file
+ *  must be reopened once the lock is released.
+ */
+bool response_cache::compact_locked() {
+  std::vector<std::pair<const std::string*, record>> live;
+  live.reserve(_index.size());
+  for (const auto& [k, r] : _index) live.emplace_back(&k, r);
+  std::sort(live.begin(), live.end(), [](const auto& a, const auto& b) {
+    return a.second.offset > b.second.offset;
+  });
+  std::size_t budget = _max_bytes / 2;
+  std::size_t keep = 0;
+  for (std::size_t used = file_magic.size(); keep < live.size(); ++keep) {
+    if (used + live[keep].second.size > budget) break;
+    used += live[keep].second.size;
+  }
+  live.resize(keep);
+  std::reverse(live.begin(), live.end());  // Oldest first, as before
+  if (!map(_end)) return false;
+
+  auto tmp = _path + ".compacting";
+  int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1) return false;
+  bool good = write_all(fd, file_magic);
+  for (const auto& [k, r] : live)
+    if (good) good = write_all(fd, std::string_view{_map + r.offset, r.size});
+  good = ::close(fd) == 0 && good;
+  if (!good || ::rename(tmp.c_str(), _path.c_str()) == -1) {
+    fmt::println(stderr, "Can't compact response cache '{}'", _path);
+    (void)::unlink(tmp.c_str());
+    return false;
+  }
+  fmt::println(stderr, "Compacted response cache '{}' to {} entries", _path,
+               live.size());
+  return true;
+}
+
+#endif
+
+}  // namespace lsplex
@@ -0,0 +1,247 @@
+#include "lsplex/rope.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace lsplex {
+
+chunk_pool::chunk_pool() : _table{std::make_shared<table>()} {}
+
+chunk_pool::chunk chunk_pool::intern(std::string_view text) {
+  auto& t = *_table;
+  if (auto it = t.chunks.find(text); it != t.chunks.end()) {
+    if (auto c = it->second.lock()) return c;
+    t.chunks.erase(it);
+  }
+  auto owned = std::make_unique<std::string>(text);
+  std::weak_ptr<table> weak = _table;
+  chunk c{owned.release(), [weak](const std::string* s) {
+            if (auto tbl = weak.lock()) {
+              auto it = tbl->chunks.find(*s);
+              if (it != tbl->chunks.end() && it->first.data() == s->data()) {
+                tbl->chunks.erase(it);
+                tbl->bytes -= s->size();
+              }
+            }
+            delete s;  // NOLINT(*-owning-memory)
+          }};
+  t.chunks.emplace(std::string_view{*c}, c);
+  t.bytes += c->size();
+  return c;
+}
+
+std::size_t chunk_pool::bytes() const { return _table->bytes; }
+std::size_t chunk_pool::chunks() const { return _table->chunks.size(); }
+
+struct rope::node {
+  node_ptr left;
+  node_ptr right;
+  chunk_pool::chunk text;  // Leaves only
+  std::size_t bytes{0};
+  std::size_t newlines{0};
+  int height{0};
+
+  [[nodiscard]] bool is_leaf() const { return text != nullptr; }
+};
+
+namespace {
+  int height(const auto& n) { return n ? n->height : -1; }
+
+  std::size_t count_newlines(std::string_view s) {
+    return static_cast<std::size_t>(std::count(s.begin(), s.end(), '\n'));
+  }
+
+  void append(const auto& n, std::size_t pos, std::size_t len,
+              std::string& out) {
+    if (!n || len == 0 || pos >= n->bytes) return;
+    if (n->is_leaf()) {
+      out.append(std::string_view{*n->text}.substr(pos, len));
+      return;
+    }
+    auto lb = n->left->bytes;
+    if (pos < lb) {
+      append(n->left, pos, len, out);
+      auto taken = std::min(len, lb - pos);
+      append(n->right, 0, len - taken, out);
+    } else {
+      append(n->right, pos - lb, len, out);
+    }
+  }
+}  // namespace
+
+rope::node_ptr rope::concat(node_ptr l, node_ptr r) {
+  auto n = std::make_shared<node>();
+  n->bytes = l->bytes + r->bytes;
+  n->newlines = l->newlines + r->newlines;
+  n->height = 1 + std::max(l->height, r->height);
+  n->left = std::move(l);
+  n->right = std::move(r);
+  return n;
+}
+
+// Concatenate subtrees whose heights differ by at most two, rotating
+// once if needed to restore balance.
+rope::node_ptr rope::balance(node_ptr l, node_ptr r) {
+  if (height(l) > height(r) + 1) {
+    if (height(l->left) >= height(l->right))
+      return concat(l->left, concat(l->right, std::move(r)));
+    return concat(concat(l->left, l->right->left),
+                  concat(l->right->right, std::move(r)));
+  }
+  if (height(r) > height(l) + 1) {
+    if (height(r->right) >= height(r->left))
+      return concat(concat(std::move(l), r->left), r->right);
+    return concat(concat(std::move(l), r->left->left),
+                  concat(r->left->right, r->right));
+  }
+  return concat(std::move(l), std::move(r));
+}
+
+rope::node_ptr rope::leaf(std::string_view text) const {
+  auto n = std::make_shared<node>();
+  n->text = _pool != nullptr ? _pool->intern(text)
+                             : std::make_shared<const std::string>(text);
+  n->bytes = text.size();
+  n->newlines = count_newlines(text);
+  return n;
+}
+
+// Cut TEXT into chunks ending at newlines chosen by line content, not
+// by offset, so that equal stretches of text in different documents
+// tend to be chunked, and hence interned, identically.
+rope::node_ptr rope::build(std::string_view text) const {
+  std::vector<node_ptr> leaves;
+  std::size_t start = 0;
+  while (start < text.size()) {
+    auto end = std::min(text.size(), start + max_chunk);
+    if (end < text.size()) {
+      std::size_t cut = 0;
+      std::size_t last_nl = 0;
+      std::uint32_t h = 0;
+      for (auto i = start; i < end; ++i) {
+        h = h * 31 + static_cast<unsigned char>(text[i]);
+        if (text[i] != '\n') continue;
+        last_nl = i + 1;
+        if (last_nl - start >= min_chunk && (h & 7U) == 0) {
+          cut = last_nl;
+          break;
+        }
+        h = 0;
+      }
+      end = cut != 0 ? cut : last_nl != 0 ? last_nl : end;
+    }
+    leaves.push_back(leaf(text.substr(start, end - start)));
+    start = end;
+  }
+  // Pairwise, so the result is perfectly balanced.
+  while (leaves.size() > 1) {
+    std::vector<node_ptr> next;
+    next.reserve((leaves.size() + 1) / 2);
+    for (std::size_t i = 0; i + 1 < leaves.size(); i += 2)
+      next.push_back(concat(leaves[i], leaves[i + 1]));
+    if (leaves.size() % 2 != 0) next.push_back(leaves.back());
+    leaves = std::move(next);
+  }
+  return leaves.empty() ? nullptr : leaves.front();
+}
+
+rope::node_ptr rope::join(const node_ptr& l, const node_ptr& r) const {
+  if (!l || l->bytes == 0) return r;
+  if (!r || r->bytes == 0) return l;
+  bool small_l = l->is_leaf() && l->bytes < min_chunk;
+  bool small_r = r->is_leaf() && r->bytes < min_chunk;
+  if (l->is_leaf() && r->is_leaf() && (small_l || small_r)
+      && l->bytes + r->bytes <= max_chunk) {
+    std::string text{*l->text};
+    text += *r->text;
+    return leaf(text);
+  }
+  // Descend towards the seam if heights are uneven, or if a small
+  // leaf could be merged into its neighbour there, so that typing
+  // doesn't fragment the rope into one-character leaves.
+  if (height(l) > height(r) + 1 || (small_r && !l->is_leaf()))
+    return balance(l->left, join(l->right, r));
+  if (height(r) > height(l) + 1 || (small_l && !r->is_leaf()))
+    return balance(join(l, r->left), r->right);
+  return concat(l, r);
+}
+
+std::pair<rope::node_ptr, rope::node_ptr> rope::split(const node_ptr& n,
+                                                      std::size_t pos) const {
+  if (!n || pos == 0) return {nullptr, n};
+  if (pos >= n->bytes) return {n, nullptr};
+  if (n->is_leaf()) {
+    std::string_view t{*n->text};
+    return {leaf(t.substr(0, pos)), leaf(t.substr(pos))};
+  }
+  auto lb = n->left->bytes;
+  if (pos <= lb) {
+    auto [a, b] = split(n->left, pos);
+    return {a, join(b, n->right)};
+  }
+  auto [a, b] = split(n->right, pos - lb);
+  return {join(n->left, a), b};
+}
+
+rope::rope(std::string_view text, chunk_pool* pool)
+    : _pool{pool} {
+  _root = build(text);
+}
+
+std::size_t rope::size() const { return _root ? _root->bytes : 0; }
+
+std::size_t rope::lines() const {
+  return (_root ? _root->newlines : 0) + 1;
+}
+
+void rope::replace(std::size_t from, std::size_t to, std::string_view text) {
+  from = std::min(from, size());
+  to = std::clamp(to, from, size());
+  auto [head, rest] = split(_root, from);
+  auto [gone, tail] = split(rest, to - from);
+  _root = join(join(head, build(text)), tail);
+}
+
+std::size_t rope::line_start(std::size_t line) const {
+  if (line == 0) return 0;
+  if (!_root || line > _root->newlines) return std::string::npos;
+  // Find the byte just past the LINE-th newline.
+  std::size_t offset = 0;
+  const node* n = _root.get();
+  while (!n->is_leaf()) {
+    if (line <= n->left->newlines) {
+      n = n->left.get();
+    } else {
+      line -= n->left->newlines;
+      offset += n->left->bytes;
+      n = n->right.get();
+    }
+  }
+  std::string_view t{*n->text};
+  std::size_t pos = 0;
+  for (;;) {
+    pos = t.find('\n', pos) + 1;
+    if (--line == 0) return offset + pos;
+  }
+}
+
+std::string rope::line(std::size_t line) const {
+  auto start = line_start(line);
+  if (start == std::string::npos) return {};
+  auto next = line_start(line + 1);
+  auto end = next == std::string::npos ? size() : next - 1;
+  auto ret = substr(start, end - start);
+  if (!ret.empty() && ret.back() == '\r') ret.pop_back();
+  return ret;
+}
+
+std::string rope::substr(std::size_t pos, std::size_t len) const {
+  std::string out;
+  if (pos >= size()) return out;
+  len = std::min(len, size() - pos);
+  out.reserve(len);
+  append(_root, pos, len, out);
+  return out;
+}
+
+}  // namespace lsplex
@@ -0,0 +1,91 @@
+#include "lsplex/routing.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+
+namespace lsplex {
+
+std::string path_to_uri(std::string_view path) {
+  if (path.find("://") != std::string_view::npos) return std::string{path};
+  constexpr std::array<char, 16> hex{'0', '1', '2', '3', '4', '5', '6', '7',
+                                     '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'};
+  std::string uri{"file://"};
+  if (!path.starts_with('/')) uri += '/';  // C:/foo
+  for (auto c : path) {
+    auto u = static_cast<unsigned char>(c);
+    bool plain = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+                 || (c >= '0' && c <= '9') || c == '/' || c == '-' || c == '_'
+                 || c == '.' || c == '~';
+    if (c == '\\') {
+      uri += '/';
+    } else if (plain) {
+      uri += c;
+    } else {
+      uri += '%';
+      uri += hex.at(u >> 4U);
+      uri += hex.at(u & 0xFU);
+    }
+  }
+  return uri;
+}
+
+std::optional<std::string> uri_to_path(std::string_view uri) {
+  constexpr std::string_view scheme{"file://"};
+  if (!uri.starts_with(scheme)) return std::nullopt;
+  uri.remove_prefix(scheme.size());
+  // The host, if any, is this one.
+  uri.remove_prefix(std::min(uri.find('/'), uri.size()));
+  auto digit = [](char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+  };
+  std::string path;
+  path.reserve(uri.size());
+  for (std::size_t i = 0; i < uri.size(); ++i) {
+    int hi = i + 2 < uri.size() && uri[i] == '%' ? digit(uri[i + 1]) : -1;
+    int lo = hi >= 0 ? digit(uri[i + 2]) : -1;
+    if (lo >= 0) {
+      path += static_cast<char>(hi * 16 + lo);
+      i += 2;
+    } else {
+      path += uri[i];
+    }
+  }
+  // /C:/foo
+  if (path.size() >= 3 && path[2] == ':'
+      && std::isalpha(static_cast<unsigned char>(path[1])) != 0)
+    path.erase(0, 1);
+  return path;
+}
+
+shard_map::shard_map(const std::vector<std::string>& roots) {
+  _roots.reserve(roots.size());
+  for (const auto& r : roots) {
+    auto uri = path_to_uri(r);
+    while (uri.ends_with('/')) uri.pop_back();
+    _roots.push_back(std::move(uri));
+  }
+}
+
+std::size_t shard_map::shard_of(std::string_view uri) const {
+  std::size_t best = 0;
+  std::size_t best_len = 0;
+  for (std::size_t i = 0; i < _roots.size(); ++i) {
+    const auto& r = _roots[i];
+    if (r.size() <= best_len || !uri.starts_with(r)) continue;
+    if (uri.size() == r.size() || uri[r.size()] == '/') {
+      best = i + 1;
+      best_len = r.size();
+    }
+  }
+  return best;
+}
+
+std::string_view shard_map::root(std::size_t shard) const {
+  return shard == 0 ? std::string_view{} : std::string_view{_roots.at(shard - 1)};
+}
+
+}  // namespace lsplex
@@ -0,0 +1,1320 @@
+#include "session.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+#include "lsplex/methods.h"
+
+namespace lsplex {
+
+namespace {
+
+using lsp::method;
+
+/** Requests that may be sent twice without ill effect. */
+bool is_read_only(method m) {
+  const auto& t = lsp::traits(m);
+  return t.kind == lsp::kind::request && t.idempotent;
+}
+
+/** The workspace root an `initialize` with PARAMS is for. */
+std::string_view workspace_root(const json::object& params) {
+  if (auto uri = lsp::get_string(params, "rootUri")) return *uri;
+  if (auto path = lsp::get_string(params, "rootPath")) return *path;
+  if (const auto* folders = lsp::get_array(params, "workspaceFolders"))
+    if (!folders->empty() && folders->front().is_object())
+      return lsp::get_string(folders->front().get_object(), "uri")
+          .value_or("");
+  return {};
+}
+
+/** Server requests that only the client can answer, even for a
+ *  replica.
+ */
+bool needs_client(method m) {
+  return m == method::configuration || m == method::workspace_folders;
+}
+
+/** Read-only requests worth sending to a second replica when the
+ *  first is slow.
+ */
+bool is_hedgeable(method m) {
+  switch (m) {
+    case method::hover:
+    case method::definition:
+    case method::declaration:
+    case method::type_definition:
+    case method::implementation:
+    case method::references:
+    case method::document_highlight:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Responses that depend on nothing but the document's contents, and
+// are worth keeping across sessions.
+bool is_persistable(method m) {
+  switch (m) {
+    case method::document_symbol:
+    case method::folding_range:
+    case method::semantic_tokens_full:
+    case method::document_link:
+      return true;
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+session::session(const asio::any_io_executor& ex, client_out_t& client,
+                 const LsOptions& options, std::string server)
+    : _ex{ex},
+      _to_client{ex, &client},
+      _shards{options.shards},
+      _replicas{std::max(options.replicas, 1U)},
+      _hedge_delay{options.hedge_delay},
+      _server{std::move(server)},
+      _utf8_positions{options.utf8_positions},
+      _partial_results{options.partial_results},
+      _slimming{options.slim},
+      _slim_keep{options.slim_keep.begin(), options.slim_keep.end()},
+      _watched_window{options.watched_files_window},
+      _watched_timer{ex} {
+  if (!options.init_cache.empty()) _init_cache.emplace(options.init_cache);
+  if (!options.response_cache.empty())
+    _responses.emplace(options.response_cache,
+                       options.response_cache_max_bytes);
+  // Replicas of a shard are adjacent: backend B is replica
+  // B % _replicas of shard B / _replicas.
+  for (std::size_t s = 0; s < _shards.size(); ++s)
+    for (std::size_t r = 0; r < _replicas; ++r)
+      _backends.push_back(std::make_unique<backend>(ex, s, r));
+  if (!options.prefetch.empty())
+    _prefetch.emplace(options.prefetch, options.prefetch_concurrency);
+  if (options.stall_threshold.count() > 0)
+    _watch.emplace(options.stall_threshold);
+  if (!options.trace.empty()) {
+    _tracer.emplace(options.trace_window);
+    using point = tracer::point;
+    _to_client.on_written([this](const json::value& msg) {
+      _tracer->mark(msg, point::replied, tracer::clock::now());
+    });
+    for (auto& be : _backends)
+      be->out.on_written([this](const json::value& msg) {
+        _tracer->mark(msg, point::sent, tracer::clock::now());
+      });
+  }
+}
+
+json::value session::fresh_id() {
+  auto name = fmt::format("lsplex:{}", ++_next_id);
+  return json::value(json::string_view{name});
+}
+
+std::size_t session::voice(std::size_t shard) const {
+  auto first = shard * _replicas;
+  for (auto b = first; b < first + _replicas; ++b)
+    if (!_backends[b]->stopped) return b;
+  return first;
+}
+
+std::size_t session::backend_for(std::string_view uri) const {
+  return voice(_shards.shard_of(uri));
+}
+
+std::optional<std::size_t> session::least_loaded(
+    std::size_t shard, std::optional<std::size_t> except) const {
+  std::optional<std::size_t> best;
+  std::size_t best_load = 0;
+  auto first = shard * _replicas;
+  for (auto b = first; b < first + _replicas; ++b) {
+    const auto& be = *_backends[b];
+    if (be.stopped || b == except) continue;
+    auto load = be.inflight.size() + be.held.size();
+    if (!best || load < best_load) {
+      best = b;
+      best_load = load;
+    }
+  }
+  return best;
+}
+
+std::vector<std::size_t> session::everyone() const {
+  std::vector<std::size_t> all(_backends.size());
+  for (std::size_t b = 0; b < all.size(); ++b) all[b] = b;
+  return all;
+}
+
+std::vector<std::size_t> session::voices() const {
+  std::vector<std::size_t> v(_shards.size());
+  for (std::size_t s = 0; s < v.size(); ++s) v[s] = voice(s);
+  return v;
+}
+
+json::value session::initialize_params(std::size_t b) const {
+  auto params = _initialize.value_or(json::object{});
+  auto root = _shards.root(_backends[b]->shard);
+  auto* obj = params.if_object();
+  if (root.empty() || obj == nullptr) return params;
+  // Confine the backend to its shard, so it only indexes that.
+  auto name = root.substr(root.rfind('/') + 1);
+  obj->insert_or_assign("rootUri", json::string_view{root});
+  obj->erase("rootPath");
+  obj->insert_or_assign(
+      "workspaceFolders",
+      json::array{json::object{{"uri", json::string_view{root}},
+                               {"name", json::string_view{name}}}});
+  return params;
+}
+
+void session::send(std::size_t b, json::object msg) {
+  auto& be = *_backends[b];
+  be.active = std::chrono::steady_clock::now();
+  // A backend shut down for hibernation is replayed the documents'
+  // state when it comes back: what it misses meanwhile doesn't matter.
+  if (be.asleep && !be.suspended) return;
+  if (be.replaying)
+    be.held.emplace_back(std::move(msg));
+  else
+    be.out.post(std::move(msg));
+}
+
+void session::send(std::size_t b, jsonrpc::shared_message msg) {
+  auto& be = *_backends[b];
+  be.active = std::chrono::steady_clock::now();
+  if (be.asleep && !be.suspended) return;
+  if (be.replaying)
+    be.held.emplace_back(std::move(msg));
+  else
+    be.out.post(std::move(msg));
+}
+
+void session::send_request(std::size_t b, json::object msg) {
+  auto& be = *_backends[b];
+  auto key = lsp::id_key(msg.at("id"));
+  if (be.stopped) {
+    deliver(b, key,
+            lsp::make_error(msg.at("id"), lsp::request_failed,
+                            "Server is gone"));
+    return;
+  }
+  if (be.asleep) {
+    // No need to bring it back just to shut it down.
+    auto m = lsp::classify(lsp::get_string(msg, "method").value_or(""));
+    if (m == method::shutdown && !be.suspended) {
+      deliver(b, key, lsp::make_response(msg.at("id"), nullptr));
+      return;
+    }
+    wake(b);
+  }
+  be.inflight.insert_or_assign(key, msg);
+  send(b, std::move(msg));
+}
+
+void session::request(std::size_t b, std::string_view method,
+                      json::value params, handler h) {
+  auto id = fresh_id();
+  _backends[b]->active = std::chrono::steady_clock::now();
+  _backends[b]->own_requests.emplace(lsp::id_key(id), std::move(h));
+  _backends[b]->out.post(lsp::make_request(id, method, std::move(params)));
+}
+
+void session::broadcast(const json::object& msg) {
+  jsonrpc::shared_message shared{msg};
+  for (std::size_t b = 0; b < _backends.size(); ++b) send(b, shared);
+}
+
+/** Hold the changes in `didChangeWatchedFiles` PARAMS back, with any
+ *  others that come before the window closes.
+ */
+void session::batch_watched(const json::object& params) {
+  const auto* changes = lsp::get_array(params, "changes");
+  if (changes == nullptr) return;
+  bool opening = _watched.empty();
+  _watched.add(*changes);
+  if (!opening) return;
+  _watched_timer.expires_after(_watched_window);
+  _watched_timer.async_wait([this](boost::system::error_code ec) {
+    if (!ec) flush_watched();
+  });
+}
+
+/** Send the watched file changes held back, as one notification. */
+void session::flush_watched() {
+  _watched_timer.cancel();
+  if (_watched.empty()) return;
+  broadcast(lsp::make_notification(
+      "workspace/didChangeWatchedFiles",
+      json::object{{"changes", _watched.take()}}));
+}
+
+void session::sync(std::size_t shard, const json::object& msg) {
+  jsonrpc::shared_message shared{msg};
+  for (auto b = shard * _replicas; b < (shard + 1) * _replicas; ++b)
+    send(b, shared);
+}
+
+void session::fan_out(
+    json::object msg, const std::vector<std::size_t>& targets,
+    fanout::merge how,
+    const std::function<void(std::size_t, json::object&)>& tweak) {
+  const auto& id = msg.at("id");
+  auto live = static_cast<std::size_t>(
+      std::count_if(targets.begin(), targets.end(),
+                    [this](auto b) { return !_backends[b]->stopped; }));
+  if (live == 0) {
+    post_client(
+        lsp::make_error(id, lsp::request_failed, "Server is gone"));
+    return;
+  }
+  _fanouts.insert_or_assign(lsp::id_key(id), fanout{how, id, live, {}, {}, {}});
+  for (auto b : targets) {
+    if (_backends[b]->stopped) continue;
+    auto copy = msg;
+    if (tweak) tweak(b, copy);
+    send_request(b, std::move(copy));
+  }
+}
+
+/** Send read-only request MSG to the least loaded replica of SHARD,
+ *  and to another one if no answer comes in time.
+ */
+void session::hedged(json::object msg, std::size_t shard) {
+  auto b = least_loaded(shard).value_or(voice(shard));
+  if (_replicas == 1 || _hedge_delay.count() <= 0) {
+    send_request(b, std::move(msg));
+    return;
+  }
+  auto key = lsp::id_key(msg.at("id"));
+  send_request(b, msg);
+  auto [it, fresh] = _hedges.insert_or_assign(
+      key, hedge{std::move(msg), b, asio::steady_timer{_ex, _hedge_delay}});
+  it->second.timer.async_wait([this, key](boost::system::error_code ec) {
+    if (!ec) hedge_fired(key);
+  });
+}
+
+void session::hedge_fired(const std::string& key) {
+  auto it = _hedges.find(key);
+  if (it == _hedges.end()) return;
+  auto& h = it->second;
+  auto shard = _backends[h.first]->shard;
+  auto second = least_loaded(shard, h.first);
+  if (!second || !_backends[h.first]->inflight.contains(key)) {
+    _hedges.erase(it);
+    return;
+  }
+  send_request(*second, std::move(h.msg));
+}
+
+/** Backend B answered hedged request KEY first: the others needn't. */
+void session::settle_hedge(std::size_t b, const std::string& key) {
+  auto node = _hedges.extract(key);
+  if (node.empty()) return;
+  node.mapped().timer.cancel();
+  auto shard = _backends[b]->shard;
+  for (auto loser = shard * _replicas; loser < (shard + 1) * _replicas;
+       ++loser) {
+    if (loser == b) continue;
+    auto sent = _backends[loser]->inflight.extract(key);
+    if (sent.empty()) continue;
+    send(loser,
+         lsp::make_notification(
+             "$/cancelRequest",
+             json::object{{"id", sent.mapped().at("id")}}));
+  }
+}
+
+void session::fail(std::size_t b, const std::string& key,
+                   std::string_view why) {
+  auto node = _backends[b]->inflight.extract(key);
+  if (node.empty()) return;
+  // A hedged request may yet be answered by the other replica.
+  if (_hedges.contains(key)
+      && std::any_of(_backends.begin(), _backends.end(),
+                     [&key](const auto& be) {
+                       return be->inflight.contains(key);
+                     }))
+    return;
+  deliver(b, key,
+          lsp::make_error(node.mapped().at("id"), lsp::request_failed, why));
+}
+
+void session::deliver(std::size_t b, const std::string& key,
+                      json::object msg) {
+  settle_hedge(b, key);
+  auto it = _fanouts.find(key);
+  if (it == _fanouts.end()) {
+    respond(key, std::move(msg));
+    return;
+  }
+  auto& f = it->second;
+  if (msg.contains("error")) {
+    if (!f.error) f.error = std::move(msg);
+  } else if (f.how == fanout::merge::first) {
+    if (!f.first || b == 0) f.first = std::move(msg);
+  } else if (const auto* items = lsp::get_array(msg, "result")) {
+    f.results.insert(f.results.end(), items->begin(), items->end());
+  }
+  if (--f.waiting > 0) return;
+
+  json::object out;
+  if (f.how == fanout::merge::first && f.first)
+    out = std::move(*f.first);
+  else if (f.how == fanout::merge::concat
+           && (!f.error || !f.results.empty()))
+    out = lsp::make_response(f.id, std::move(f.results));
+  else
+    out = std::move(*f.error);
+  _fanouts.erase(it);
+  respond(key, std::move(out));
+}
+
+void session::respond(const std::string& key, json::object msg) {
+  if (key == _initialize_key) {
+    // The client may use the id again.
+    _initialize_key.clear();
+    _initialized = true;
+    if (!initialize_answered(msg)) return;
+    negotiate_positions(msg);
+  }
+  if (auto node = _flying.extract(key); !node.empty()) {
+    auto& f = node.mapped();
+    land(f, key);
+    for (auto& id : f.joiners) {
+      _joined.erase(lsp::id_key(id));
+      auto copy = msg;
+      copy.insert_or_assign("id", std::move(id));
+      post_client(std::move(copy));
+    }
+    if (!f.leader_waits) return;
+  }
+  post_client(std::move(msg));
+}
+
+/** The backends answered `initialize` with MSG.  Returns whether the
+ *  client still needs to hear about it.
+ */
+bool session::initialize_answered(const json::object& msg) {
+  const auto* result = msg.if_contains("result");
+  if (_init_cache) {
+    if (result != nullptr)
+      _init_cache->store(_init_cache_key, *result);
+    else
+      _init_cache->erase(_init_cache_key);
+  }
+  if (!_speculated) return true;
+
+  auto cached = std::move(*_speculated);
+  _speculated.reset();
+  if (result == nullptr)
+    fmt::println(stderr, "Server failed the initialize answered from cache");
+  else
+    correct_capabilities(cached, *result);
+  // Now the backends are ready for what the client sent meanwhile.
+  auto early = std::move(_early);
+  _early.clear();
+  for (auto& e : early) from_client(std::move(e));
+  return false;
+}
+
+/** Tell the client about capabilities that the server has now but
+ *  didn't when the CACHED `InitializeResult` was saved, those it can
+ *  register dynamically.  Ones it has lost can't be taken back, since
+ *  they were static.
+ */
+void session::correct_capabilities(const json::value& cached,
+                                   const json::value& real) {
+  // Static capability, the method to register dynamically for it, and
+  // the client's capability saying it can be, in `textDocument` or, for
+  // `workspace/` methods, in `workspace`
+  struct provider {
+    std::string_view capability;
+    std::string_view method;
+    std::string_view client;
+  };
+  static constexpr std::array<provider, 31> providers{{
+      {"hoverProvider", "textDocument/hover", "hover"},
+      {"completionProvider", "textDocument/completion", "completion"},
+      {"signatureHelpProvider", "textDocument/signatureHelp", "signatureHelp"},
+      {"declarationProvider", "textDocument/declaration", "declaration"},
+      {"definitionProvider", "textDocument/definition", "definition"},
+      {"typeDefinitionProvider", "textDocument/typeDefinition",
+       "typeDefinition"},
+      {"implementationProvider", "textDocument/implementation",
+       "implementation"},
+      {"referencesProvider", "textDocument/references", "references"},
+      {"documentHighlightProvider", "textDocument/documentHighlight",
+       "documentHighlight"},
+      {"documentSymbolProvider", "textDocument/documentSymbol",
+       "documentSymbol"},
+      {"codeActionProvider", "textDocument/codeAction", "codeAction"},
+      {"codeLensProvider", "textDocument/codeLens", "codeLens"},
+      {"documentLinkProvider", "textDocument/documentLink", "documentLink"},
+      {"colorProvider", "textDocument/documentColor", "colorProvider"},
+      {"documentFormattingProvider", "textDocument/formatting", "formatting"},
+      {"documentRangeFormattingProvider", "textDocument/rangeFormatting",
+       "rangeFormatting"},
+      {"documentOnTypeFormattingProvider", "textDocument/onTypeFormatting",
+       "onTypeFormatting"},
+      {"renameProvider", "textDocument/rename", "rename"},
+      {"foldingRangeProvider", "textDocument/foldingRange", "foldingRange"},
+      {"executeCommandProvider", "workspace/executeCommand", "executeCommand"},
+      {"selectionRangeProvider", "textDocument/selectionRange",
+       "selectionRange"},
+      {"linkedEditingRangeProvider", "textDocument/linkedEditingRange",
+       "linkedEditingRange"},
+      {"callHierarchyProvider", "textDocument/prepareCallHierarchy",
+       "callHierarchy"},
+      {"semanticTokensProvider", "textDocument/semanticTokens",
+       "semanticTokens"},
+      {"monikerProvider", "textDocument/moniker", "moniker"},
+      {"typeHierarchyProvider", "textDocument/prepareTypeHierarchy",
+       "typeHierarchy"},
+      {"inlineValueProvider", "textDocument/inlineValue", "inlineValue"},
+      {"inlayHintProvider", "textDocument/inlayHint", "inlayHint"},
+      {"diagnosticProvider", "textDocument/diagnostic", "diagnostic"},
+      {"workspaceSymbolProvider", "workspace/symbol", "symbol"},
+      {"textDocumentSync", "textDocument/didChange", "synchronization"}}};
+
+  const auto* was = cached.is_object()
+                        ? lsp::get_object(cached.get_object(), "capabilities")
+                        : nullptr;
+  const auto* now = real.is_object()
+                        ? lsp::get_object(real.get_object(), "capabilities")
+                        : nullptr;
+  if (now == nullptr) return;
+  static const json::object none;
+  if (was == nullptr) was = &none;
+
+  auto enabled = [](const json::value* v) {
+    return v != nullptr && !v->is_null()
+           && !(v->is_bool() && !v->get_bool());
+  };
+  // What the client can register dynamically
+  const auto* init = _initialize ? _initialize->if_object() : nullptr;
+  const auto* caps = init != nullptr ? lsp::get_object(*init, "capabilities")
+                                     : nullptr;
+  auto dynamic = [caps](std::string_view method, std::string_view client) {
+    std::string_view where
+        = method.starts_with("workspace/") ? "workspace" : "textDocument";
+    const auto* section
+        = caps != nullptr ? lsp::get_object(*caps, where) : nullptr;
+    const auto* c = section != nullptr ? lsp::get_object(*section, client)
+                                       : nullptr;
+    const auto* d = c != nullptr ? c->if_contains("dynamicRegistration")
+                                 : nullptr;
+    return d != nullptr && d->is_bool() && d->get_bool();
+  };
+  json::array registrations;
+  for (const auto& [capability, method, client] : providers) {
+    const auto* before = was->if_contains(capability);
+    const auto* after = now->if_contains(capability);
+    if (!enabled(after)) {
+      if (enabled(before))
+        fmt::println(stderr, "Server no longer has '{}', client wasn't told",
+                     capability);
+      continue;
+    }
+    if (enabled(before) && *before == *after) continue;
+    if (!dynamic(method, client)) {
+      fmt::println(stderr, "Server now has '{}', client can't be told",
+                   capability);
+      continue;
+    }
+    json::object options;
+    if (after->is_object()) options = after->get_object();
+    if (capability == "textDocumentSync") {
+      // Only the sync kind can be registered for
+      auto kind = after->is_int64()
+                      ? after->get_int64()
+                      : lsp::get_int(options, "change").value_or(0);
+      options = json::object{{"syncKind", kind}};
+    }
+    options.insert_or_assign("documentSelector", nullptr);
+    registrations.push_back(json::object{
+        {"id", fmt::format("lsplex:{}", method)},
+        {"method", json::string_view{method}},
+        {"registerOptions", std::move(options)}});
+  }
+  if (registrations.empty()) return;
+  fmt::println(stderr, "Registering {} capabilities the cache didn't have",
+               registrations.size());
+  post_client(lsp::make_request(
+      fresh_id(), "client/registerCapability",
+      json::object{{"registrations", std::move(registrations)}}));
+}
+
+/** Have the client count columns in UTF-8 bytes if it can and the
+ *  server, answering `initialize` with MSG, only does UTF-16: the
+ *  proxy translates.  MSG may come from the cache, which keeps what
+ *  the servers said, as sessions needn't translate alike.
+ */
+void session::negotiate_positions(json::object& msg) {
+  if (!_utf8_positions || _positions || !_initialize) return;
+  auto* result = msg.if_contains("result");
+  if (result == nullptr || !negotiate_utf8(*_initialize, *result)) return;
+  _positions.emplace(_docs);
+  fmt::println(stderr, "Translating positions: UTF-8 for the client, "
+                       "UTF-16 for the servers");
+}
+
+/** Make the client's MSG count columns as the servers do.  Changes
+ *  are left to be translated as they're applied to the documents.
+ */
+void session::positions_from_client(json::object& msg) {
+  using direction = position_translator::direction;
+  auto name = lsp::get_string(msg, "method");
+  if (!name) {
+    if (auto* result = msg.if_contains("result"))
+      _positions->translate(*result, "", direction::to_server);
+    return;
+  }
+  auto m = lsp::classify(*name);
+  auto* params = msg.if_contains("params");
+  if (params == nullptr || !params->is_object() || m == method::did_open
+      || m == method::did_change)
+    return;
+  auto uri = lsp::document_uri(params->get_object());
+  _positions->translate(*params, uri.value_or(""), direction::to_server);
+  if (const auto* id = msg.if_contains("id"); id != nullptr && uri)
+    _positioned.insert_or_assign(lsp::id_key(*id),
+                                 positioned{std::string{*uri}, m});
+}
+
+/** Make MSG, going to the client, count columns as it does. */
+void session::positions_to_client(json::object& msg) {
+  using direction = position_translator::direction;
+  if (msg.contains("method")) {
+    if (auto* params = msg.if_contains("params"))
+      _positions->translate(*params, "", direction::to_client);
+    return;
+  }
+  const auto* id = msg.if_contains("id");
+  if (id == nullptr) return;
+  auto asked = _positioned.extract(lsp::id_key(*id));
+  auto* result = msg.if_contains("result");
+  if (result == nullptr || result->is_null()) return;
+  std::string_view uri = asked.empty() ? "" : asked.mapped().uri;
+  auto m = asked.empty() ? method::unknown : asked.mapped().method;
+  if (m == method::semantic_tokens_full
+      || m == method::semantic_tokens_range) {
+    auto* tokens = result->if_object();
+    auto* data = tokens != nullptr ? tokens->if_contains("data") : nullptr;
+    if (data != nullptr && data->is_array())
+      _positions->translate_tokens(data->get_array(), uri,
+                                   direction::to_client);
+    return;
+  }
+  _positions->translate(*result, uri, direction::to_client);
+}
+
+/** Send the result list of the response MSG ahead, in `$/progress`
+ *  notifications of at most `_partial_results` items, if the client
+ *  gave its request a partial result token.  MSG is left with an empty
+ *  list, as the last of the partial results.
+ */
+void session::stream_partial(json::object& msg) {
+  auto node = _partial_tokens.extract(lsp::id_key(msg.at("id")));
+  if (node.empty()) return;
+  auto* result = msg.if_contains("result");
+  auto* items = result != nullptr ? result->if_array() : nullptr;
+  if (items == nullptr || items->size() <= _partial_results) return;
+  for (std::size_t i = 0; i < items->size(); i += _partial_results) {
+    auto n = std::min(_partial_results, items->size() - i);
+    json::array part;
+    part.reserve(n);
+    for (std::size_t j = i; j < i + n; ++j)
+      part.push_back(std::move((*items)[j]));
+    _to_client.post(lsp::make_notification(
+        "$/progress",
+        json::object{{"token", node.mapped()}, {"value", std::move(part)}}));
+  }
+  items->clear();
+}
+
+bool session::answer_completion(const json::object& msg,
+                                const json::object& params) {
+  auto uri = lsp::document_uri(params);
+  auto at = lsp::get_position(params, "position");
+  if (!uri || !at) return false;
+  auto line = _docs.line(*uri, at->line);
+  if (!line) return false;
+  auto prefix = word_prefix(*line, utf16_to_byte(*line, at->character));
+
+  // Only plain invocations can be answered from cache: a trigger
+  // character or a re-request for an incomplete list means the
+  // context changed.
+  std::int64_t kind = 1;
+  if (const auto* ctx = lsp::get_object(params, "context"))
+    kind = lsp::get_int(*ctx, "triggerKind").value_or(1);
+
+  const auto& id = msg.at("id");
+  if (kind == 1) {
+    if (auto list = _completions.lookup(*uri, *at, prefix)) {
+      post_client(lsp::make_response(id, std::move(*list)));
+      return true;
+    }
+  }
+  _pending_completions.insert_or_assign(
+      lsp::id_key(id),
+      pending_completion{std::string{*uri}, *at, std::string{prefix}});
+  return false;
+}
+
+bool session::answer_from_disk(const json::object& msg, lsp::method m,
+                               std::string_view uri) {
+  const auto* doc = _docs.find(uri);
+  if (doc == nullptr) return false;
+  // Hash each version's text once, however many requests ask about it.
+  auto [it, fresh] = _text_hashes.try_emplace(std::string{uri});
+  if (fresh || it->second.version != doc->version)
+    it->second = {doc->version, content_hash(doc->text.str())};
+
+  auto key = response_cache::key(lsp::traits(m).name, uri, it->second.hash,
+                                 _server);
+  const auto& id = msg.at("id");
+  if (auto hit = _responses->lookup(key)) {
+    post_client(lsp::make_response(id, std::move(*hit)));
+    return true;
+  }
+  _pending_stores.insert_or_assign(lsp::id_key(id), std::move(key));
+  return false;
+}
+
+/** Answer the client's request MSG, named NAME, about URI, with what
+ *  was prefetched, now or when it comes.  Returns whether it will be.
+ */
+bool session::answer_prefetched(const json::object& msg,
+                                std::string_view name, std::string_view uri) {
+  auto version = _docs.version(uri);
+  if (!version) return false;
+  const auto& id = msg.at("id");
+  auto key = lsp::id_key(id);
+  const auto* params = msg.if_contains("params");
+  if (params == nullptr || !params->is_object()) return false;
+  auto found = _prefetch->take(name, uri, *version, params->get_object(), key,
+                               std::chrono::steady_clock::now());
+  if (found.what == prefetcher::found::nothing) return false;
+  if (found.what == prefetcher::found::pending) {
+    // As if sent: it's failed or resent with the backend's others.
+    _backends[found.backend]->inflight.insert_or_assign(std::move(key), msg);
+    return true;
+  }
+  auto response = lsp::make_response(id, std::move(found.result));
+  keep(key, response);
+  post_client(std::move(response));
+  return true;
+}
+
+void session::prefetch() {
+  auto idle = [this](std::string_view uri) -> std::optional<std::size_t> {
+    auto b = backend_for(uri);
+    const auto& be = *_backends[b];
+    // Interactive traffic goes first.
+    if (be.stopped || be.asleep || be.replaying || !be.inflight.empty())
+      return std::nullopt;
+    return b;
+  };
+  while (auto job = _prefetch->start(idle)) {
+    auto b = job->backend;
+    request(b, job->method, job->params,
+            [this, b, j = std::move(*job)](json::object response) {
+              std::optional<json::value> result;
+              if (const auto* r = response.if_contains("result"))
+                result = *r;
+              auto now = std::chrono::steady_clock::now();
+              for (const auto& key : _prefetch->finish(j, result, now)) {
+                auto& inflight = _backends[b]->inflight;
+                auto it = inflight.find(key);
+                // Unless cancelled meanwhile.
+                if (it == inflight.end()) continue;
+                if (!result) {
+                  // The client's own request may fare better.
+                  send(b, it->second);
+                  continue;
+                }
+                auto answer = lsp::make_response(it->second.at("id"), *result);
+                inflight.erase(it);
+                keep(key, answer);
+                deliver(b, key, std::move(answer));
+              }
+              prefetch();
+            });
+  }
+}
+
+/** Have the request MSG named NAME about URI wait for an identical one
+ *  in flight, if any.  Returns whether it does; if not, it may lead
+ *  later ones.
+ */
+bool session::join_flight(const json::object& msg, std::string_view name,
+                          std::string_view uri) {
+  const auto* params = msg.if_contains("params");
+  auto what = fmt::format("{}\n{}\n{}\n{}", name, uri,
+                          _docs.version(uri).value_or(-1),
+                          params != nullptr ? json::serialize(*params) : "");
+  const auto& id = msg.at("id");
+  auto key = lsp::id_key(id);
+  auto [it, fresh] = _flights.try_emplace(std::move(what), key);
+  if (fresh) {
+    _flying.insert_or_assign(key, flight{it->first, {}, true});
+    return false;
+  }
+  _flying.at(it->second).joiners.push_back(id);
+  // The leader's answer is what gets cached, if anything.
+  _pending_completions.erase(key);
+  _pending_stores.erase(key);
+  _joined.insert_or_assign(std::move(key), it->second);
+  return true;
+}
+
+/** The client cancelled request ID, whose key is KEY.  Returns the
+ *  key of the request to cancel with the backends, if any: none while
+ *  others wait on its answer.
+ */
+std::optional<std::string> session::leave_flight(const std::string& key,
+                                                 const json::value& id) {
+  auto leader = key;
+  if (auto node = _joined.extract(key); !node.empty())
+    leader = std::move(node.mapped());
+  auto it = _flying.find(leader);
+  if (it == _flying.end()) return leader;
+  auto& f = it->second;
+  if (leader == key) {
+    if (!f.leader_waits) return std::nullopt;
+    f.leader_waits = false;
+  } else {
+    auto& j = f.joiners;
+    j.erase(std::remove(j.begin(), j.end(), id), j.end());
+  }
+  post_client(lsp::make_error(id, lsp::request_cancelled, "Cancelled"));
+  if (f.leader_waits || !f.joiners.empty()) return std::nullopt;
+
+  // Nobody waits anymore: cancel it for real, and let new requests
+  // start a flight of their own.
+  land(f, leader);
+  return leader;
+}
+
+/** F, led by LEADER, is over for new requests. */
+void session::land(const flight& f, const std::string& leader) {
+  auto it = _flights.find(f.key);
+  if (it != _flights.end() && it->second == leader) _flights.erase(it);
+}
+
+void session::post_client(json::object msg) {
+  if (_positions) positions_to_client(msg);
+  if (_slim) _slim->slim(msg);
+  const auto* id = msg.if_contains("id");
+  if (id != nullptr && !msg.contains("method")) {
+    if (!_partial_tokens.empty()) stream_partial(msg);
+    auto node = _batched.extract(lsp::id_key(*id));
+    if (!node.empty()) {
+      auto& b = *node.mapped();
+      b.responses.push_back(std::move(msg));
+      if (--b.waiting == 0) _to_client.post(std::move(b.responses));
+      return;
+    }
+  }
+  _to_client.post(std::move(msg));
+}
+
+/** Servers aren't expected to take batches, so MSGS goes to them one
+ *  by one.  Responses to the requests in MSGS go back together, with
+ *  those ANSWERED already.
+ */
+void session::from_client_batch(json::array msgs,
+                                std::vector<json::object> answered) {
+  if (msgs.empty() && answered.empty()) {
+    _to_client.post(
+        lsp::make_error(nullptr, lsp::invalid_request, "Empty batch"));
+    return;
+  }
+  auto b = std::make_shared<batch>();
+  for (const auto& v : msgs) {
+    const auto* o = v.if_object();
+    if (o == nullptr) {
+      b->responses.push_back(
+          lsp::make_error(nullptr, lsp::invalid_request, "Not an object"));
+      continue;
+    }
+    const auto* id = o->if_contains("id");
+    if (id != nullptr && o->contains("method")
+        && _batched.try_emplace(lsp::id_key(*id), b).second)
+      ++b->waiting;
+  }
+  for (const auto& a : answered)
+    if (const auto* id = a.if_contains("id");
+        id != nullptr && _batched.try_emplace(lsp::id_key(*id), b).second)
+      ++b->waiting;
+  for (auto& v : msgs)
+    if (auto* o = v.if_object()) from_client(std::move(*o));
+  for (auto& a : answered) post_client(std::move(a));
+  // Without requests, only errors about the batch itself are due.
+  if (b->waiting == 0 && !b->responses.empty())
+    _to_client.post(std::move(b->responses));
+}
+
+void session::from_client(json::object msg) {
+  if (_speculated) {
+    _early.push_back(std::move(msg));
+    return;
+  }
+  if (_positions) positions_from_client(msg);
+  auto name = lsp::get_string(msg, "method");
+  const auto* id = msg.if_contains("id");
+  // What was held back came first.
+  if (!_watched.empty()
+      && lsp::classify(name.value_or("")) != method::did_change_watched_files)
+    flush_watched();
+  if (!name) {
+    if (id == nullptr) {
+      send(0, std::move(msg));
+      return;
+    }
+    // A response: only the backend that asked gets it, under the id
+    // it used.
+    auto node = _server_requests.extract(lsp::id_key(*id));
+    if (node.empty()) return;
+    msg.insert_or_assign("id", node.mapped().id);
+    send(node.mapped().backend, std::move(msg));
+    return;
+  }
+
+  const auto* params = lsp::get_object(msg, "params");
+  auto m = lsp::classify(*name);
+  if (m == method::did_change_watched_files && _positions
+      && params != nullptr)
+    if (const auto* changes = lsp::get_array(*params, "changes"))
+      for (const auto& change : *changes)
+        if (const auto* c = change.if_object())
+          if (auto uri = lsp::get_string(*c, "uri")) _positions->forget(*uri);
+  if (m == method::did_change_watched_files && _watched_window.count() > 0
+      && params != nullptr) {
+    batch_watched(*params);
+    return;
+  }
+  if (m == method::exit || m == method::shutdown) {
+    _exiting = true;
+  } else if (m == method::did_change_configuration) {
+    _configuration = params != nullptr ? json::value(*params) : json::value();
+  } else if (m == method::cancel_request) {
+    const auto* cancelled = params != nullptr ? params->if_contains("id")
+                                              : nullptr;
+    if (cancelled == nullptr) return;
+    auto key = leave_flight(lsp::id_key(*cancelled), *cancelled);
+    if (!key) return;
+    for (std::size_t b = 0; b < _backends.size(); ++b) {
+      const auto& inflight = _backends[b]->inflight;
+      if (auto it = inflight.find(*key); it != inflight.end())
+        send(b, lsp::make_notification(
+                    "$/cancelRequest",
+                    json::object{{"id", it->second.at("id")}}));
+    }
+    return;
+  } else if (params != nullptr) {
+    if (m == method::did_open) {
+      _docs.did_open(*params);
+    } else if (m == method::did_change) {
+      _completions.did_change(*params);
+      if (_positions) {
+        // Each change's range is against the text the previous ones
+        // left.
+        auto uri = lsp::document_uri(*params).value_or("");
+        _docs.did_change(
+            msg.at("params").as_object(), [this, uri](json::object& range) {
+              _positions->translate(range, uri,
+                                    position_translator::direction::to_server);
+            });
+      } else {
+        _docs.did_change(*params);
+      }
+      if (auto uri = lsp::document_uri(*params); uri && _prefetch)
+        _prefetch->forget(*uri);
+    } else if (m == method::did_close) {
+      _docs.did_close(*params);
+      if (auto uri = lsp::document_uri(*params)) {
+        _completions.invalidate(*uri);
+        _text_hashes.erase(std::string{*uri});
+        if (_prefetch) _prefetch->forget(*uri);
+        // What's on disk is what it'll be now, maybe saved since read.
+        if (_positions) _positions->forget(*uri);
+      }
+    }
+  }
+
+  // Known methods say whether to look for a document; unknown ones
+  // take the slow path and get looked at.
+  const auto& traits = lsp::traits(m);
+  auto uri = params != nullptr
+                     && (traits.document_uri || m == method::unknown)
+                 ? lsp::document_uri(*params)
+                 : std::nullopt;
+  if (id == nullptr) {
+    if (uri) {
+      sync(_shards.shard_of(*uri), msg);
+    } else {
+      broadcast(msg);
+    }
+    // Right behind it, ask what the client will.
+    if (uri && _prefetch && (m == method::did_open || m == method::did_save))
+      if (auto version = _docs.version(*uri)) {
+        const auto* doc = _docs.find(*uri);
+        _prefetch->queue(*uri, *version, doc != nullptr ? doc->text.lines() : 0,
+                         std::chrono::steady_clock::now());
+        prefetch();
+      }
+    return;
+  }
+
+  if (_partial_results > 0 && params != nullptr)
+    if (const auto* token = params->if_contains("partialResultToken"))
+      _partial_tokens.insert_or_assign(lsp::id_key(*id), *token);
+  if (m == method::initialize && _slimming) {
+    const auto* caps = params != nullptr
+                           ? lsp::get_object(*params, "capabilities")
+                           : nullptr;
+    _slim.emplace(caps != nullptr ? *caps : json::object{}, _slim_keep);
+  }
+  if (auto* p = msg.if_contains("params");
+      _slim && p != nullptr && p->is_object()
+      && !_slim->request(lsp::id_key(*id), m, p->get_object())) {
+    post_client(lsp::make_response(*id, std::move(*p)));
+    return;
+  }
+
+  if (m == method::initialize) {
+    _initialize = params != nullptr ? json::value(*params) : json::value();
+    _initialize_key = lsp::id_key(*id);
+    if (_init_cache) {
+      _init_cache_key = init_cache::key(
+          _server, params != nullptr ? workspace_root(*params) : "");
+      if (auto cached = _init_cache->load(_init_cache_key)) {
+        // Answer now, and hold everything else back until the
+        // backends are really initialized.
+        fmt::println(stderr, "Answering initialize from cache");
+        auto answer = lsp::make_response(*id, *cached);
+        negotiate_positions(answer);
+        post_client(std::move(answer));
+        _speculated = std::move(cached);
+      }
+    }
+    fan_out(std::move(msg), everyone(), fanout::merge::first,
+            [this](std::size_t b, json::object& copy) {
+              copy.insert_or_assign("params", initialize_params(b));
+            });
+    return;
+  }
+  if (m == method::shutdown) {
+    fan_out(std::move(msg), everyone(), fanout::merge::first);
+    return;
+  }
+  if (m == method::workspace_symbol) {
+    fan_out(std::move(msg), voices(), fanout::merge::concat);
+    return;
+  }
+  if (m == method::completion && params != nullptr
+      && answer_completion(msg, *params))
+    return;
+  if (uri && _responses && is_persistable(m)
+      && answer_from_disk(msg, m, *uri))
+    return;
+  if (uri && _prefetch && _prefetch->wants(*name)
+      && answer_prefetched(msg, *name, *uri))
+    return;
+  if (uri && is_read_only(m) && join_flight(msg, *name, *uri)) return;
+
+  if (uri && is_hedgeable(m)) {
+    hedged(std::move(msg), _shards.shard_of(*uri));
+    return;
+  }
+
+  auto b = uri ? backend_for(*uri) : _last_backend;
+  if (uri) _last_backend = b;
+  send_request(b, std::move(msg));
+}
+
+void session::from_server(std::size_t b, json::object msg) {
+  auto& be = *_backends[b];
+  be.active = std::chrono::steady_clock::now();
+  const auto* id = msg.if_contains("id");
+  // Replicas echo their shard's voice; the client hears it once.
+  bool heard = b == voice(be.shard);
+  if (id == nullptr) {
+    if (heard) post_client(std::move(msg));
+    return;
+  }
+  if (auto name = lsp::get_string(msg, "method")) {
+    if (!heard && !needs_client(lsp::classify(*name))) {
+      send(b, lsp::make_response(*id, nullptr));
+      return;
+    }
+    auto cid = fresh_id();
+    _server_requests.insert_or_assign(lsp::id_key(cid),
+                                      server_request{b, *id});
+    msg.insert_or_assign("id", cid);
+    post_client(std::move(msg));
+    return;
+  }
+
+  auto key = lsp::id_key(*id);
+  if (auto own = be.own_requests.extract(key); !own.empty()) {
+    own.mapped()(std::move(msg));
+    return;
+  }
+  // Unknown ids are answers to requests the dead predecessor of this
+  // backend was asked, or that were failed since.
+  if (be.inflight.erase(key) == 0) return;
+  // Completion items are set aside before the list is cached, so that
+  // answers from the cache hand out the same tokens.
+  if (_slim && _pending_completions.contains(key)) _slim->slim(msg);
+  keep(key, msg);
+  deliver(b, key, std::move(msg));
+  // Prefetching waits for the client's requests to be answered.
+  if (_prefetch && _prefetch->queued() > 0 && be.inflight.empty())
+    prefetch();
+}
+
+void session::keep(const std::string& key, const json::object& msg) {
+  if (auto node = _pending_completions.extract(key); !node.empty()) {
+    if (const auto* result = msg.if_contains("result")) {
+      auto& p = node.mapped();
+      _completions.store(p.uri, p.at, p.prefix, *result);
+    }
+  }
+  if (auto node = _pending_stores.extract(key); !node.empty()) {
+    if (const auto* result = msg.if_contains("result");
+        result != nullptr && !result->is_null()) {
+      json::value v = *result;
+      // A resultId names server state that a new session won't have,
+      // so a delta request against it would fail.
+      if (v.is_object()) v.as_object().erase("resultId");
+      _responses->store(node.mapped(), v);
+    }
+  }
+}
+
+bool session::pass_through(std::size_t b, const jsonrpc::envelope& head) {
+  // Every position on its way to the client needs translating, and
+  // every response slimming.
+  if (_positions || _slim) return false;
+  auto& be = *_backends[b];
+  if (head.id.empty()) {
+    // Notifications go to the client as they are, if the voice's.
+    auto m = lsp::classify(head.method);
+    return head.payload == "params" && m != method::unknown
+           && lsp::traits(m).kind == lsp::kind::notification
+           && b == voice(be.shard);
+  }
+  // Requests get new ids.
+  if (!head.method.empty() || head.payload == "params") return false;
+
+  boost::system::error_code ec;
+  auto id = json::parse(head.id, ec);
+  if (ec) return false;
+  auto key = lsp::id_key(id);
+  // Responses to the client's requests, unless the session makes
+  // something of them.
+  if (!be.inflight.contains(key) || be.own_requests.contains(key)
+      || _pending_completions.contains(key) || _pending_stores.contains(key)
+      || _fanouts.contains(key) || _batched.contains(key)
+      || _partial_tokens.contains(key) || key == _initialize_key)
+    return false;
+  auto flying = _flying.find(key);
+  if (flying != _flying.end()) {
+    if (!flying->second.joiners.empty() || !flying->second.leader_waits)
+      return false;
+    land(flying->second, key);
+    _flying.erase(flying);
+  }
+  be.inflight.erase(key);
+  settle_hedge(b, key);
+  if (_prefetch && _prefetch->queued() > 0 && be.inflight.empty())
+    prefetch();
+  return true;
+}
+
+void session::client_closed() {
+  _client_gone = true;
+  for (auto& be : _backends) {
+    be->out.close();
+    be->wake.cancel();  // Sleepers must see it too
+  }
+}
+
+void session::server_exited(std::size_t b) { _backends[b]->out.abandon(); }
+
+void session::server_started(std::size_t b, server_out_t& out,
+                             bool respawned) {
+  _backends[b]->out.reset(out);
+  if (respawned) replay(b);
+}
+
+void session::server_stopped(std::size_t b) {
+  auto& be = *_backends[b];
+  be.stopped = true;
+  be.out.abandon();
+  if (_prefetch) _prefetch->abandon(b);
+  std::vector<std::string> keys;
+  for (const auto& [key, msg] : be.inflight) keys.push_back(key);
+  for (const auto& key : keys) fail(b, key, "Server is gone");
+  if (std::all_of(_backends.begin(), _backends.end(),
+                  [](const auto& x) { return x->stopped; }))
+    _to_client.close();
+}
+
+std::chrono::steady_clock::duration session::quiet_for(std::size_t b) const {
+  const auto& be = *_backends[b];
+  if (!_initialized || _exiting || _client_gone || be.stopped || be.asleep
+      || be.replaying || !be.inflight.empty() || !be.own_requests.empty()
+      || std::any_of(_server_requests.begin(), _server_requests.end(),
+                     [b](const auto& kv) { return kv.second.backend == b; }))
+    return {};
+  return std::chrono::steady_clock::now() - be.active;
+}
+
+void session::hibernate(std::size_t b, bool suspended, std::size_t resident) {
+  constexpr double mib = 1 << 20;
+  auto& be = *_backends[b];
+  be.resident = resident;
+  if (suspended) {
+    fmt::println(stderr, "Backend {} suspended with {:.1f} MiB resident", b,
+                 static_cast<double>(resident) / mib);
+  } else {
+    _reclaimed += resident;
+    fmt::println(stderr,
+                 "Backend {} hibernating: {:.1f} MiB reclaimed, {:.1f} MiB "
+                 "in all",
+                 b, static_cast<double>(resident) / mib,
+                 static_cast<double>(_reclaimed) / mib);
+    request(b, "shutdown", nullptr, [this, b](json::object) {
+      _backends[b]->out.post(lsp::make_notification("exit", nullptr));
+    });
+  }
+  be.asleep = true;
+  be.suspended = suspended;
+  be.woken = false;
+}
+
+void session::wake(std::size_t b) {
+  auto& be = *_backends[b];
+  if (!be.asleep || be.woken) return;
+  fmt::println(stderr, "Waking backend {} up", b);
+  be.woken = true;
+  be.wake.cancel();
+}
+
+asio::awaitable<void> session::until_needed(std::size_t b) {
+  auto& be = *_backends[b];
+  while (be.asleep && !be.woken && !_client_gone) {
+    boost::system::error_code ec;
+    co_await be.wake.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+    auto cs = co_await asio::this_coro::cancellation_state;
+    if (cs.cancelled() != asio::cancellation_type::none) co_return;
+  }
+}
+
+void session::resumed(std::size_t b, std::size_t resident) {
+  constexpr double mib = 1 << 20;
+  auto& be = *_backends[b];
+  fmt::println(stderr,
+               "Backend {} resumed: {:.1f} MiB resident, {:.1f} MiB when "
+               "suspended",
+               b, static_cast<double>(resident) / mib,
+               static_cast<double>(be.resident) / mib);
+  be.asleep = false;
+  be.suspended = false;
+  be.woken = false;
+  be.active = std::chrono::steady_clock::now();
+}
+
+/** Bring respawned backend B up to date with the session.
+ *
+ *  Replays the client's `initialize` and `initialized`, the last
+ *  configuration and a `didOpen` for every open document of B's
+ *  shard.  Client requests the old process never answered are sent
+ *  again if read-only, else failed.  New traffic for B is held back
+ *  until it answers `initialize`.  After hibernation, requests in
+ *  flight were never sent, so they all are.
+ */
+void session::replay(std::size_t b) {
+  auto& be = *_backends[b];
+  bool hibernated = be.asleep;
+  if (hibernated) _reclaimed -= std::min(_reclaimed, be.resident);
+  be.asleep = false;
+  be.woken = false;
+  be.replaying = false;
+  be.held.clear();
+  be.own_requests.clear();
+  if (_prefetch) _prefetch->abandon(b);
+  std::erase_if(_server_requests,
+                [b](const auto& kv) { return kv.second.backend == b; });
+
+  std::vector<json::object> resend;
+  std::vector<std::string> lost;
+  for (const auto& [key, msg] : be.inflight) {
+    auto m = lsp::classify(lsp::get_string(msg, "method").value_or(""));
+    if (hibernated || (!_initialized && m == method::initialize)
+        || is_read_only(m))
+      resend.push_back(msg);
+    else
+      lost.push_back(key);
+  }
+  for (const auto& key : lost) fail(b, key, "Server died, request lost");
+
+  if (!_initialized) {
+    // Nothing to replay, the client is still waiting for the
+    // handshake.
+    for (auto& r : resend) be.out.post(std::move(r));
+    return;
+  }
+
+  // Ropes are persistent, so snapshotting the texts here is cheap, and
+  // it freezes them before any held-back change is applied.  They're
+  // flattened once the backend is ready for them.
+  struct snapshot {
+    std::string uri;
+    std::string language_id;
+    std::int64_t version;
+    rope text;
+  };
+  std::vector<snapshot> opens;
+  _docs.for_each([&](const std::string& uri, const auto& doc) {
+    if (_shards.shard_of(uri) != be.shard) return;
+    opens.push_back({uri, doc.language_id, doc.version, doc.text});
+  });
+
+  be.replaying = true;
+  request(b, "initialize", initialize_params(b),
+          [this, b, opens = std::move(opens),
+           resend = std::move(resend)](json::object) mutable {
+            auto& fresh = *_backends[b];
+            fresh.out.post(
+                lsp::make_notification("initialized", json::object{}));
+            if (_configuration)
+              fresh.out.post(lsp::make_notification(
+                  "workspace/didChangeConfiguration", *_configuration));
+            for (const auto& o : opens)
+              fresh.out.post(lsp::make_notification(
+                  "textDocument/didOpen",
+                  json::object{{"textDocument",
+                                {{"uri", o.uri},
+                                 {"languageId", o.language_id},
+                                 {"version", o.version},
+                                 {"text", o.text.str()}}}}));
+            for (auto& r : resend) fresh.out.post(std::move(r));
+            for (auto& h : fresh.held)
+              std::visit([&](auto& m) { fresh.out.post(std::move(m)); }, h);
+            fresh.held.clear();
+            fresh.replaying = false;
+          });
+}
+
+}  // namespace lsplex
@@ -0,0 +1,504 @@
+#pragma once
+
+#include <fmt/core.h>
+
+#include <boost/asio.hpp>
+#include <boost/json.hpp>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "jsonrpc/jsonrpc.h"
+#include "jsonrpc/passthrough.h"
+#include "jsonrpc/pal/pal.h"
+#include "lsplex/completion.h"
+#include "lsplex/documents.h"
+#include "lsplex/export.hpp"
+#include "lsplex/init_cache.h"
+#include "lsplex/lsp.h"
+#include "lsplex/lsplex.h"
+#include "lsplex/methods.h"
+#include "lsplex/positions.h"
+#include "lsplex/prefetch.h"
+#include "lsplex/slimming.h"
+#include "lsplex/response_cache.h"
+#include "lsplex/routing.h"
+#include "lsplex/trace.h"
+#include "lsplex/watchdog.h"
+#include "lsplex/watched_files.h"
+
+namespace lsplex {
+
+namespace asio = boost::asio;
+namespace json = boost::json;
+
+// Framed as configured, see LsOptions.
+using client_in_t = jsonrpc::any_istream<jsonrpc::pal::asio_stdin>;
+using client_out_t = jsonrpc::any_ostream<jsonrpc::pal::asio_stdout>;
+using server_in_t = jsonrpc::any_istream<asio::readable_pipe>;
+using server_out_t = jsonrpc::any_ostream<asio::writable_pipe>;
+
+/** Queue of messages for a sink, written one at a time and in order.
+ *
+ *  Messages to one peer may originate from both directions (e.g. a
+ *  response to the client answered by the proxy itself), and two
+ *  concurrent `async_put` on the same sink would interleave.
+ */
+template <typename Sink> class outbox {
+  // Objects, or batches of them, or messages already serialized for
+  // several sinks.  Entries with a turn are room for a writer that
+  // seize()d the sink.
+  struct entry {
+    json::value msg;
+    jsonrpc::shared_message shared;
+    std::size_t turn{0};
+  };
+
+  Sink* _sink;
+  std::deque<entry> _queue;
+  asio::steady_timer _ready;
+  asio::steady_timer _granted;  // A turn came
+  std::size_t _turns{0};        // Handed out so far
+  std::size_t _holder{0};       // Whose turn it is, if anyone's
+  bool _closed{false};
+  bool _done{false};
+  std::function<void(const json::value&)> _written;
+
+public:
+  explicit outbox(const asio::any_io_executor& ex, Sink* sink = nullptr)
+      : _sink{sink},
+        _ready{ex, asio::steady_timer::time_point::max()},
+        _granted{ex, asio::steady_timer::time_point::max()} {}
+
+  [[nodiscard]] Sink* sink() const { return _sink; }
+
+  /** Have F called with each json::value message once written. */
+  void on_written(std::function<void(const json::value&)> f) {
+    _written = std::move(f);
+  }
+
+  void post(json::value o) {
+    if (_closed) return;
+    _queue.push_back({std::move(o), {}, 0});
+    _ready.cancel();
+  }
+
+  void post(jsonrpc::shared_message m) {
+    if (_closed) return;
+    _queue.push_back({json::value{}, std::move(m), 0});
+    _ready.cancel();
+  }
+
+  /** Wait for what's queued to be written, then have the sink to
+   *  ourselves until release(), e.g. to write a message that isn't a
+   *  json::value.  What's posted meanwhile is written after.  Returns
+   *  null if the sink got closed instead.
+   */
+  asio::awaitable<Sink*> seize() {
+    if (_closed) co_return nullptr;
+    auto turn = ++_turns;
+    _queue.push_back({json::value{}, {}, turn});
+    _ready.cancel();
+    while (_holder != turn) {
+      if (_done) co_return nullptr;
+      boost::system::error_code ec;
+      co_await _granted.async_wait(
+          asio::redirect_error(asio::use_awaitable, ec));
+    }
+    co_return _sink;
+  }
+
+  void release() {
+    _holder = 0;
+    _ready.cancel();
+  }
+
+  /** Take what's queued and not written yet, shared messages parsed
+   *  back.  For looking at what's sent without a sink, as tests do.
+   */
+  std::vector<json::value> take() {
+    std::vector<json::value> taken;
+    for (auto& e : _queue)
+      if (e.shared)
+        taken.push_back(json::parse(e.shared.body()));
+      else if (e.turn == 0)
+        taken.push_back(std::move(e.msg));
+    std::erase_if(_queue, [](const entry& e) { return e.turn == 0; });
+    return taken;
+  }
+
+  /** Finish writing what's queued, then close the sink. */
+  void close() {
+    _closed = true;
+    _ready.cancel();
+  }
+
+  /** Close the sink without writing what's queued. */
+  void abandon() {
+    _queue.clear();
+    close();
+  }
+
+  /** Write to SINK from now on.  The previous drain(), if any, must
+   *  be done.
+   */
+  void reset(Sink& sink) {
+    _sink = &sink;
+    _closed = false;
+    _done = false;
+  }
+
+  asio::awaitable<void> drain() {
+    try {
+      for (;;) {
+        if (_queue.empty()) {
+          if (_closed) break;
+          boost::system::error_code ec;
+          co_await _ready.async_wait(
+              asio::redirect_error(asio::use_awaitable, ec));
+          continue;
+        }
+        auto e = std::move(_queue.front());
+        _queue.pop_front();
+        if (e.turn != 0) {
+          _holder = e.turn;
+          _granted.cancel();
+          while (_holder == e.turn) {
+            boost::system::error_code ec;
+            co_await _ready.async_wait(
+                asio::redirect_error(asio::use_awaitable, ec));
+          }
+          continue;
+        }
+        if (e.shared)
+          co_await _sink->async_put(std::move(e.shared), asio::use_awaitable);
+        else
+          co_await _sink->async_put(e.msg, asio::use_awaitable);
+        if (_written && !e.shared) _written(e.msg);
+      }
+    } catch (std::exception& e) {
+      fmt::println(stderr, "Exception writing: {}", e.what());
+    }
+    // In theory, we should be able to wait on the two 'transfer'
+    // calls as well as the child process in some sort of && chain,
+    // but we can't because per-op cancellation is _not_ supported on
+    // Windows for asio::windows::basic_object_handle (according to
+    // Klemens Morgenstern).  So we close the sink's handle which
+    // should be enough to convince the process to kill itself.
+    _closed = true;
+    _done = true;
+    _queue.clear();
+    _granted.cancel();
+    _sink->handle().close();
+  }
+};
+
+/** Where proxying decisions are made.
+ *
+ *  Sees every message between the client and the backends (running
+ *  instances of the server program) and decides what gets forwarded,
+ *  and to whom.  Each shard is served by one or more replicas, all
+ *  kept in sync; the first live one is the shard's voice towards the
+ *  client.  Ids of server-to-client requests are rewritten so that
+ *  backends can't clash.
+ */
+class LSPLEX_EXPORT session {
+public:
+  /** SERVER identifies the server program, for the `initialize`
+   *  cache.
+   */
+  session(const asio::any_io_executor& ex, client_out_t& client,
+          const LsOptions& options, std::string server);
+
+  [[nodiscard]] std::size_t backends() const { return _backends.size(); }
+  outbox<client_out_t>& to_client() { return _to_client; }
+  outbox<server_out_t>& to_server(std::size_t b) { return _backends[b]->out; }
+
+  void from_client(json::object msg);
+  /** The client's batch MSGS, less the requests that were answered
+   *  before reaching the session with ANSWERED.
+   */
+  void from_client_batch(json::array msgs,
+                         std::vector<json::object> answered = {});
+  void from_server(std::size_t b, json::object msg);
+  /** Whether backend B's message, of which only HEAD was looked at,
+   *  may go to the client as it is.  If so, it's accounted for as
+   *  from_server() would.
+   */
+  bool pass_through(std::size_t b, const jsonrpc::envelope& head);
+
+  /** The client won't send anything else. */
+  void client_closed();
+  /** Backend B's process is gone. */
+  void server_exited(std::size_t b);
+  /** Backend B is (again) writing to OUT.  If RESPAWNED, bring it up
+   *  to date with the session.
+   */
+  void server_started(std::size_t b, server_out_t& out, bool respawned);
+  /** Backend B won't be coming back. */
+  void server_stopped(std::size_t b);
+
+  /** How long backend B has had nothing to do, or zero if it has, or
+   *  can't be put to sleep now.
+   */
+  [[nodiscard]] std::chrono::steady_clock::duration quiet_for(
+      std::size_t b) const;
+  /** Put backend B to sleep, with RESIDENT bytes of memory.  If
+   *  SUSPENDED, its process was frozen; otherwise it's shut down.
+   */
+  void hibernate(std::size_t b, bool suspended, std::size_t resident);
+  [[nodiscard]] bool asleep(std::size_t b) const {
+    return _backends[b]->asleep;
+  }
+  /** Wait until asleep backend B is needed, or the client is gone. */
+  asio::awaitable<void> until_needed(std::size_t b);
+  /** Suspended backend B was thawed, and has RESIDENT bytes again. */
+  void resumed(std::size_t b, std::size_t resident);
+
+  /** The request timelines, if they're being traced. */
+  tracer* tracing() { return _tracer ? &*_tracer : nullptr; }
+  /** The event loop's stall watch, if it's watched. */
+  stall_watch* watching() { return _watch ? &*_watch : nullptr; }
+
+  [[nodiscard]] bool wants_restart() const {
+    return !_client_gone && !_exiting;
+  }
+
+private:
+  using handler = std::function<void(json::object)>;
+
+  struct backend {
+    std::size_t shard;
+    std::size_t replica;
+    outbox<server_out_t> out;
+    // Client requests sent here and not yet answered, as sent.
+    std::unordered_map<std::string, json::object> inflight;
+    // Requests the proxy itself sent here.
+    std::unordered_map<std::string, handler> own_requests;
+    // While a respawned backend initializes, traffic waits here.
+    bool replaying{false};
+    std::deque<std::variant<json::object, jsonrpc::shared_message>> held;
+    bool stopped{false};
+    // Hibernation: when traffic last went either way, and whether the
+    // backend sleeps, frozen or shut down, and has been asked for.
+    std::chrono::steady_clock::time_point active;
+    bool asleep{false};
+    bool suspended{false};
+    bool woken{false};
+    std::size_t resident{0};  // When it fell asleep
+    asio::steady_timer wake;
+
+    backend(const asio::any_io_executor& ex, std::size_t s, std::size_t r)
+        : shard{s},
+          replica{r},
+          out{ex},
+          active{std::chrono::steady_clock::now()},
+          wake{ex, asio::steady_timer::time_point::max()} {}
+  };
+
+  // A client request sent to several backends, whose responses are
+  // merged into one.
+  struct fanout {
+    enum class merge { first, concat } how;
+    json::value id;
+    std::size_t waiting{0};
+    std::optional<json::object> first;
+    json::array results;
+    std::optional<json::object> error;
+  };
+
+  // A read-only client request that goes to a second replica if the
+  // first is slow to answer.  Whichever answers first wins.
+  struct hedge {
+    json::object msg;
+    std::size_t first;
+    asio::steady_timer timer;
+  };
+
+  // A client batch, whose responses go back together.
+  struct batch {
+    std::size_t waiting{0};
+    json::array responses;
+  };
+
+  struct server_request {
+    std::size_t backend;
+    json::value id;  // As the backend knows it
+  };
+
+  struct pending_completion {
+    std::string uri;
+    lsp::position at;
+    std::string prefix;
+  };
+
+  /** Identical requests the client has in flight, sent to the
+   *  backends once under the leader's id.
+   */
+  struct flight {
+    std::string key;                   // In _flights
+    std::vector<json::value> joiners;  // Ids of the others still waiting
+    bool leader_waits{true};
+  };
+
+  asio::any_io_executor _ex;
+  outbox<client_out_t> _to_client;
+  shard_map _shards;
+  std::size_t _replicas;
+  std::chrono::milliseconds _hedge_delay;
+  std::string _server;
+  std::vector<std::unique_ptr<backend>> _backends;
+  document_store _docs;
+  completion_cache _completions;
+
+  std::unordered_map<std::string, fanout> _fanouts;
+  std::unordered_map<std::string, hedge> _hedges;
+  // Batched client requests not yet answered
+  std::unordered_map<std::string, std::shared_ptr<batch>> _batched;
+  std::unordered_map<std::string, server_request> _server_requests;
+  std::unordered_map<std::string, pending_completion> _pending_completions;
+
+  // Responses kept across sessions: what to store them under, by
+  // request id, and the hash of each document's current text.
+  std::optional<response_cache> _responses;
+  std::unordered_map<std::string, std::string> _pending_stores;
+  struct text_hash {
+    std::int64_t version;
+    std::uint64_t hash;
+  };
+  std::unordered_map<std::string, text_hash> _text_hashes;
+
+  // Single-flight: leaders by what they ask, flights by leader id, and
+  // leaders by the id of each joiner.
+  std::unordered_map<std::string, std::string> _flights;
+  std::unordered_map<std::string, flight> _flying;
+  std::unordered_map<std::string, std::string> _joined;
+
+  std::int64_t _next_id{0};
+  // Where requests without a document go, e.g. `*/resolve`.
+  std::size_t _last_backend{0};
+
+  // What's needed to bring a respawned backend to where the dead one
+  // was.
+  std::optional<json::value> _initialize;
+  std::string _initialize_key;
+  bool _initialized{false};
+  std::optional<json::value> _configuration;
+
+  // An `initialize` answered from cache: until the backends answer it
+  // for real, client traffic waits here.
+  std::optional<init_cache> _init_cache;
+  std::string _init_cache_key;
+  std::optional<json::value> _speculated;
+  std::deque<json::object> _early;
+
+  bool _client_gone{false};
+  bool _exiting{false};
+  // Memory given back by backends shut down for hibernation
+  std::size_t _reclaimed{0};
+  std::optional<tracer> _tracer;
+  std::optional<stall_watch> _watch;
+  // Requests sent ahead of the client's, see prefetcher.
+  std::optional<prefetcher> _prefetch;
+
+  // Positions as the client counts them, if not as the servers do:
+  // what each of its requests was about, for the answers.
+  bool _utf8_positions{false};
+  std::optional<position_translator> _positions;
+  struct positioned {
+    std::string uri;
+    lsp::method method;
+  };
+  std::unordered_map<std::string, positioned> _positioned;
+
+  // Client requests that take partial results: their tokens
+  std::size_t _partial_results{0};
+  std::unordered_map<std::string, json::value> _partial_tokens;
+
+  // Made once the client says what it can use
+  bool _slimming{false};
+  std::set<std::string, std::less<>> _slim_keep;
+  std::optional<slimmer> _slim;
+
+  // The client's watched file changes, until the window closes
+  std::chrono::milliseconds _watched_window;
+  watched_changes _watched;
+  asio::steady_timer _watched_timer;
+
+  json::value fresh_id();
+  /** Asleep backend B is needed: have it woken up. */
+  void wake(std::size_t b);
+  /** The voice of SHARD: its first live replica. */
+  std::size_t voice(std::size_t shard) const;
+  std::size_t backend_for(std::string_view uri) const;
+  /** Live replica of SHARD with the fewest requests in flight, other
+   *  than EXCEPT.
+   */
+  std::optional<std::size_t> least_loaded(
+      std::size_t shard, std::optional<std::size_t> except = {}) const;
+  std::vector<std::size_t> everyone() const;
+  std::vector<std::size_t> voices() const;
+  json::value initialize_params(std::size_t b) const;
+
+  /** Send MSG to the client, holding back responses to a batch until
+   *  they can all go.
+   */
+  void post_client(json::object msg);
+  void send(std::size_t b, json::object msg);
+  void send(std::size_t b, jsonrpc::shared_message msg);
+  void send_request(std::size_t b, json::object msg);
+  void request(std::size_t b, std::string_view method, json::value params,
+               handler h);
+  /** Send MSG to every backend, or to every replica of SHARD.  It's
+   *  serialized once for all of them.
+   */
+  void broadcast(const json::object& msg);
+  void sync(std::size_t shard, const json::object& msg);
+  void fan_out(json::object msg, const std::vector<std::size_t>& targets,
+               fanout::merge how,
+               const std::function<void(std::size_t, json::object&)>& tweak
+               = {});
+  void hedged(json::object msg, std::size_t shard);
+  void hedge_fired(const std::string& key);
+  void settle_hedge(std::size_t b, const std::string& key);
+  void fail(std::size_t b, const std::string& key, std::string_view why);
+  void deliver(std::size_t b, const std::string& key, json::object msg);
+  void respond(const std::string& key, json::object msg);
+  bool initialize_answered(const json::object& msg);
+  void correct_capabilities(const json::value& cached,
+                            const json::value& real);
+  void negotiate_positions(json::object& msg);
+  void positions_from_client(json::object& msg);
+  void positions_to_client(json::object& msg);
+  void stream_partial(json::object& msg);
+  void batch_watched(const json::object& params);
+  void flush_watched();
+  bool answer_completion(const json::object& msg, const json::object& params);
+  bool answer_from_disk(const json::object& msg, lsp::method m,
+                        std::string_view uri);
+  bool answer_prefetched(const json::object& msg, std::string_view name,
+                         std::string_view uri);
+  /** Send what prefetching is due and may go now. */
+  void prefetch();
+  /** What the session makes of the answer MSG to request KEY, before
+   *  it goes to the client.
+   */
+  void keep(const std::string& key, const json::object& msg);
+  bool join_flight(const json::object& msg, std::string_view name,
+                   std::string_view uri);
+  std::optional<std::string> leave_flight(const std::string& key,
+                                          const json::value& id);
+  void land(const flight& f, const std::string& leader);
+  void replay(std::size_t b);
+};
+
+}  // namespace lsplex
@@ -0,0 +1,287 @@
+#include "lsplex/slimming.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <charconv>
+#include <initializer_list>
+#include <utility>
+
+#include "lsplex/lsp.h"
+
+namespace json = boost::json;
+
+namespace lsplex {
+
+namespace {
+  constexpr std::string_view token_prefix = "lsplex:";
+
+  const json::object* object_at(const json::object& o,
+                                std::initializer_list<std::string_view> path) {
+    const auto* at = &o;
+    for (auto key : path)
+      if (at = lsp::get_object(*at, key); at == nullptr) break;
+    return at;
+  }
+
+  // Capabilities are flags, or objects that tell more.
+  bool supports(const json::object* caps, std::string_view key) {
+    const auto* v = caps != nullptr ? caps->if_contains(key) : nullptr;
+    return v != nullptr && (v->is_object() || (v->is_bool() && v->get_bool()));
+  }
+
+  void drop(json::object& o, const std::vector<std::string>& fields) {
+    for (const auto& f : fields) o.erase(f);
+  }
+
+  // Null members say nothing absent ones don't, but a `version` may
+  // have to be there even if null.
+  void prune(json::value& v) {
+    if (auto* a = v.if_array()) {
+      for (auto& e : *a) prune(e);
+      return;
+    }
+    auto* o = v.if_object();
+    if (o == nullptr) return;
+    for (auto it = o->begin(); it != o->end();) {
+      if (it->value().is_null() && it->key() != "version") {
+        it = o->erase(it);
+        continue;
+      }
+      if (it->key() != "data" && it->key() != "arguments") prune(it->value());
+      ++it;
+    }
+  }
+
+  // A token is "lsplex:LIST.ITEM".
+  struct token {
+    std::uint64_t list;
+    std::size_t item;
+  };
+
+  std::optional<token> token_of(const json::value& data) {
+    if (!data.is_string()) return std::nullopt;
+    std::string_view s{data.get_string()};
+    if (!s.starts_with(token_prefix)) return std::nullopt;
+    s.remove_prefix(token_prefix.size());
+    token t{};
+    const auto* end = s.data() + s.size();
+    auto [dot, ec] = std::from_chars(s.data(), end, t.list);
+    if (ec != std::errc{} || dot == end || *dot != '.') return std::nullopt;
+    auto [last, ec2] = std::from_chars(dot + 1, end, t.item);
+    if (ec2 != std::errc{} || last != end) return std::nullopt;
+    return t;
+  }
+}  // namespace
+
+slimmer::slimmer(const json::object& client_capabilities,
+                 const std::set<std::string, std::less<>>& keep,
+                 std::size_t max_lists)
+    : _keep_documentation{keep.contains("documentation")},
+      _keep_data{keep.contains("data")},
+      _max_lists{std::max<std::size_t>(max_lists, 1)} {
+  using by_capability
+      = std::initializer_list<std::pair<std::string_view, std::string_view>>;
+  auto unsupported = [&](std::vector<std::string>& fields,
+                         std::initializer_list<std::string_view> path,
+                         by_capability fields_by_capability) {
+    const auto* caps = object_at(client_capabilities, path);
+    for (auto [field, capability] : fields_by_capability)
+      if (!supports(caps, capability) && !keep.contains(field))
+        fields.emplace_back(field);
+  };
+  unsupported(_item_fields, {"textDocument", "completion", "completionItem"},
+              {{"commitCharacters", "commitCharactersSupport"},
+               {"deprecated", "deprecatedSupport"},
+               {"preselect", "preselectSupport"},
+               {"tags", "tagSupport"},
+               {"insertTextMode", "insertTextModeSupport"},
+               {"labelDetails", "labelDetailsSupport"}});
+  unsupported(_diagnostic_fields, {"textDocument", "publishDiagnostics"},
+              {{"relatedInformation", "relatedInformation"},
+               {"tags", "tagSupport"},
+               {"codeDescription", "codeDescriptionSupport"},
+               {"data", "dataSupport"}});
+  unsupported(_symbol_fields, {"textDocument", "documentSymbol"},
+              {{"tags", "tagSupport"}});
+}
+
+bool slimmer::request(const std::string& key, lsp::method m,
+                      json::object& params) {
+  using lsp::method;
+  if (m == method::initialize || m == method::completion
+      || m == method::document_symbol || m == method::document_diagnostic) {
+    _asked.insert_or_assign(key, asked{m, std::nullopt});
+    return true;
+  }
+  if (m != method::completion_resolve) return true;
+
+  std::optional<json::value> documentation;
+  auto* data = params.if_contains("data");
+  // Tokens of lists forgotten since, or data of the server's own that
+  // looks like one, are for the server to make sense of.
+  auto t = data != nullptr ? token_of(*data) : std::nullopt;
+  auto list = t ? _lists.find(t->list) : _lists.end();
+  if (list != _lists.end() && t->item < list->second.items.size()) {
+    auto& k = list->second.items[t->item];
+    const auto& original = k.data ? k.data : list->second.data;
+    if (original) {
+      *data = *original;
+    } else {
+      params.erase("data");
+    }
+    documentation = k.documentation;
+  }
+  if (!_server_resolves) {
+    if (documentation)
+      params.insert_or_assign("documentation", std::move(*documentation));
+    return false;
+  }
+  _asked.insert_or_assign(key, asked{m, std::move(documentation)});
+  return true;
+}
+
+void slimmer::slim(json::object& msg) {
+  if (auto name = lsp::get_string(msg, "method")) {
+    auto* params = msg.if_contains("params");
+    if (msg.contains("id") || params == nullptr || !params->is_object()
+        || lsp::classify(*name) != lsp::method::publish_diagnostics)
+      return;
+    diagnostics(params->get_object().if_contains("diagnostics"));
+    prune(*params);
+    return;
+  }
+  const auto* id = msg.if_contains("id");
+  if (id == nullptr) return;
+  auto node = _asked.extract(lsp::id_key(*id));
+  auto* result = msg.if_contains("result");
+  if (result == nullptr) return;
+  switch (node.empty() ? lsp::method::unknown : node.mapped().method) {
+    case lsp::method::initialize:
+      initialized(*result);
+      return;
+    case lsp::method::completion:
+      completion(*result);
+      break;
+    case lsp::method::completion_resolve:
+      resolved(*result, std::move(node.mapped().documentation));
+      break;
+    case lsp::method::document_symbol:
+      symbols(*result);
+      break;
+    case lsp::method::document_diagnostic:
+      if (auto* report = result->if_object()) {
+        diagnostics(report->if_contains("items"));
+        auto* related = report->if_contains("relatedDocuments");
+        if (related != nullptr && related->is_object())
+          for (auto& kv : related->get_object())
+            if (auto* r = kv.value().if_object())
+              diagnostics(r->if_contains("items"));
+      }
+      break;
+    default:
+      return;
+  }
+  prune(*result);
+}
+
+/** Completion items can be resolved once their documentation is kept
+ *  aside: by the proxy, if the server doesn't.
+ */
+void slimmer::initialized(json::value& result) {
+  auto* r = result.if_object();
+  auto* caps = r != nullptr ? r->if_contains("capabilities") : nullptr;
+  auto* c = caps != nullptr ? caps->if_object() : nullptr;
+  auto* provider = c != nullptr ? c->if_contains("completionProvider")
+                                : nullptr;
+  if (provider == nullptr || !provider->is_object()) return;
+  auto& p = provider->get_object();
+  const auto* resolves = p.if_contains("resolveProvider");
+  _server_resolves = resolves != nullptr && resolves->is_bool()
+                     && resolves->get_bool();
+  if (!_keep_data) p.insert_or_assign("resolveProvider", true);
+}
+
+void slimmer::completion(json::value& result) {
+  auto* items = result.if_array();
+  kept_list kept;
+  if (auto* list = result.if_object()) {
+    auto* i = list->if_contains("items");
+    items = i != nullptr ? i->if_array() : nullptr;
+    const auto* d = lsp::get_object(*list, "itemDefaults");
+    if (const auto* data = d != nullptr ? d->if_contains("data") : nullptr)
+      kept.data = *data;
+  }
+  if (items == nullptr) return;
+  auto number = _next;
+  for (auto& v : *items) {
+    auto* item = v.if_object();
+    if (item == nullptr) continue;
+    drop(*item, _item_fields);
+    keep_aside(*item, kept, number);
+  }
+  if (kept.items.empty()) return;
+  _lists.emplace(_next++, std::move(kept));
+  while (_lists.size() > _max_lists) _lists.erase(_oldest++);
+}
+
+/** Whether DATA is the token of an item kept aside. */
+bool slimmer::known(const json::value& data) const {
+  auto t = token_of(data);
+  if (!t) return false;
+  auto it = _lists.find(t->list);
+  return it != _lists.end() && t->item < it->second.items.size();
+}
+
+/** Put ITEM's documentation and data aside in LIST, numbered NUMBER,
+ *  leaving a token in their place.  Items slimmed before, as they were
+ *  cached, keep theirs.
+ */
+void slimmer::keep_aside(json::object& item, kept_list& list,
+                         std::uint64_t number) {
+  if (_keep_data) return;
+  auto* documentation = _keep_documentation
+                            ? nullptr
+                            : item.if_contains("documentation");
+  auto* own = item.if_contains("data");
+  if (own != nullptr && known(*own)) return;
+  if (documentation == nullptr && own == nullptr) return;
+  kept_item k;
+  if (own != nullptr) k.data = std::move(*own);
+  if (documentation != nullptr) {
+    k.documentation = std::move(*documentation);
+    item.erase("documentation");
+  }
+  item.insert_or_assign(
+      "data", fmt::format("{}{}.{}", token_prefix, number, list.items.size()));
+  list.items.push_back(std::move(k));
+}
+
+void slimmer::resolved(json::value& result,
+                       std::optional<json::value> documentation) {
+  auto* item = result.if_object();
+  if (item == nullptr) return;
+  drop(*item, _item_fields);
+  if (documentation && !item->contains("documentation"))
+    item->insert_or_assign("documentation", std::move(*documentation));
+}
+
+void slimmer::diagnostics(json::value* list) {
+  auto* diagnostics = list != nullptr ? list->if_array() : nullptr;
+  if (diagnostics == nullptr) return;
+  for (auto& d : *diagnostics)
+    if (auto* o = d.if_object()) drop(*o, _diagnostic_fields);
+}
+
+void slimmer::symbols(json::value& result) {
+  auto* list = result.if_array();
+  if (list == nullptr) return;
+  for (auto& v : *list) {
+    auto* symbol = v.if_object();
+    if (symbol == nullptr) continue;
+    drop(*symbol, _symbol_fields);
+    if (auto* children = symbol->if_contains("children")) symbols(*children);
+  }
+}
+
+}  // namespace lsplex
@@ -0,0 +1,148 @@
+#include "lsplex/trace.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include "lsplex/lsp.h"
+
+namespace json = boost::json;
+
+namespace lsplex {
+
+namespace {
+
+constexpr auto none = tracer::clock::time_point{};
+
+// The stretch of a timeline that starts at each point.
+constexpr std::array<std::string_view, 4> phase_names{
+    "read",    // Client to proxy, and parsing
+    "proxy",   // Routing, waiting for the server's pipe
+    "server",  // The server at work
+    "return",  // Proxy back to the client
+};
+
+}  // namespace
+
+tracer::tracer(std::size_t window)
+    : _window{std::max<std::size_t>(window, 1)}, _epoch{clock::now()} {}
+
+void tracer::received(const json::value& msg, clock::time_point received,
+                      clock::time_point parsed) {
+  if (const auto* o = msg.if_object()) {
+    start(*o, received, parsed);
+  } else if (const auto* a = msg.if_array()) {
+    for (const auto& m : *a)
+      if (const auto* o = m.if_object()) start(*o, received, parsed);
+  }
+}
+
+void tracer::start(const json::object& msg, clock::time_point received,
+                   clock::time_point parsed) {
+  const auto* id = msg.if_contains("id");
+  auto method = lsp::get_string(msg, "method");
+  if (id == nullptr || !method) return;
+  auto key = lsp::id_key(*id);
+  timeline t{++_serial, key, std::string{*method}, {}};
+  t.at[static_cast<std::size_t>(point::received)] =
+      received == none ? parsed : received;
+  t.at[static_cast<std::size_t>(point::parsed)] = parsed;
+  // A request never answered is forgotten once the window moves past
+  // it.
+  _open.insert_or_assign(key, std::move(t));
+  _order.push_back(std::move(key));
+  while (_order.size() > _window) {
+    _open.erase(_order.front());
+    _order.pop_front();
+  }
+}
+
+void tracer::mark(const json::value& msg, point p, clock::time_point t) {
+  if (const auto* o = msg.if_object()) {
+    mark_one(*o, p, t);
+  } else if (const auto* a = msg.if_array()) {
+    for (const auto& m : *a)
+      if (const auto* o = m.if_object()) mark_one(*o, p, t);
+  }
+}
+
+void tracer::mark_one(const json::object& msg, point p,
+                      clock::time_point t) {
+  const auto* id = msg.if_contains("id");
+  if (id == nullptr) return;
+  // Only requests are sent, and only responses come back: a server's
+  // own request may well have an id the client uses too.
+  if (msg.contains("method") != (p == point::sent)) return;
+  mark(lsp::id_key(*id), p, t);
+}
+
+void tracer::mark(const std::string& key, point p, clock::time_point t) {
+  auto it = _open.find(key);
+  if (it == _open.end()) return;
+  // The first time counts, e.g. when sent to several servers.
+  auto& at = it->second.at[static_cast<std::size_t>(p)];
+  if (at == none) at = t;
+  if (p != point::replied) return;
+  _done.push_back(std::move(it->second));
+  _open.erase(it);
+  if (_done.size() > _window) _done.pop_front();
+}
+
+std::string tracer::chrome_json() const {
+  auto us = [this](clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(t - _epoch)
+        .count();
+  };
+  json::array events;
+  events.push_back({{"name", "process_name"},
+                    {"ph", "M"},
+                    {"pid", 1},
+                    {"args", {{"name", "lsplex"}}}});
+  // Requests overlap, so they're async slices, each phase nested in
+  // its request by id.
+  auto slice = [&](std::string_view name, std::uint64_t serial,
+                   clock::time_point from, clock::time_point to,
+                   json::object args) {
+    json::object b{{"name", name},       {"cat", "request"},
+                   {"ph", "b"},          {"id", serial},
+                   {"pid", 1},           {"tid", 1},
+                   {"ts", us(from)}};
+    if (!args.empty()) b["args"] = std::move(args);
+    events.push_back(std::move(b));
+    events.push_back({{"name", name},
+                      {"cat", "request"},
+                      {"ph", "e"},
+                      {"id", serial},
+                      {"pid", 1},
+                      {"tid", 1},
+                      {"ts", us(to)}});
+  };
+  for (const auto& t : _done) {
+    const auto& at = t.at;
+    slice(t.method, t.serial, at.front(), at.back(),
+          {{"id", t.key}});
+    // Points not reached, e.g. for requests the proxy answered
+    // itself, are left out.
+    std::size_t from = 0;
+    for (std::size_t to = 1; to < points; ++to) {
+      if (at[to] == none) continue;
+      slice(phase_names[from], t.serial, at[from], at[to], {});
+      from = to;
+    }
+  }
+  return json::serialize(json::object{{"traceEvents", std::move(events)},
+                                      {"displayTimeUnit", "ms"}});
+}
+
+bool tracer::write(const std::string& path) const {
+  std::ofstream file{path, std::ios::binary | std::ios::trunc};
+  file << chrome_json();
+  if (!file) {
+    fmt::println(stderr, "Can't write trace '{}'", path);
+    return false;
+  }
+  return true;
+}
+
+}  // namespace lsplex
@@ -0,0 +1,70 @@
+#include "lsplex/watchdog.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+
+namespace lsplex {
+
+namespace {
+  double ms(stall_watch::clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+  }
+}  // namespace
+
+stall_watch::stall_watch(clock::duration threshold, std::size_t window)
+    : _threshold{threshold}, _window{std::max<std::size_t>(window, 1)} {
+  _lags.reserve(_window);
+}
+
+void stall_watch::ran(std::string_view what, std::string_view where,
+                      clock::duration took) {
+  if (took <= _longest) return;
+  _what = what;
+  _where = where;
+  _longest = took;
+}
+
+std::optional<std::string> stall_watch::probe(clock::time_point due,
+                                              clock::time_point now) {
+  auto lag = std::max(now - due, clock::duration::zero());
+  if (_lags.size() < _window)
+    _lags.push_back(lag);
+  else
+    _lags[_probes % _window] = lag;
+  ++_probes;
+  _worst = std::max(_worst, lag);
+
+  std::optional<std::string> stall;
+  if (lag >= _threshold) {
+    stall = _longest > clock::duration::zero()
+                ? fmt::format("Event loop stalled for {:.1f}ms, longest by "
+                              "{} from {} ({:.1f}ms)",
+                              ms(lag), _what, _where, ms(_longest))
+                : fmt::format("Event loop stalled for {:.1f}ms, not by "
+                              "handling a message",
+                              ms(lag));
+  }
+  _longest = clock::duration::zero();
+  return stall;
+}
+
+stall_watch::clock::duration stall_watch::percentile(double p) const {
+  if (_lags.empty()) return clock::duration::zero();
+  auto lags = _lags;
+  auto last = static_cast<double>(lags.size() - 1);
+  auto i = static_cast<std::size_t>(std::clamp(p, 0.0, 1.0) * last + 0.5);
+  std::nth_element(lags.begin(),
+                   lags.begin() + static_cast<std::ptrdiff_t>(i), lags.end());
+  return lags[i];
+}
+
+std::string stall_watch::summary() const {
+  return fmt::format(
+      "Event loop lag over the last {} of {} probes: p50 {:.2f}ms, p90 "
+      "{:.2f}ms, p99 {:.2f}ms; worst ever {:.1f}ms",
+      _lags.size(), _probes, ms(percentile(0.5)), ms(percentile(0.9)),
+      ms(percentile(0.99)), ms(_worst));
+}
+
+}  // namespace lsplex
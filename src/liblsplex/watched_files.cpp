@@ -0,0 +1,61 @@
+#include "lsplex/watched_files.h"
+
+#include "lsplex/lsp.h"
+
+namespace json = boost::json;
+
+namespace lsplex {
+
+namespace {
+  bool known(std::int64_t type) {
+    return type >= watched_changes::created && type <= watched_changes::deleted;
+  }
+
+  // What BEFORE then AFTER amount to, zero for nothing.
+  std::int64_t net(std::int64_t before, std::int64_t after) {
+    if (before == watched_changes::created)
+      return after == watched_changes::deleted ? 0 : watched_changes::created;
+    return after == watched_changes::deleted ? watched_changes::deleted
+                                             : watched_changes::changed;
+  }
+}  // namespace
+
+void watched_changes::add(const json::array& changes) {
+  for (const auto& c : changes) {
+    const auto* change = c.if_object();
+    if (change == nullptr) continue;
+    auto uri = lsp::get_string(*change, "uri");
+    auto type = lsp::get_int(*change, "type");
+    // Types the LSP doesn't have mean nothing, new or not.
+    if (!uri || !type || !known(*type)) continue;
+    auto [it, fresh] = _index.try_emplace(std::string{*uri}, _events.size());
+    if (fresh) {
+      _events.push_back({std::string{*uri}, *type});
+      ++_net;
+      continue;
+    }
+    auto& e = _events[it->second];
+    e.type = net(e.type, *type);
+    if (e.type == 0) {
+      // Later events start afresh.
+      _index.erase(it);
+      --_net;
+    }
+  }
+  // All came to nothing: nobody will take() what's left of them.
+  if (_net == 0) _events.clear();
+}
+
+json::array watched_changes::take() {
+  json::array events;
+  events.reserve(_net);
+  for (auto& e : _events)
+    if (e.type != 0)
+      events.push_back(json::object{{"uri", e.uri}, {"type", e.type}});
+  _events.clear();
+  _index.clear();
+  _net = 0;
+  return events;
+}
+
+}  // namespace lsplex
@@ -1,8 +1,11 @@
 #include <fmt/core.h>
 #include <lsplex/lsplex.h>
+#include <lsplex/prefetch.h>
 #include <lsplex/version.h>
 
+#include <algorithm>
 #include <cxxopts.hpp>
+#include <utility>
 
 int main(int argc, char* argv[]) {
   cxxopts::Options options(*argv, "A language server proxy");
@@ -11,6 +14,52 @@ int main(int argc, char* argv[]) {
          .add_options()
     ("h,help", "Show help")
     ("v,version", "Print the current version number")
+    ("max-restarts", "Respawn a server that dies at most this many times",
+     cxxopts::value<unsigned>()->default_value("3"))
+    ("shard", "Run a separate server instance for documents under this directory",
+     cxxopts::value<std::vector<std::string>>())
+    ("replicas", "Run this many server instances per shard",
+     cxxopts::value<unsigned>()->default_value("1"))
+    ("hedge-delay", "Milliseconds before a slow read-only request is sent to another replica (0 never)",
+     cxxopts::value<unsigned>()->default_value("150"))
+    ("init-cache", "Directory where to remember servers' initialize results, to answer the next initialize at once",
+     cxxopts::value<std::string>()->default_value(""))
+    ("response-cache", "File where to keep document symbols, folding ranges, semantic tokens and links across sessions",
+     cxxopts::value<std::string>()->default_value(""))
+    ("response-cache-max-mb", "Size in MiB past which the response cache is compacted",
+     cxxopts::value<std::size_t>()->default_value("256"))
+    ("client-framing", "How messages to and from the client are delimited: content-length or ndjson",
+     cxxopts::value<std::string>()->default_value("content-length"))
+    ("server-framing", "How messages to and from the servers are delimited: content-length or ndjson",
+     cxxopts::value<std::string>()->default_value("content-length"))
+    ("deny-method", "Answer the client's requests for this method with an error instead of forwarding them",
+     cxxopts::value<std::vector<std::string>>())
+    ("hibernate-after", "Seconds a server may be idle before it's put to sleep until needed (0 never)",
+     cxxopts::value<unsigned>()->default_value("0"))
+    ("hibernate-mode", "How idle servers sleep: exit (shut down, respawn on demand) or stop (SIGSTOP, SIGCONT on demand)",
+     cxxopts::value<std::string>()->default_value("exit"))
+    ("prefetch", "Ask the servers this about documents as they're opened or saved, ahead of the client (e.g. textDocument/documentSymbol)",
+     cxxopts::value<std::vector<std::string>>())
+    ("prefetch-concurrency", "Prefetching requests in flight at most",
+     cxxopts::value<unsigned>()->default_value("2"))
+    ("utf8-positions", "Let the client count columns in UTF-8 bytes, translating for servers that count UTF-16",
+     cxxopts::value<bool>()->default_value("false"))
+    ("partial-results", "Stream long results to clients that ask for partial ones, this many at a time (0: never)",
+     cxxopts::value<std::size_t>()->default_value("0"))
+    ("slim", "Remove what the client can't use from what goes to it, and send completion documentation on resolve",
+     cxxopts::value<bool>()->default_value("false"))
+    ("slim-keep", "Field to leave alone when slimming (repeatable)",
+     cxxopts::value<std::vector<std::string>>())
+    ("watched-files-window", "Milliseconds to collect the client's watched file changes for, to send them as one (0 never)",
+     cxxopts::value<unsigned>()->default_value("0"))
+    ("trace", "File where to write the timelines of the latest requests as Chrome trace-event JSON, at exit and on SIGUSR1",
+     cxxopts::value<std::string>()->default_value(""))
+    ("trace-window", "How many of the latest requests to keep timelines of",
+     cxxopts::value<std::size_t>()->default_value("10000"))
+    ("stall-threshold", "Milliseconds the event loop may lag before it's logged as stalled, with lag percentiles at exit and on SIGUSR1 (0 never)",
+     cxxopts::value<unsigned>()->default_value("0"))
+    ("server-log-level", "Forward servers' log messages up to this type: 1 errors, 2 warnings, 3 info, 4 log, 5 debug",
+     cxxopts::value<unsigned>()->default_value("5"))
     ("program", "The primary LS program to run", cxxopts::value<std::string>())
     ("program-args", "The primary LS args", cxxopts::value<std::vector<std::string>>()->default_value({}));
   // clang-format on
@@ -36,6 +85,61 @@ int main(int argc, char* argv[]) {
   auto args = result["program-args"].as<std::vector<std::string>>();
   args.erase(args.begin());  // because cxxopts reasons
 
-  lsplex::LsPlex lsplex({lsplex::LsContact{program, args}});
+  lsplex::LsOptions opts;
+  opts.max_restarts = result["max-restarts"].as<unsigned>();
+  opts.replicas = result["replicas"].as<unsigned>();
+  opts.hedge_delay
+      = std::chrono::milliseconds{result["hedge-delay"].as<unsigned>()};
+  opts.init_cache = result["init-cache"].as<std::string>();
+  opts.response_cache = result["response-cache"].as<std::string>();
+  opts.response_cache_max_bytes =
+      result["response-cache-max-mb"].as<std::size_t>() << 20U;
+  for (auto [option, framing] :
+       {std::pair{"client-framing", &opts.client_framing},
+        std::pair{"server-framing", &opts.server_framing}}) {
+    auto name = result[option].as<std::string>();
+    auto f = lsplex::jsonrpc::framing_named(name);
+    if (!f) {
+      fmt::println(stderr, "Unknown --{} '{}'", option, name);
+      return 2;
+    }
+    *framing = *f;
+  }
+  if (result.count("shard"))
+    opts.shards = result["shard"].as<std::vector<std::string>>();
+  if (result.count("deny-method"))
+    opts.deny_methods = result["deny-method"].as<std::vector<std::string>>();
+  opts.server_log_level = result["server-log-level"].as<unsigned>();
+  opts.hibernate_after
+      = std::chrono::seconds{result["hibernate-after"].as<unsigned>()};
+  auto mode = result["hibernate-mode"].as<std::string>();
+  if (mode != "exit" && mode != "stop") {
+    fmt::println(stderr, "Unknown --hibernate-mode '{}'", mode);
+    return 2;
+  }
+  opts.hibernate_stop = mode == "stop";
+  if (result.count("prefetch"))
+    opts.prefetch = result["prefetch"].as<std::vector<std::string>>();
+  for (const auto& m : opts.prefetch) {
+    if (std::find(lsplex::prefetchable.begin(), lsplex::prefetchable.end(), m)
+        == lsplex::prefetchable.end()) {
+      fmt::println(stderr, "Can't --prefetch '{}'", m);
+      return 2;
+    }
+  }
+  opts.prefetch_concurrency = result["prefetch-concurrency"].as<unsigned>();
+  opts.utf8_positions = result["utf8-positions"].as<bool>();
+  opts.partial_results = result["partial-results"].as<std::size_t>();
+  opts.slim = result["slim"].as<bool>();
+  if (result.count("slim-keep") != 0)
+    opts.slim_keep = result["slim-keep"].as<std::vector<std::string>>();
+  opts.watched_files_window = std::chrono::milliseconds{
+      result["watched-files-window"].as<unsigned>()};
+  opts.trace = result["trace"].as<std::string>();
+  opts.trace_window = result["trace-window"].as<std::size_t>();
+  opts.stall_threshold
+      = std::chrono::milliseconds{result["stall-threshold"].as<unsigned>()};
+
+  lsplex::LsPlex lsplex({lsplex::LsContact{program, args}}, opts);
   lsplex.start();
 }
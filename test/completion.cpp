@@ -0,0 +1,115 @@
+#include <doctest/doctest.h>
+#include <lsplex/completion.h>
+
+#include <boost/json.hpp>
+
+namespace json = boost::json;
+
+namespace {
+json::array labels(const json::object& list) {
+  json::array ret;
+  for (const auto& item : list.at("items").as_array())
+    ret.push_back(item.as_object().at("label"));
+  return ret;
+}
+}  // namespace
+
+TEST_CASE("Fuzzy scoring") {
+  CHECK_FALSE(lsplex::fuzzy_score("pbx", "pop_back").has_value());
+  CHECK_FALSE(lsplex::fuzzy_score("bp", "push_back").has_value());
+  CHECK(lsplex::fuzzy_score("pb", "push_back").has_value());
+  CHECK(lsplex::fuzzy_score("PB", "push_back").has_value());
+  CHECK(*lsplex::fuzzy_score("pb", "push_back")
+        > *lsplex::fuzzy_score("pb", "xpushxbackx"));
+  CHECK(*lsplex::fuzzy_score("pbi", "PushBackImpl")
+        > *lsplex::fuzzy_score("pbi", "pushbackimpl"));
+  CHECK(lsplex::word_prefix("  foo.barB(", 10) == "barB");
+  CHECK(lsplex::word_prefix("  foo.", 6).empty());
+}
+
+TEST_CASE("Completion lists are refiltered from cache") {
+  lsplex::completion_cache cache;
+  auto result = json::parse(R"({"isIncomplete": false, "items": [
+    {"label": "push_back"}, {"label": "pop_back"},
+    {"label": " emplace_back", "filterText": "emplace_back"},
+    {"label": "size"}]})");
+  cache.store("file:///a.cpp", {3, 6}, "", result);
+
+  auto list = cache.lookup("file:///a.cpp", {3, 7}, "p");
+  REQUIRE(list.has_value());
+  // Best first, and the shorter of equals
+  CHECK(labels(*list)
+        == json::array{"pop_back", "push_back", " emplace_back"});
+
+  list = cache.lookup("file:///a.cpp", {3, 8}, "pu");
+  REQUIRE(list.has_value());
+  CHECK(labels(*list) == json::array{"push_back"});
+
+  list = cache.lookup("file:///a.cpp", {3, 8}, "em");
+  REQUIRE(list.has_value());
+  CHECK(labels(*list) == json::array{" emplace_back"});
+
+  // Different word, different line, different document
+  CHECK_FALSE(cache.lookup("file:///a.cpp", {3, 12}, "pb").has_value());
+  CHECK_FALSE(cache.lookup("file:///a.cpp", {4, 8}, "pb").has_value());
+  CHECK_FALSE(cache.lookup("file:///b.cpp", {3, 8}, "pb").has_value());
+
+  // Editing another line drops the entry
+  cache.did_change(json::parse(R"({
+    "textDocument": {"uri": "file:///a.cpp", "version": 2},
+    "contentChanges": [{"range": {"start": {"line": 0, "character": 0},
+                                  "end": {"line": 0, "character": 0}},
+                        "text": "x"}]})")
+                       .as_object());
+  CHECK_FALSE(cache.lookup("file:///a.cpp", {3, 8}, "pb").has_value());
+}
+
+TEST_CASE("Cached edits take in what was typed since") {
+  lsplex::completion_cache cache;
+  // Asked at character 6 of line 3, with nothing typed yet
+  auto result = json::parse(R"({"isIncomplete": false,
+    "itemDefaults": {"editRange": {
+      "insert": {"start": {"line": 3, "character": 6},
+                 "end": {"line": 3, "character": 6}},
+      "replace": {"start": {"line": 3, "character": 6},
+                  "end": {"line": 3, "character": 9}}}},
+    "items": [
+      {"label": "foobar", "sortText": "2",
+       "textEdit": {"newText": "foobar",
+                    "range": {"start": {"line": 3, "character": 6},
+                              "end": {"line": 3, "character": 6}}}},
+      {"label": "foobaz", "sortText": "1"}]})");
+  cache.store("file:///a.cpp", {3, 6}, "", result);
+
+  auto list = cache.lookup("file:///a.cpp", {3, 9}, "foo");
+  REQUIRE(list.has_value());
+  // Equal scores go by sortText.
+  CHECK(labels(*list) == json::array{"foobaz", "foobar"});
+  auto edit = list->at("items").as_array()[1].as_object().at("textEdit");
+  auto range = edit.as_object().at("range").as_object();
+  CHECK(range.at("start").as_object().at("character") == 6);
+  CHECK(range.at("end").as_object().at("character") == 9);
+  auto defaults = list->at("itemDefaults").as_object().at("editRange");
+  auto end = [&defaults](std::string_view which) {
+    return defaults.as_object().at(which).as_object().at("end").as_object().at(
+        "character");
+  };
+  CHECK(end("insert") == 9);
+  CHECK(end("replace") == 12);
+
+  // What's stored stays as the server sent it.
+  list = cache.lookup("file:///a.cpp", {3, 7}, "f");
+  REQUIRE(list.has_value());
+  edit = list->at("items").as_array()[1].as_object().at("textEdit");
+  CHECK(edit.as_object().at("range").as_object().at("end").as_object().at(
+            "character")
+        == 7);
+}
+
+TEST_CASE("Incomplete completion lists are never cached") {
+  lsplex::completion_cache cache;
+  cache.store("file:///a.cpp", {0, 0}, "",
+              json::parse(R"({"isIncomplete": true, "items": []})"));
+  CHECK(cache.size() == 0);
+  CHECK_FALSE(cache.lookup("file:///a.cpp", {0, 1}, "p").has_value());
+}
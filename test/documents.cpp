@@ -0,0 +1,72 @@
+#include <doctest/doctest.h>
+#include <lsplex/documents.h>
+#include <lsplex/rope.h>
+
+#include <boost/json.hpp>
+#include <string>
+
+namespace json = boost::json;
+
+TEST_CASE("Rope edits and line index") {
+  std::string ref;
+  for (int i = 0; i < 2000; ++i) ref += "line " + std::to_string(i) + "\n";
+  lsplex::rope r{ref};
+  CHECK(r.size() == ref.size());
+  CHECK(r.lines() == std::size_t{2001});
+  CHECK(r.line(1234) == "line 1234");
+
+  r.replace(5, 6, "zero\r\nand one");
+  ref.replace(5, 1, "zero\r\nand one");
+  CHECK(r.str() == ref);
+  CHECK(r.line(0) == "line zero");
+  CHECK(r.line(1) == "and one");
+  CHECK(r.line_start(2) == ref.find("line 1\n"));
+
+  for (std::size_t i = 0; i < 500; ++i) {
+    r.replace(100 + i, 100 + i, "x");
+    ref.insert(100 + i, "x");
+  }
+  r.replace(50, 3000, "");
+  ref.erase(50, 2950);
+  CHECK(r.str() == ref);
+  CHECK(r.substr(40, 30) == ref.substr(40, 30));
+  CHECK(r.line_start(r.lines()) == std::string::npos);
+}
+
+TEST_CASE("Ropes in one pool share identical content") {
+  lsplex::chunk_pool pool;
+  std::string text;
+  for (int i = 0; i < 5000; ++i) text += "int x" + std::to_string(i) + ";\n";
+  lsplex::rope a{text, &pool};
+  auto bytes = pool.bytes();
+  lsplex::rope b{text, &pool};
+  CHECK(pool.bytes() == bytes);
+  b.replace(10, 10, "// edit\n");
+  CHECK(pool.bytes() < bytes + lsplex::rope::max_chunk * 2);
+  CHECK(a.str() == text);
+}
+
+TEST_CASE("Document store follows incremental changes") {
+  lsplex::document_store docs;
+  docs.did_open(json::parse(R"({"textDocument": {
+    "uri": "file:///a.cpp", "languageId": "cpp", "version": 1,
+    "text": "int main() {\n  return 0;\n}\n"}})")
+                    .as_object());
+  docs.did_change(json::parse(R"({
+    "textDocument": {"uri": "file:///a.cpp", "version": 2},
+    "contentChanges": [
+      {"range": {"start": {"line": 1, "character": 9},
+                 "end": {"line": 1, "character": 10}}, "text": "42"},
+      {"range": {"start": {"line": 0, "character": 0},
+                 "end": {"line": 0, "character": 0}}, "text": "// é😀\n"}]})")
+                      .as_object());
+  CHECK(docs.version("file:///a.cpp") == 2);
+  CHECK(docs.line("file:///a.cpp", 2) == "  return 42;");
+  // 'é' is one UTF-16 unit, the emoji two: character 6 is past both.
+  CHECK(docs.offset("file:///a.cpp", {0, 6}) == std::size_t{9});
+  CHECK(docs.find("file:///a.cpp")->language_id == "cpp");
+
+  docs.did_close(json::parse(R"({"textDocument": {"uri": "file:///a.cpp"}})")
+                     .as_object());
+  CHECK_FALSE(docs.line("file:///a.cpp", 0).has_value());
+}
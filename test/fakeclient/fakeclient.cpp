@@ -0,0 +1,416 @@
+// A load-generating language client, for load tests.
+//
+// Runs a command (typically lsplex in front of fakeserver), opens some
+// documents and fires a mix of edits and requests at it, several at a
+// time.  Reports throughput and latency percentiles per method, and
+// how long diagnostics took to follow an edit.  Exits non-zero if a
+// request failed or timed out.
+
+#include <fmt/core.h>
+#include <jsonrpc/jsonrpc.h>
+
+#include <algorithm>
+#include <boost/asio.hpp>
+#include <boost/json.hpp>
+#include <boost/process/v2.hpp>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cxxopts.hpp>
+#include <deque>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace asio = boost::asio;
+namespace bp2 = boost::process::v2;
+namespace json = boost::json;
+namespace jsonrpc = lsplex::jsonrpc;
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+using us = std::chrono::microseconds;
+
+struct options {
+  std::string mix;
+  std::size_t requests{0};
+  std::size_t concurrency{1};
+  std::size_t documents{1};
+  std::size_t lines{0};
+  std::chrono::milliseconds timeout{0};
+  bool json_report{false};
+};
+
+/** Latencies of one kind of thing. */
+class samples {
+  std::vector<us> _v;
+
+public:
+  void add(us d) { _v.push_back(d); }
+  [[nodiscard]] std::size_t size() const { return _v.size(); }
+
+  /** The P-th percentile, P in [0, 100]. */
+  [[nodiscard]] us percentile(std::size_t p) {
+    if (_v.empty()) return us{0};
+    std::sort(_v.begin(), _v.end());
+    auto i = (_v.size() - 1) * p / 100;
+    return _v[i];
+  }
+};
+
+struct doc {
+  std::string uri;
+  std::int64_t version{1};
+  std::size_t line{0};  // Where typing happens
+  std::size_t col{0};
+};
+
+class client {
+  using in_t = jsonrpc::any_istream<asio::readable_pipe>;
+  using out_t = jsonrpc::any_ostream<asio::writable_pipe>;
+
+  struct pending {
+    std::string method;
+    clock_type::time_point sent;
+    asio::steady_timer* done;
+    json::value response;
+  };
+
+  asio::io_context& _ioc;
+  out_t& _out;
+  const options& _opts;
+  std::deque<json::value> _queue;
+  bool _writing{false};
+  std::int64_t _next_id{0};
+  std::unordered_map<std::int64_t, pending> _pending;
+  std::vector<doc> _docs;
+  // When a didChange was sent, by "uri@version", for diagnostics
+  std::unordered_map<std::string, clock_type::time_point> _changes;
+  std::mt19937 _rng{7};  // NOLINT(*-msc51-cpp): reproducible on purpose
+
+public:
+  std::map<std::string, samples> latencies;
+  std::size_t failures{0};
+  std::size_t notifications{0};
+  std::size_t server_requests{0};
+
+  client(asio::io_context& ioc, out_t& out, const options& opts)
+      : _ioc{ioc}, _out{out}, _opts{opts} {}
+
+  asio::awaitable<void> drain() {
+    _writing = true;
+    try {
+      while (!_queue.empty()) {
+        auto v = std::move(_queue.front());
+        _queue.pop_front();
+        co_await _out.async_put(v, asio::use_awaitable);
+      }
+    } catch (std::exception& e) {
+      fmt::println(stderr, "fakeclient: can't write: {}", e.what());
+    }
+    _writing = false;
+  }
+
+  void post(json::object o) {
+    _queue.push_back(std::move(o));
+    if (!_writing) asio::co_spawn(_ioc, drain(), asio::detached);
+  }
+
+  void notify(std::string_view method, json::value params) {
+    post(json::object{{"jsonrpc", "2.0"},
+                      {"method", json::string_view{method}},
+                      {"params", std::move(params)}});
+  }
+
+  /** Send a request and wait for its response, which is null if none
+   *  came in time.
+   */
+  asio::awaitable<json::value> request(std::string method,
+                                       json::value params) {
+    auto id = ++_next_id;
+    asio::steady_timer done{_ioc, _opts.timeout};
+    _pending.emplace(id, pending{method, clock_type::now(), &done, nullptr});
+    post(json::object{{"jsonrpc", "2.0"},
+                      {"id", id},
+                      {"method", json::string_view{method}},
+                      {"params", std::move(params)}});
+    boost::system::error_code ec;
+    co_await done.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+    auto node = _pending.extract(id);
+    if (!ec) {
+      fmt::println(stderr, "fakeclient: {} timed out", method);
+      ++failures;
+      co_return nullptr;
+    }
+    co_return std::move(node.mapped().response);
+  }
+
+  void received(json::object msg) {
+    const auto* id = msg.if_contains("id");
+    const auto* method = msg.if_contains("method");
+    if (method != nullptr && id != nullptr) {
+      // Whatever the server asks, the answer is "nothing".
+      ++server_requests;
+      post(json::object{{"jsonrpc", "2.0"}, {"id", *id}, {"result", nullptr}});
+      return;
+    }
+    if (method != nullptr) {
+      ++notifications;
+      if (*method == "textDocument/publishDiagnostics") diagnosed(msg);
+      return;
+    }
+    if (id == nullptr || !id->is_int64()) return;
+    auto it = _pending.find(id->get_int64());
+    if (it == _pending.end()) return;
+    auto& p = it->second;
+    latencies[p.method].add(
+        std::chrono::duration_cast<us>(clock_type::now() - p.sent));
+    if (msg.contains("error")) {
+      fmt::println(stderr, "fakeclient: {} failed: {}", p.method,
+                   json::serialize(msg.at("error")));
+      ++failures;
+    }
+    p.response = std::move(msg);
+    p.done->cancel();
+  }
+
+  void diagnosed(const json::object& msg) {
+    const auto& params = msg.at("params").as_object();
+    const auto* version = params.if_contains("version");
+    if (version == nullptr) return;
+    auto key = fmt::format("{}@{}", json::serialize(params.at("uri")),
+                           json::serialize(*version));
+    auto node = _changes.extract(key);
+    if (node.empty()) return;
+    latencies["(diagnostics after edit)"].add(
+        std::chrono::duration_cast<us>(clock_type::now() - node.mapped()));
+  }
+
+  static json::object at(const doc& d) {
+    return {{"textDocument", {{"uri", d.uri}}},
+            {"position", {{"line", d.line}, {"character", d.col}}}};
+  }
+
+  void open_documents() {
+    for (std::size_t i = 0; i < _opts.documents; ++i) {
+      doc d{fmt::format("file:///fake/doc{}.cpp", i)};
+      std::string text;
+      for (std::size_t l = 0; l < _opts.lines; ++l)
+        text += fmt::format("int variable_{} = {};\n", l, l);
+      d.line = _opts.lines;
+      notify("textDocument/didOpen",
+             json::object{{"textDocument",
+                           {{"uri", d.uri},
+                            {"languageId", "cpp"},
+                            {"version", d.version},
+                            {"text", text}}}});
+      _docs.push_back(std::move(d));
+    }
+  }
+
+  /** Type one character into D, as editors do: an edit, then a
+   *  completion request.
+   */
+  asio::awaitable<void> keystroke(doc& d) {
+    ++d.version;
+    _changes.insert_or_assign(
+        fmt::format("\"{}\"@{}", d.uri, d.version), clock_type::now());
+    notify("textDocument/didChange",
+           json::object{
+               {"textDocument", {{"uri", d.uri}, {"version", d.version}}},
+               {"contentChanges",
+                json::array{json::object{
+                    {"range",
+                     {{"start", {{"line", d.line}, {"character", d.col}}},
+                      {"end", {{"line", d.line}, {"character", d.col}}}}},
+                    {"text", "x"}}}}});
+    ++d.col;
+    co_await request("textDocument/completion", at(d));
+  }
+
+  /** One unit of work from the configured mix, on D. */
+  asio::awaitable<void> step(doc& d) {
+    std::uniform_int_distribution<int> pick{0, 99};
+    auto roll = pick(_rng);
+    if (_opts.mix == "typing") roll = 0;
+    if (_opts.mix == "references") roll = 99;
+    if (_opts.mix == "navigation") roll = 50 + roll / 2;
+    if (roll < 50) {
+      co_await keystroke(d);
+    } else if (roll < 70) {
+      co_await request("textDocument/hover", at(d));
+    } else if (roll < 85) {
+      co_await request("textDocument/definition", at(d));
+    } else if (roll < 95) {
+      co_await request("textDocument/documentHighlight", at(d));
+    } else {
+      auto params = at(d);
+      params["context"] = {{"includeDeclaration", true}};
+      co_await request("textDocument/references", std::move(params));
+    }
+  }
+
+  /** Worker W of the configured concurrency.  Each has a document of
+   *  its own, so that edits to it stay in order.
+   */
+  asio::awaitable<void> worker(std::size_t w, std::size_t& budget) {
+    auto& d = _docs[w % _docs.size()];
+    while (budget > 0) {
+      --budget;
+      co_await step(d);
+    }
+  }
+
+  asio::awaitable<void> run(std::size_t& budget) {
+    co_await request("initialize",
+                     json::object{{"processId", nullptr},
+                                  {"rootUri", "file:///fake"},
+                                  {"capabilities", json::object{}}});
+    notify("initialized", json::object{});
+    open_documents();
+
+    auto started = clock_type::now();
+    auto done = std::make_shared<asio::steady_timer>(
+        _ioc, clock_type::time_point::max());
+    auto running = std::make_shared<std::size_t>(_opts.concurrency);
+    for (std::size_t w = 0; w < _opts.concurrency; ++w)
+      asio::co_spawn(_ioc, worker(w, budget), [done, running](auto&&...) {
+        if (--*running == 0) done->cancel();
+      });
+    boost::system::error_code ec;
+    co_await done->async_wait(asio::redirect_error(asio::use_awaitable, ec));
+    elapsed = clock_type::now() - started;
+
+    co_await request("shutdown", nullptr);
+    notify("exit", nullptr);
+    co_await drain();
+  }
+
+  clock_type::duration elapsed{};
+};
+
+asio::awaitable<void> read_all(jsonrpc::any_istream<asio::readable_pipe>& in,
+                               client& c) {
+  try {
+    for (;;) c.received(co_await in.async_get(asio::use_awaitable));
+  } catch (std::exception&) {
+    // The other end exited
+  }
+}
+
+void report(client& c, const options& opts) {
+  auto secs = std::chrono::duration<double>(c.elapsed).count();
+  std::size_t total = 0;
+  for (const auto& [method, s] : c.latencies)
+    if (!method.starts_with("(")) total += s.size();
+  auto throughput = secs > 0 ? static_cast<double>(total) / secs : 0.0;
+  auto ms = [](us d) { return static_cast<double>(d.count()) / 1000.0; };
+
+  if (opts.json_report) {
+    json::object methods;
+    for (auto& [method, s] : c.latencies)
+      methods[method] = {{"count", s.size()},
+                         {"p50_ms", ms(s.percentile(50))},
+                         {"p90_ms", ms(s.percentile(90))},
+                         {"p99_ms", ms(s.percentile(99))},
+                         {"max_ms", ms(s.percentile(100))}};
+    fmt::println("{}", json::serialize(json::object{
+                           {"seconds", secs},
+                           {"requests", total},
+                           {"requests_per_second", throughput},
+                           {"failures", c.failures},
+                           {"notifications", c.notifications},
+                           {"methods", std::move(methods)}}));
+    return;
+  }
+  fmt::println("{} requests in {:.3f}s: {:.1f} req/s, {} failed, "
+               "{} notifications, {} server requests",
+               total, secs, throughput, c.failures, c.notifications,
+               c.server_requests);
+  fmt::println("{:<34} {:>7} {:>9} {:>9} {:>9} {:>9}", "method (ms)", "count",
+               "p50", "p90", "p99", "max");
+  for (auto& [method, s] : c.latencies)
+    fmt::println("{:<34} {:>7} {:>9.3f} {:>9.3f} {:>9.3f} {:>9.3f}", method,
+                 s.size(), ms(s.percentile(50)), ms(s.percentile(90)),
+                 ms(s.percentile(99)), ms(s.percentile(100)));
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  cxxopts::Options cli(*argv, "A load-generating language client");
+  // clang-format off
+  cli.positional_help("-- COMMAND ARGS...")
+     .add_options()
+    ("h,help", "Show help")
+    ("mix", "typing, navigation, references or mixed",
+     cxxopts::value<std::string>()->default_value("mixed"))
+    ("requests", "How many units of work (a keystroke or a request)",
+     cxxopts::value<std::size_t>()->default_value("1000"))
+    ("concurrency", "Units of work in flight at once",
+     cxxopts::value<std::size_t>()->default_value("4"))
+    ("documents", "Documents to open",
+     cxxopts::value<std::size_t>()->default_value("4"))
+    ("lines", "Lines per document",
+     cxxopts::value<std::size_t>()->default_value("2000"))
+    ("timeout", "Milliseconds to wait for any one response",
+     cxxopts::value<unsigned>()->default_value("10000"))
+    ("framing", "How messages are delimited: content-length or ndjson",
+     cxxopts::value<std::string>()->default_value("content-length"))
+    ("json", "Report as JSON")
+    ("command", "The server, or proxy, to drive",
+     cxxopts::value<std::vector<std::string>>());
+  // clang-format on
+  cli.parse_positional({"command"});
+  auto result = cli.parse(argc, argv);
+  if (result["help"].as<bool>() || !result.count("command")) {
+    fmt::println("{}", cli.help());
+    return result["help"].as<bool>() ? 0 : 2;
+  }
+
+  options opts;
+  opts.mix = result["mix"].as<std::string>();
+  opts.requests = result["requests"].as<std::size_t>();
+  opts.concurrency
+      = std::max<std::size_t>(1, result["concurrency"].as<std::size_t>());
+  opts.documents
+      = std::max<std::size_t>(1, result["documents"].as<std::size_t>());
+  opts.lines = result["lines"].as<std::size_t>();
+  opts.timeout = std::chrono::milliseconds{result["timeout"].as<unsigned>()};
+  opts.json_report = result["json"].as<bool>();
+  auto command = result["command"].as<std::vector<std::string>>();
+  auto framing = jsonrpc::framing_named(result["framing"].as<std::string>());
+  if (!framing) {
+    fmt::println(stderr, "fakeclient: unknown framing");
+    return 2;
+  }
+
+  asio::io_context ioc;
+  jsonrpc::any_istream<asio::readable_pipe> in{asio::readable_pipe{ioc},
+                                               *framing};
+  jsonrpc::any_ostream<asio::writable_pipe> out{asio::writable_pipe{ioc},
+                                                *framing};
+  auto exe = bp2::environment::find_executable(command.front());
+  if (exe.empty()) exe = command.front();
+  std::vector<std::string> args{command.begin() + 1, command.end()};
+  bp2::process proc{ioc, exe, args,
+                    bp2::process_stdio{out.handle(), in.handle(), {}}};
+
+  client c{ioc, out, opts};
+  auto budget = opts.requests;
+  asio::co_spawn(ioc, read_all(in, c), asio::detached);
+  asio::co_spawn(ioc, c.run(budget), [&](auto&&...) {
+    out.handle().close();
+  });
+  ioc.run();
+  auto status = proc.wait();
+
+  report(c, opts);
+  if (status != 0)
+    fmt::println(stderr, "fakeclient: command exited with {}", status);
+  return c.failures == 0 && status == 0 ? 0 : 1;
+}
@@ -0,0 +1,332 @@
+// A stand-in for a language server, for load tests.
+//
+// Answers requests with canned results of configurable size after a
+// configurable delay, publishes diagnostics for every document change
+// and can be told to spam notifications or to crash.  Per-method
+// behavior may be scripted with a JSON file like
+//
+//   {"textDocument/references": {"latency": 200, "items": 5000}}
+
+#include <fmt/core.h>
+#include <jsonrpc/jsonrpc.h>
+#include <jsonrpc/pal/pal.h>
+
+#include <boost/asio.hpp>
+#include <boost/json.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cxxopts.hpp>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+
+namespace asio = boost::asio;
+namespace json = boost::json;
+namespace jsonrpc = lsplex::jsonrpc;
+namespace pal = lsplex::jsonrpc::pal;
+
+namespace {
+
+using ms = std::chrono::milliseconds;
+
+struct behavior {
+  ms latency{0};
+  ms jitter{0};
+  std::size_t items{1};  // Results in arrays, or 64-byte lines of hover
+};
+
+struct config {
+  behavior fallback;
+  std::unordered_map<std::string, behavior> methods;
+  std::size_t diagnostics{0};  // Published per didOpen and didChange
+  std::size_t burst{0};        // Log messages per didChange
+  std::size_t crash_after{0};  // Requests, 0 for never
+
+  [[nodiscard]] const behavior& of(const std::string& method) const {
+    auto it = methods.find(method);
+    return it != methods.end() ? it->second : fallback;
+  }
+};
+
+json::object range(std::size_t line) {
+  return {{"start", {{"line", line}, {"character", 0}}},
+          {"end", {{"line", line}, {"character", 4}}}};
+}
+
+json::value result_for(const std::string& method, const json::object& params,
+                       std::size_t items) {
+  json::value uri("file:///fake");
+  if (const auto* td = params.if_contains("textDocument"); td && td->is_object())
+    if (const auto* u = td->get_object().if_contains("uri")) uri = *u;
+
+  if (method == "initialize") {
+    return json::object{
+        {"capabilities",
+         {{"textDocumentSync", 2},
+          {"hoverProvider", true},
+          {"definitionProvider", true},
+          {"declarationProvider", true},
+          {"referencesProvider", true},
+          {"documentHighlightProvider", true},
+          {"documentSymbolProvider", true},
+          {"workspaceSymbolProvider", true},
+          {"completionProvider",
+           {{"triggerCharacters", json::array{"."}}}}}},
+        {"serverInfo", {{"name", "fakeserver"}}}};
+  }
+  if (method == "textDocument/hover") {
+    std::string text;
+    for (std::size_t i = 0; i < items; ++i)
+      text += fmt::format("{:063}\n", i);
+    return json::object{
+        {"contents", {{"kind", "plaintext"}, {"value", text}}}};
+  }
+  json::array a;
+  a.reserve(items);
+  if (method == "textDocument/completion") {
+    for (std::size_t i = 0; i < items; ++i)
+      a.push_back(json::object{{"label", fmt::format("item{}", i)},
+                               {"kind", 6},
+                               {"detail", "int"}});
+    return json::object{{"isIncomplete", false}, {"items", std::move(a)}};
+  }
+  if (method == "textDocument/documentSymbol") {
+    for (std::size_t i = 0; i < items; ++i)
+      a.push_back(json::object{{"name", fmt::format("symbol{}", i)},
+                               {"kind", 12},
+                               {"range", range(i)},
+                               {"selectionRange", range(i)}});
+    return a;
+  }
+  if (method == "workspace/symbol") {
+    for (std::size_t i = 0; i < items; ++i)
+      a.push_back(json::object{{"name", fmt::format("symbol{}", i)},
+                               {"kind", 12},
+                               {"location", {{"uri", uri}, {"range", range(i)}}}});
+    return a;
+  }
+  if (method == "textDocument/documentHighlight") {
+    for (std::size_t i = 0; i < items; ++i)
+      a.push_back(json::object{{"range", range(i)}, {"kind", 1}});
+    return a;
+  }
+  if (method == "textDocument/definition"
+      || method == "textDocument/declaration"
+      || method == "textDocument/typeDefinition"
+      || method == "textDocument/implementation"
+      || method == "textDocument/references") {
+    for (std::size_t i = 0; i < items; ++i)
+      a.push_back(json::object{{"uri", uri}, {"range", range(i)}});
+    return a;
+  }
+  return nullptr;
+}
+
+class fake_server {
+  asio::io_context& _ioc;
+  jsonrpc::any_ostream<pal::asio_stdout>& _out;
+  const config& _cfg;
+  std::deque<json::value> _queue;
+  bool _writing{false};
+  std::unordered_map<std::string, std::shared_ptr<asio::steady_timer>>
+      _pending;
+  std::mt19937 _rng{42};  // NOLINT(*-msc51-cpp): reproducible on purpose
+  std::size_t _requests{0};
+
+  asio::awaitable<void> drain() {
+    _writing = true;
+    try {
+      while (!_queue.empty()) {
+        auto v = std::move(_queue.front());
+        _queue.pop_front();
+        co_await _out.async_put(v, asio::use_awaitable);
+      }
+    } catch (std::exception& e) {
+      fmt::println(stderr, "fakeserver: can't write: {}", e.what());
+      _ioc.stop();
+    }
+    _writing = false;
+  }
+
+  void post(json::value v) {
+    _queue.push_back(std::move(v));
+    if (!_writing) asio::co_spawn(_ioc, drain(), asio::detached);
+  }
+
+  void notify(std::string_view method, json::value params) {
+    post(json::object{{"jsonrpc", "2.0"},
+                      {"method", json::string_view{method}},
+                      {"params", std::move(params)}});
+  }
+
+  ms delay(const behavior& b) {
+    if (b.jitter.count() <= 0) return b.latency;
+    std::uniform_int_distribution<ms::rep> d{0, b.jitter.count()};
+    return b.latency + ms{d(_rng)};
+  }
+
+  asio::awaitable<void> answer(json::value id, std::string method,
+                               json::object params) {
+    const auto& b = _cfg.of(method);
+    auto key = json::serialize(id);
+    auto timer = std::make_shared<asio::steady_timer>(_ioc, delay(b));
+    _pending.insert_or_assign(key, timer);
+    boost::system::error_code ec;
+    co_await timer->async_wait(asio::redirect_error(asio::use_awaitable, ec));
+    _pending.erase(key);
+    if (ec) {
+      post(json::object{{"jsonrpc", "2.0"},
+                        {"id", id},
+                        {"error", {{"code", -32800}, {"message", "Cancelled"}}}});
+      co_return;
+    }
+    post(json::object{{"jsonrpc", "2.0"},
+                      {"id", id},
+                      {"result", result_for(method, params, b.items)}});
+  }
+
+  void publish(const json::object& params) {
+    const auto* td = params.if_contains("textDocument");
+    if (td == nullptr || !td->is_object()) return;
+    const auto& doc = td->as_object();
+    json::array diags;
+    diags.reserve(_cfg.diagnostics);
+    for (std::size_t i = 0; i < _cfg.diagnostics; ++i)
+      diags.push_back(json::object{{"range", range(i)},
+                                   {"severity", 1},
+                                   {"source", "fakeserver"},
+                                   {"message", fmt::format("problem {}", i)}});
+    json::object p{{"uri", doc.at("uri")}, {"diagnostics", std::move(diags)}};
+    if (const auto* v = doc.if_contains("version")) p["version"] = *v;
+    notify("textDocument/publishDiagnostics", std::move(p));
+  }
+
+public:
+  fake_server(asio::io_context& ioc,
+              jsonrpc::any_ostream<pal::asio_stdout>& out, const config& cfg)
+      : _ioc{ioc}, _out{out}, _cfg{cfg} {}
+
+  void handle(json::object msg) {
+    const auto* m = msg.if_contains("method");
+    if (m == nullptr || !m->is_string()) return;  // Responses to us
+    std::string method{m->get_string()};
+    json::object params;
+    if (const auto* p = msg.if_contains("params"); p && p->is_object())
+      params = p->get_object();
+
+    if (const auto* id = msg.if_contains("id")) {
+      if (_cfg.crash_after != 0 && ++_requests > _cfg.crash_after) {
+        fmt::println(stderr, "fakeserver: crashing as told");
+        std::_Exit(3);
+      }
+      asio::co_spawn(_ioc, answer(*id, std::move(method), std::move(params)),
+                     asio::detached);
+      return;
+    }
+    if (method == "exit") {
+      _ioc.stop();
+    } else if (method == "$/cancelRequest") {
+      if (const auto* id = params.if_contains("id")) {
+        auto it = _pending.find(json::serialize(*id));
+        if (it != _pending.end()) it->second->cancel();
+      }
+    } else if (method == "textDocument/didOpen") {
+      publish(params);
+    } else if (method == "textDocument/didChange") {
+      publish(params);
+      for (std::size_t i = 0; i < _cfg.burst; ++i)
+        notify("window/logMessage",
+               json::object{{"type", 4},
+                            {"message", fmt::format("busy, {} of {}", i + 1,
+                                                    _cfg.burst)}});
+    }
+  }
+};
+
+asio::awaitable<void> serve(jsonrpc::any_istream<pal::asio_stdin>& in,
+                            fake_server& server, asio::io_context& ioc) {
+  try {
+    for (;;) server.handle(co_await in.async_get(asio::use_awaitable));
+  } catch (std::exception& e) {
+    fmt::println(stderr, "fakeserver: done reading: {}", e.what());
+  }
+  ioc.stop();
+}
+
+behavior parse_behavior(const json::object& o, behavior b) {
+  if (const auto* v = o.if_contains("latency"))
+    b.latency = ms{v->to_number<ms::rep>()};
+  if (const auto* v = o.if_contains("jitter"))
+    b.jitter = ms{v->to_number<ms::rep>()};
+  if (const auto* v = o.if_contains("items"))
+    b.items = v->to_number<std::size_t>();
+  return b;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  cxxopts::Options options(*argv, "A fake language server, for load tests");
+  // clang-format off
+  options.add_options()
+    ("h,help", "Show help")
+    ("latency", "Milliseconds before answering a request",
+     cxxopts::value<unsigned>()->default_value("0"))
+    ("jitter", "Up to this many more milliseconds, at random",
+     cxxopts::value<unsigned>()->default_value("0"))
+    ("items", "Entries in array results (references, completion...)",
+     cxxopts::value<std::size_t>()->default_value("1"))
+    ("diagnostics", "Diagnostics published per document change",
+     cxxopts::value<std::size_t>()->default_value("0"))
+    ("burst", "Log messages sent per document change",
+     cxxopts::value<std::size_t>()->default_value("0"))
+    ("crash-after", "Die abruptly on this request (0 never)",
+     cxxopts::value<std::size_t>()->default_value("0"))
+    ("script", "JSON file of per-method latency, jitter and items",
+     cxxopts::value<std::string>())
+    ("framing", "How messages are delimited: content-length or ndjson",
+     cxxopts::value<std::string>()->default_value("content-length"));
+  // clang-format on
+  auto result = options.parse(argc, argv);
+  if (result["help"].as<bool>()) {
+    fmt::println("{}", options.help());
+    return 0;
+  }
+
+  config cfg;
+  cfg.fallback.latency = ms{result["latency"].as<unsigned>()};
+  cfg.fallback.jitter = ms{result["jitter"].as<unsigned>()};
+  cfg.fallback.items = result["items"].as<std::size_t>();
+  cfg.diagnostics = result["diagnostics"].as<std::size_t>();
+  cfg.burst = result["burst"].as<std::size_t>();
+  cfg.crash_after = result["crash-after"].as<std::size_t>();
+  if (result.count("script")) {
+    std::ifstream file{result["script"].as<std::string>()};
+    std::stringstream text;
+    text << file.rdbuf();
+    for (const auto& [method, b] : json::parse(text.str()).as_object())
+      cfg.methods.insert_or_assign(std::string{method},
+                                   parse_behavior(b.as_object(), cfg.fallback));
+  }
+
+  auto framing = jsonrpc::framing_named(result["framing"].as<std::string>());
+  if (!framing) {
+    fmt::println(stderr, "fakeserver: unknown framing");
+    return 2;
+  }
+
+  asio::io_context ioc;
+  jsonrpc::any_istream<pal::asio_stdin> in{pal::asio_stdin{ioc}, *framing};
+  jsonrpc::any_ostream<pal::asio_stdout> out{pal::asio_stdout{ioc}, *framing};
+  fake_server server{ioc, out, cfg};
+  asio::co_spawn(ioc, serve(in, server, ioc), asio::detached);
+  ioc.run();
+  // The stdin reader thread may be blocked for good: don't join it.
+  (void)std::fflush(stdout);
+  std::_Exit(0);
+}
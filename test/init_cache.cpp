@@ -0,0 +1,58 @@
+#include <doctest/doctest.h>
+#include <lsplex/init_cache.h>
+#include <lsplex/positions.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/json.hpp>
+
+namespace fs = boost::filesystem;
+namespace json = boost::json;
+
+TEST_CASE("InitializeResults are cached by server and root") {
+  auto dir = fs::temp_directory_path() / fs::unique_path();
+  lsplex::init_cache cache{dir.string()};
+  auto key = lsplex::init_cache::key("clangd\n123", "file:///src");
+  auto other = lsplex::init_cache::key("clangd\n124", "file:///src");
+  json::value result = {{"capabilities", {{"hoverProvider", true}}}};
+
+  CHECK_FALSE(cache.load(key));
+  cache.store(key, result);
+  CHECK(cache.load(key) == result);
+  CHECK_FALSE(cache.load(other));
+  cache.erase(key);
+  CHECK_FALSE(cache.load(key));
+  fs::remove_all(dir);
+}
+
+TEST_CASE("Cached InitializeResults are what the server said") {
+  // Position encodings are for each session to negotiate: the entry a
+  // translating session leaves must not tell one that doesn't to use
+  // UTF-8, and the other way around.
+  auto dir = fs::temp_directory_path() / fs::unique_path();
+  lsplex::init_cache cache{dir.string()};
+  auto key = lsplex::init_cache::key("clangd\n123", "file:///src");
+  json::value params = {
+      {"capabilities",
+       {{"general", {{"positionEncodings", json::array{"utf-8", "utf-16"}}}}}}};
+  json::value result = {{"capabilities", {{"hoverProvider", true}}}};
+  cache.store(key, result);
+
+  // With --utf8-positions
+  auto translating = cache.load(key);
+  REQUIRE(translating);
+  CHECK(lsplex::negotiate_utf8(params, *translating));
+  const auto& caps = translating->as_object().at("capabilities").as_object();
+  CHECK(caps.at("positionEncoding") == "utf-8");
+  // Without, or with a client that can't
+  auto plain = cache.load(key);
+  REQUIRE(plain);
+  CHECK_FALSE(plain->as_object().at("capabilities").as_object().contains(
+      "positionEncoding"));
+  CHECK_FALSE(lsplex::negotiate_utf8(json::object{}, *plain));
+  CHECK(*plain == result);
+
+  // Servers that do UTF-8 themselves need no translating.
+  json::value utf8 = {{"capabilities", {{"positionEncoding", "utf-8"}}}};
+  CHECK_FALSE(lsplex::negotiate_utf8(params, utf8));
+  fs::remove_all(dir);
+}
@@ -15,8 +15,11 @@
 #include <boost/process/v2/process.hpp>
 #include <boost/process/v2/stdio.hpp>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "jsonrpc/pal/pal.h"
+#include "jsonrpc/passthrough.h"
 
 namespace bp2 = boost::process::v2;
 namespace asio = boost::asio;
@@ -36,6 +39,17 @@ TEST_CASE("Get JSON objects from stdin") {
   CHECK(is.get() == json::object{{"hello", 47}});
 }
 
+TEST_CASE("Get batches and objects as messages") {
+  asio::thread_pool ioc{1};
+
+  jsonrpc::istream is{jsonrpc::pal::readable_file{ioc, "resources/batch.txt"}};
+  auto batch = is.get_message();
+  REQUIRE(batch.is_array());
+  CHECK(batch.as_array().size() == 2);
+  CHECK(batch.as_array()[0].as_object().at("method") == "a");
+  CHECK(is.get_message() == json::object{{"hello", 42}});
+}
+
 TEST_CASE("Get JSON objects from a process's stdout") {
   asio::thread_pool ioc{1};
 
@@ -59,3 +73,162 @@ TEST_CASE("Get JSON objects from a process's stdout") {
   CHECK(is.get() == json::object{{"hello", 46}});
   CHECK(is.get() == json::object{{"hello", 47}});
 }
+
+TEST_CASE("Get headers and bodies apart") {
+  asio::thread_pool ioc{1};
+
+  jsonrpc::istream is{
+      jsonrpc::pal::readable_file{ioc, "resources/jsonrpc_1.txt"}};
+  REQUIRE(is.async_get_header(asio::use_future).get() == 12);
+  std::string body(12, '\0');
+  is.async_get_body(asio::buffer(body), asio::use_future).get();
+  CHECK(body == R"({"hello":42})");
+  CHECK(is.get() == json::object{{"hello", 43}});
+}
+
+TEST_CASE("Get newline-delimited JSON") {
+  asio::thread_pool ioc{1};
+
+  jsonrpc::istream<jsonrpc::pal::readable_file, jsonrpc::ndjson> is{
+      jsonrpc::pal::readable_file{ioc, "resources/ndjson.txt"}};
+  CHECK(is.get() == json::object{{"hello", 42}});
+  CHECK(is.get() == json::object{{"hello", 43}});
+  auto batch = is.get_message();
+  REQUIRE(batch.is_array());
+  CHECK(batch.as_array().size() == 2);
+  CHECK(is.get() == json::object{{"hello", 44}});
+}
+
+TEST_CASE("Put and get in either framing") {
+  for (auto framing :
+       {jsonrpc::framing::content_length, jsonrpc::framing::ndjson}) {
+    asio::io_context ioc;
+    asio::readable_pipe r{ioc};
+    asio::writable_pipe w{ioc};
+    asio::connect_pipe(r, w);
+    jsonrpc::any_istream is{std::move(r), framing};
+    jsonrpc::any_ostream os{std::move(w), framing};
+
+    // Newlines inside strings are escaped, so don't end lines.
+    json::object multiline{{"text", "one\ntwo\n"}};
+    json::object hello{{"hello", 42}};
+    std::vector<json::object> got;
+    auto put = [&]() -> asio::awaitable<void> {
+      co_await os.async_put(multiline, asio::use_awaitable);
+      co_await os.async_put(hello, asio::use_awaitable);
+    };
+    auto get = [&]() -> asio::awaitable<void> {
+      for (int i = 0; i < 2; ++i)
+        got.push_back(co_await is.async_get(asio::use_awaitable));
+    };
+    asio::co_spawn(ioc, put(), asio::detached);
+    asio::co_spawn(ioc, get(), asio::detached);
+    ioc.run();
+    REQUIRE(got.size() == 2);
+    CHECK(got[0] == multiline);
+    CHECK(got[1] == hello);
+    CHECK((is.get_if<jsonrpc::ndjson>() != nullptr)
+          == (framing == jsonrpc::framing::ndjson));
+  }
+}
+
+TEST_CASE("Write one serialized message to several sinks") {
+  asio::io_context ioc;
+  asio::readable_pipe r1{ioc};
+  asio::writable_pipe w1{ioc};
+  asio::connect_pipe(r1, w1);
+  asio::readable_pipe r2{ioc};
+  asio::writable_pipe w2{ioc};
+  asio::connect_pipe(r2, w2);
+  jsonrpc::any_istream is1{std::move(r1), jsonrpc::framing::content_length};
+  jsonrpc::any_ostream os1{std::move(w1), jsonrpc::framing::content_length};
+  jsonrpc::any_istream is2{std::move(r2), jsonrpc::framing::ndjson};
+  jsonrpc::any_ostream os2{std::move(w2), jsonrpc::framing::ndjson};
+
+  json::object hello{{"hello", 42}};
+  jsonrpc::shared_message m{hello};
+  CHECK(m.header() == "Content-Length: 12\r\n\r\n");
+  os1.async_put(m, asio::detached);
+  os2.async_put(m, asio::detached);
+  // Each write holds on to the text until it's done.
+  CHECK(m.use_count() == 3);
+  json::object got1;
+  json::object got2;
+  asio::co_spawn(
+      ioc,
+      [&]() -> asio::awaitable<void> {
+        got1 = co_await is1.async_get(asio::use_awaitable);
+        got2 = co_await is2.async_get(asio::use_awaitable);
+      },
+      asio::detached);
+  ioc.run();
+  CHECK(m.use_count() == 1);
+  CHECK(got1 == hello);
+  CHECK(got2 == hello);
+}
+
+TEST_CASE("Sniff the envelope of a message") {
+  auto response = jsonrpc::sniff(R"({"jsonrpc":"2.0","id":3,"result":[1,)");
+  REQUIRE(response);
+  CHECK(response->id == "3");
+  CHECK(response->method.empty());
+  CHECK(response->payload == "result");
+
+  auto notification = jsonrpc::sniff(
+      R"( { "jsonrpc" : "2.0", "method": "$/progress", "params": {)");
+  REQUIRE(notification);
+  CHECK(notification->id.empty());
+  CHECK(notification->method == "$/progress");
+  CHECK(notification->payload == "params");
+
+  CHECK(jsonrpc::sniff(R"({"id":"a\"b","error":{)")->id == R"("a\"b")");
+  CHECK_FALSE(jsonrpc::sniff(R"({"jsonrpc":"2.0","id":3)"));
+  CHECK_FALSE(jsonrpc::sniff(R"({"jsonrpc":"2.0","id":3})"));
+  CHECK_FALSE(jsonrpc::sniff(R"({"x":{},"result":1})"));
+  CHECK_FALSE(jsonrpc::sniff(R"([{"id":1,"result":1}])"));
+}
+
+#if defined(__linux__)
+TEST_CASE("Splice the rest of a body from pipe to pipe") {
+  asio::io_context ioc;
+  asio::readable_pipe from_r{ioc};
+  asio::writable_pipe from_w{ioc};
+  asio::connect_pipe(from_r, from_w);
+  asio::readable_pipe to_r{ioc};
+  asio::writable_pipe to_w{ioc};
+  asio::connect_pipe(to_r, to_w);
+
+  // Bigger than a pipe, so that it can't be moved all at once.
+  auto body = R"({"id":1,"result":")" + std::string(100000, 'x') + R"("})";
+  auto message = "Content-Length: " + std::to_string(body.size())
+                 + "\r\n\r\n" + body;
+  jsonrpc::istream is{std::move(from_r)};
+  jsonrpc::splicer splicer{ioc.get_executor(), is.handle().native_handle(),
+                           to_w.native_handle()};
+  std::string head(256, '\0');
+  std::string rest(body.size() - head.size(), '\0');
+
+  auto write = [&]() -> asio::awaitable<void> {
+    co_await asio::async_write(from_w, asio::buffer(message),
+                               asio::use_awaitable);
+  };
+  auto forward = [&]() -> asio::awaitable<void> {
+    auto length = co_await is.async_get_header(asio::use_awaitable);
+    CHECK(length == body.size());
+    // Some of the body was read ahead with the header.
+    CHECK(is.buffered() > 0);
+    co_await is.async_get_body(asio::buffer(head), asio::use_awaitable);
+    auto envelope = jsonrpc::sniff(head);
+    CHECK((envelope && envelope->id == "1"));
+    co_await splicer.async_move(length - head.size(), asio::use_awaitable);
+  };
+  auto read = [&]() -> asio::awaitable<void> {
+    co_await asio::async_read(to_r, asio::buffer(rest), asio::use_awaitable);
+  };
+  asio::co_spawn(ioc, write(), asio::detached);
+  asio::co_spawn(ioc, forward(), asio::detached);
+  asio::co_spawn(ioc, read(), asio::detached);
+  ioc.run();
+  CHECK(head + rest == body);
+}
+#endif
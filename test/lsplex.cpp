@@ -5,6 +5,8 @@
 #include <jsonrpc/pal/pal.h>
 #include <unistd.h>
 
+#include <boost/json.hpp>
+
 #include <fstream>
 #include <string>
 #include <thread>
@@ -39,3 +41,43 @@ TEST_CASE("Loop some well behaved messages fully through LsPlex") {
   CHECK(slurped.size() == buffer.str().size());
   CHECK(slurped == buffer.str());
 }
+
+TEST_CASE("Denied requests are answered within the client's batch") {
+  lsplex::jsonrpc::pal::redirector r{"resources/denied_batch.txt"};
+  std::thread th{[]{
+#if defined(_MSC_VER) || defined(__MINGW64__)
+    lsplex::LsContact contact{"./wincat.exe", {}};
+#else
+    lsplex::LsContact contact{"cat", {}};
+#endif
+    lsplex::LsOptions options;
+    options.deny_methods = {"textDocument/hover"};
+    lsplex::LsPlex plex{{contact}, options};
+    plex.start();
+    ::close(STDOUT_FILENO);
+  }};
+  th.join();
+  auto slurped = r.slurp();
+
+  // Whatever cat echoes comes back on its own, but the answer to the
+  // request is in the batch's response, not a stray one.
+  std::vector<boost::json::value> messages;
+  constexpr std::string_view header = "Content-Length: ";
+  for (std::size_t at = slurped.find(header); at != std::string::npos;
+       at = slurped.find(header, at)) {
+    auto length = std::stoul(slurped.substr(at + header.size()));
+    auto body = slurped.find("\r\n\r\n", at) + 4;
+    messages.push_back(boost::json::parse(slurped.substr(body, length)));
+    at = body + length;
+  }
+  const boost::json::array* batch = nullptr;
+  for (const auto& m : messages) {
+    if (m.is_array()) batch = &m.get_array();
+    CHECK_FALSE((m.is_object() && m.get_object().contains("id")));
+  }
+  REQUIRE(batch != nullptr);
+  REQUIRE(batch->size() == 1);
+  const auto& answer = batch->at(0).as_object();
+  CHECK(answer.at("id") == 1);
+  CHECK(answer.at("error").as_object().at("code") == -32601);
+}
@@ -0,0 +1,22 @@
+#include <doctest/doctest.h>
+#include <lsplex/methods.h>
+
+#include <cstddef>
+
+using namespace lsplex::lsp;  // NOLINT
+
+TEST_CASE("Every LSP method classifies as itself") {
+  for (std::size_t m = 0; m + 1 < method_table.size(); ++m)
+    CHECK(classify(method_table[m].name) == static_cast<method>(m));
+  CHECK(classify("textDocument/hove") == method::unknown);
+  CHECK(classify("$/clangd/fileStatus") == method::unknown);
+}
+
+TEST_CASE("Method traits") {
+  CHECK(traits("textDocument/didChange").kind == kind::notification);
+  CHECK(traits("textDocument/didChange").priority == priority::sync);
+  CHECK(traits("textDocument/hover").idempotent);
+  CHECK(traits("textDocument/hover").document_uri);
+  CHECK(traits("workspace/applyEdit").direction == direction::to_client);
+  CHECK_FALSE(traits("experimental/thing").idempotent);
+}
@@ -0,0 +1,88 @@
+#include <doctest/doctest.h>
+#include <lsplex/pipeline.h>
+
+#include <string>
+
+using namespace lsplex;  // NOLINT
+
+namespace {
+
+json::object log_message(int type) {
+  return lsp::make_notification("window/logMessage",
+                                json::object{{"type", type}, {"message", "x"}});
+}
+
+/** Counts what it sees, and passes it on. */
+struct counter {
+  int* seen;
+  verdict operator()(json::object& /*msg*/) const {
+    ++*seen;
+    return verdict::pass;
+  }
+};
+
+/** Tags what it sees. */
+struct tagger {
+  verdict operator()(json::object& msg) const {
+    msg["tagged"] = true;
+    return verdict::pass;
+  }
+};
+
+static_assert(stage<log_filter>);
+static_assert(stage<method_filter>);
+static_assert(!stage<int>);
+static_assert(plain_pipeline::empty);
+static_assert(!server_pipeline::empty);
+
+}  // namespace
+
+TEST_CASE("An empty pipeline passes everything") {
+  plain_pipeline p;
+  auto msg = log_message(5);
+  auto copy = msg;
+  CHECK(p(msg) == verdict::pass);
+  CHECK(msg == copy);
+}
+
+TEST_CASE("Stages run in order until one stops the message") {
+  int before = 0;
+  int after = 0;
+  pipeline p{counter{&before}, tagger{}, log_filter{3}, counter{&after}};
+
+  auto info = log_message(3);
+  CHECK(p(info) == verdict::pass);
+  CHECK(info.contains("tagged"));
+
+  auto debug = log_message(5);
+  CHECK(p(debug) == verdict::drop);
+  CHECK(before == 2);
+  CHECK(after == 1);
+}
+
+TEST_CASE("Log messages are filtered by type") {
+  log_filter f{2};
+  auto error = log_message(1);
+  auto info = log_message(3);
+  auto other = lsp::make_notification("window/showMessage",
+                                      json::object{{"type", 4}});
+  CHECK(f(error) == verdict::pass);
+  CHECK(f(info) == verdict::drop);
+  CHECK(f(other) == verdict::pass);
+}
+
+TEST_CASE("Denied methods are answered or dropped") {
+  method_filter f{{"textDocument/inlayHint", "$/setTrace"}};
+
+  auto request = lsp::make_request(7, "textDocument/inlayHint", nullptr);
+  CHECK(f(request) == verdict::answer);
+  CHECK(request.at("id") == 7);
+  CHECK(request.at("error").as_object().at("code") == lsp::method_not_found);
+
+  auto notification = lsp::make_notification("$/setTrace", nullptr);
+  CHECK(f(notification) == verdict::drop);
+
+  auto hover = lsp::make_request(8, "textDocument/hover", nullptr);
+  CHECK(f(hover) == verdict::pass);
+  CHECK_FALSE(hover.contains("error"));
+}
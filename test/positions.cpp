@@ -0,0 +1,126 @@
+#include <doctest/doctest.h>
+#include <lsplex/documents.h>
+#include <lsplex/positions.h>
+#include <lsplex/routing.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/json.hpp>
+#include <fstream>
+
+namespace fs = boost::filesystem;
+namespace json = boost::json;
+using direction = lsplex::position_translator::direction;
+
+namespace {
+json::object open(std::string_view uri, std::string_view text) {
+  return json::object{
+      {"textDocument",
+       {{"uri", uri}, {"languageId", "cpp"}, {"version", 1}, {"text", text}}}};
+}
+
+std::int64_t character(const json::value& position) {
+  return position.as_object().at("character").as_int64();
+}
+}  // namespace
+
+TEST_CASE("Columns convert between UTF-8 bytes and UTF-16 units") {
+  // 'é' is 2 bytes and 1 unit, the emoji 4 bytes and 2 units.
+  std::string_view line = "a\xC3\xA9\xF0\x9F\x98\x80 long enough for eight";
+  CHECK(lsplex::byte_to_utf16(line, 1) == 1);
+  CHECK(lsplex::byte_to_utf16(line, 3) == 2);
+  CHECK(lsplex::byte_to_utf16(line, 8) == 5);
+  CHECK(lsplex::utf16_to_byte(line, 5) == 8);
+  CHECK(lsplex::byte_to_utf16(line, 1000) == line.size() - 3);
+  std::string_view ascii = "all ASCII, and more than eight bytes of it";
+  CHECK(lsplex::byte_to_utf16(ascii, 20) == 20);
+  CHECK(lsplex::utf16_to_byte(ascii, 20) == 20);
+}
+
+TEST_CASE("Positions are translated against the document text") {
+  lsplex::document_store docs;
+  docs.did_open(
+      open("file:///a.cpp", "int x;\nauto s = \"\xC3\xA9t\xC3\xA9\";\n"));
+  lsplex::position_translator positions{docs};
+
+  // A hover just past the second 'é', byte 15 and unit 13 of line 1
+  json::value params{
+      {"textDocument", {{"uri", "file:///a.cpp"}}},
+      {"position", {{"line", 1}, {"character", 15}}},
+  };
+  positions.translate(params, "file:///a.cpp", direction::to_server);
+  CHECK(character(params.as_object().at("position")) == 13);
+  positions.translate(params, "file:///a.cpp", direction::to_client);
+  CHECK(character(params.as_object().at("position")) == 15);
+
+  // Locations say where they are; `data` is the server's own.
+  json::value locations = json::array{
+      {{"uri", "file:///a.cpp"},
+       {"range",
+        {{"start", {{"line", 1}, {"character", 11}}},
+         {"end", {{"line", 0}, {"character", 3}}}}},
+       {"data", {{"line", 1}, {"character", 10}}}},
+  };
+  positions.translate(locations, "", direction::to_client);
+  const auto& location = locations.as_array()[0].as_object();
+  const auto& range = location.at("range").as_object();
+  CHECK(character(range.at("start")) == 12);
+  CHECK(character(range.at("end")) == 3);
+  CHECK(character(location.at("data")) == 10);
+}
+
+TEST_CASE("Changes are translated as they're applied") {
+  lsplex::document_store docs;
+  docs.did_open(open("file:///a.cpp", "\xC3\xA9\n"));
+  lsplex::position_translator positions{docs};
+  // The first change puts an 'é' where the second one, in bytes, is.
+  auto params = json::parse(R"({
+    "textDocument": {"uri": "file:///a.cpp", "version": 2},
+    "contentChanges": [
+      {"range": {"start": {"line": 0, "character": 2},
+                 "end": {"line": 0, "character": 2}}, "text": "é"},
+      {"range": {"start": {"line": 0, "character": 4},
+                 "end": {"line": 0, "character": 4}}, "text": "!"}]})")
+                    .as_object();
+  docs.did_change(params, [&](json::object& range) {
+    positions.translate(range, "file:///a.cpp", direction::to_server);
+  });
+  CHECK(docs.line("file:///a.cpp", 0) == "\xC3\xA9\xC3\xA9!");
+  const auto& changes = params.at("contentChanges").as_array();
+  const auto& second = changes[1].as_object().at("range").as_object();
+  CHECK(character(second.at("start")) == 2);
+}
+
+TEST_CASE("Semantic tokens are re-encoded") {
+  lsplex::document_store docs;
+  docs.did_open(open("file:///a.cpp", "\xC3\xA9 x y\nz\n"));
+  lsplex::position_translator positions{docs};
+  // x at unit 2, y at 4, both one long, then z on the next line
+  json::array data{0, 2, 1, 0, 0, 0, 2, 1, 0, 0, 1, 0, 1, 0, 0};
+  positions.translate_tokens(data, "file:///a.cpp", direction::to_client);
+  CHECK(data == json::array{0, 3, 1, 0, 0, 0, 2, 1, 0, 0, 1, 0, 1, 0, 0});
+}
+
+TEST_CASE("Files on disk are read once, until they change") {
+  auto path = fs::temp_directory_path() / fs::unique_path();
+  std::ofstream{path.string()} << "int x;\n\"\xC3\xA9\";\n";
+  auto uri = lsplex::path_to_uri(path.string());
+  lsplex::document_store docs;
+  lsplex::position_translator positions{docs};
+  auto at = [&](std::int64_t line, std::int64_t c) {
+    json::value position{{"line", line}, {"character", c}};
+    positions.translate(position, uri, direction::to_server);
+    return character(position);
+  };
+  CHECK(at(1, 3) == 2);
+  // Past the end of an ASCII line: left alone.
+  CHECK(at(0, 40) == 40);
+
+  // Kept from one message to the next...
+  std::ofstream{path.string()} << "\"\xC3\xA9\";\nint x;\n";
+  CHECK(at(1, 3) == 2);
+  // ...until the client says it changed.
+  positions.forget(uri);
+  CHECK(at(0, 3) == 2);
+  CHECK(at(1, 3) == 3);
+  fs::remove(path);
+}
@@ -0,0 +1,138 @@
+#include <doctest/doctest.h>
+#include <lsplex/prefetch.h>
+
+#include <boost/json.hpp>
+#include <optional>
+#include <string_view>
+
+namespace json = boost::json;
+using lsplex::prefetcher;
+
+namespace {
+constexpr std::string_view symbols = "textDocument/documentSymbol";
+constexpr std::string_view folding = "textDocument/foldingRange";
+
+std::optional<std::size_t> idle(std::string_view /*uri*/) { return 0; }
+std::optional<std::size_t> busy(std::string_view /*uri*/) {
+  return std::nullopt;
+}
+
+const json::object about_a{{"textDocument", {{"uri", "file:///a.cpp"}}}};
+}  // namespace
+
+TEST_CASE("Prefetched results answer the client's first request") {
+  auto now = prefetcher::clock::now();
+  prefetcher p{{std::string{symbols}, std::string{folding}}, 1};
+  CHECK(p.wants(symbols));
+  CHECK_FALSE(p.wants("textDocument/hover"));
+
+  p.queue("file:///a.cpp", 1, 10, now);
+  CHECK(p.queued() == 2);
+  CHECK_FALSE(p.start(busy));
+  auto first = p.start(idle);
+  REQUIRE(first);
+  CHECK(first->method == symbols);
+  CHECK_FALSE(p.start(idle));  // At most one at a time
+  CHECK(p.finish(*first, json::array{}, now).empty());
+  CHECK(p.running() == 0);
+
+  // Once only, and only for the version it was asked about.
+  CHECK(p.take(symbols, "file:///a.cpp", 2, about_a, "1", now).what
+        == prefetcher::found::nothing);
+  auto hit = p.take(symbols, "file:///a.cpp", 1, about_a, "2", now);
+  CHECK(hit.what == prefetcher::found::ready);
+  CHECK(hit.result == json::array{});
+  CHECK(p.take(symbols, "file:///a.cpp", 1, about_a, "3", now).what
+        == prefetcher::found::nothing);
+
+  // Asked for before being sent: the client's request goes instead.
+  CHECK(p.take(folding, "file:///a.cpp", 1, about_a, "4", now).what
+        == prefetcher::found::nothing);
+  CHECK(p.queued() == 0);
+}
+
+TEST_CASE("The client's requests wait for prefetches on their way") {
+  auto now = prefetcher::clock::now();
+  prefetcher p{{std::string{symbols}}, 2};
+  p.queue("file:///a.cpp", 1, 10, now);
+  auto job = p.start(idle);
+  REQUIRE(job);
+  auto pending = p.take(symbols, "file:///a.cpp", 1, about_a, "7", now);
+  CHECK(pending.what == prefetcher::found::pending);
+  CHECK(pending.backend == 0);
+  auto waiting = p.finish(*job, json::array{}, now);
+  REQUIRE(waiting.size() == 1);
+  CHECK(waiting[0] == "7");
+  // Taken by the request that waited.
+  CHECK(p.take(symbols, "file:///a.cpp", 1, about_a, "8", now).what
+        == prefetcher::found::nothing);
+}
+
+TEST_CASE("Prefetched results go stale") {
+  auto now = prefetcher::clock::now();
+  prefetcher p{{std::string{symbols}}, 2, std::chrono::seconds{1}};
+  p.queue("file:///a.cpp", 1, 10, now);
+  auto job = p.start(idle);
+  REQUIRE(job);
+  p.finish(*job, json::array{}, now);
+  auto later = now + std::chrono::seconds{2};
+  CHECK(p.take(symbols, "file:///a.cpp", 1, about_a, "1", later).what
+        == prefetcher::found::nothing);
+
+  // Edits make what's queued useless.
+  p.queue("file:///a.cpp", 2, 10, now);
+  p.forget("file:///a.cpp");
+  CHECK(p.queued() == 0);
+
+  // A backend that lost its requests won't answer.
+  p.queue("file:///a.cpp", 3, 10, now);
+  REQUIRE(p.start(idle));
+  CHECK(p.running() == 1);
+  p.abandon(0);
+  CHECK(p.running() == 0);
+}
+
+TEST_CASE("Prefetched results answer only what they were asked") {
+  auto now = prefetcher::clock::now();
+  constexpr std::string_view hints = "textDocument/inlayHint";
+  prefetcher p{{std::string{hints}}, 1};
+  p.queue("file:///a.cpp", 1, 10, now);
+  auto job = p.start(idle);
+  REQUIRE(job);
+  auto whole = about_a;
+  whole["range"] = {{"start", {{"line", 0}, {"character", 0}}},
+                    {"end", {{"line", 10}, {"character", 0}}}};
+  CHECK(job->params == whole);
+  p.finish(*job, json::array{}, now);
+
+  // Some other range is for the server to answer.
+  auto screen = whole;
+  screen["range"].as_object()["end"].as_object()["line"] = 5;
+  CHECK(p.take(hints, "file:///a.cpp", 1, screen, "1", now).what
+        == prefetcher::found::nothing);
+  // How progress is reported doesn't matter.
+  whole["workDoneToken"] = "w";
+  CHECK(p.take(hints, "file:///a.cpp", 1, whole, "2", now).what
+        == prefetcher::found::ready);
+}
+
+TEST_CASE("Prefetches for an edited document aren't kept") {
+  auto now = prefetcher::clock::now();
+  prefetcher p{{std::string{symbols}}, 2};
+  p.queue("file:///a.cpp", 1, 10, now);
+  auto ready = p.start(idle);
+  REQUIRE(ready);
+  p.finish(*ready, json::array{}, now);
+  p.queue("file:///a.cpp", 2, 10, now);
+  auto pending = p.start(idle);
+  REQUIRE(pending);
+
+  p.forget("file:///a.cpp");
+  CHECK(p.take(symbols, "file:///a.cpp", 1, about_a, "1", now).what
+        == prefetcher::found::nothing);
+  // Answered after the edit, for nobody.
+  CHECK(p.finish(*pending, json::array{}, now).empty());
+  CHECK(p.running() == 0);
+  CHECK(p.take(symbols, "file:///a.cpp", 2, about_a, "2", now).what
+        == prefetcher::found::nothing);
+}
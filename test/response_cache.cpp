@@ -0,0 +1,74 @@
+#include <doctest/doctest.h>
+#include <lsplex/response_cache.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/json.hpp>
+#include <fstream>
+#include <string>
+
+namespace fs = boost::filesystem;
+namespace json = boost::json;
+
+#if !defined(_WIN32)
+TEST_CASE("Responses are kept on disk by document contents") {
+  auto path = (fs::temp_directory_path() / fs::unique_path()).string();
+  auto hash = lsplex::content_hash("int main() {}\n");
+  auto key = lsplex::response_cache::key("textDocument/documentSymbol",
+                                         "file:///a.cpp", hash, "clangd");
+  auto edited = lsplex::response_cache::key(
+      "textDocument/documentSymbol", "file:///a.cpp",
+      lsplex::content_hash("int main() { }\n"), "clangd");
+  json::value symbols = json::array{{{"name", "main"}, {"kind", 12}}};
+
+  {
+    lsplex::response_cache cache{path, 1 << 20};
+    REQUIRE(cache.ok());
+    CHECK_FALSE(cache.lookup(key));
+    cache.store(key, symbols);
+    CHECK(cache.lookup(key) == symbols);
+    CHECK_FALSE(cache.lookup(edited));
+    cache.store(key, json::array{});  // Shadows the first record
+    CHECK(cache.lookup(key) == json::array{});
+    CHECK(cache.entries() == 1);
+  }
+  {
+    lsplex::response_cache cache{path, 1 << 20};
+    CHECK(cache.lookup(key) == json::array{});
+    cache.store(edited, symbols);
+  }
+
+  // A torn record at the end is dropped, the rest survives.
+  {
+    std::ofstream f{path, std::ios::app | std::ios::binary};
+    f << "LREC\x01\x02";
+  }
+  lsplex::response_cache cache{path, 1 << 20};
+  CHECK(cache.entries() == 2);
+  CHECK(cache.lookup(edited) == symbols);
+
+  // Compaction leaves the newest records only.
+  auto before = cache.file_size();
+  cache.compact();
+  CHECK(cache.file_size() < before);
+  CHECK(cache.lookup(edited) == symbols);
+  fs::remove(path);
+}
+
+TEST_CASE("The response cache stays under its cap") {
+  auto path = (fs::temp_directory_path() / fs::unique_path()).string();
+  lsplex::response_cache cache{path, 4096};
+  json::value result = json::string(std::string(100, 'x'));
+  for (int i = 0; i < 100; ++i)
+    cache.store(lsplex::response_cache::key("textDocument/foldingRange",
+                                            "file:///a.cpp",
+                                            static_cast<std::uint64_t>(i), ""),
+                result);
+  CHECK(cache.file_size() <= 4096);
+  CHECK(cache.lookup(lsplex::response_cache::key(
+            "textDocument/foldingRange", "file:///a.cpp", 99, ""))
+        == result);
+  CHECK_FALSE(cache.lookup(lsplex::response_cache::key(
+      "textDocument/foldingRange", "file:///a.cpp", 0, "")));
+  fs::remove(path);
+}
+#endif
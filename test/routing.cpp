@@ -0,0 +1,28 @@
+#include <doctest/doctest.h>
+#include <lsplex/routing.h>
+
+TEST_CASE("Paths become file URIs") {
+  CHECK(lsplex::path_to_uri("/src/a b.cpp") == "file:///src/a%20b.cpp");
+  CHECK(lsplex::path_to_uri("C:\\src") == "file:///C%3A/src");
+  CHECK(lsplex::path_to_uri("file:///src") == "file:///src");
+}
+
+TEST_CASE("File URIs become paths") {
+  CHECK(lsplex::uri_to_path("file:///src/a%20b.cpp") == "/src/a b.cpp");
+  CHECK(lsplex::uri_to_path("file://localhost/src") == "/src");
+  CHECK(lsplex::uri_to_path("file:///C%3A/src") == "C:/src");
+  CHECK(lsplex::uri_to_path("file:///100%") == "/100%");
+  CHECK_FALSE(lsplex::uri_to_path("untitled:1").has_value());
+}
+
+TEST_CASE("Documents go to the shard with the longest matching root") {
+  lsplex::shard_map shards{{"/src/", "/src/vendor", "/srcs"}};
+  CHECK(shards.size() == std::size_t{4});
+  CHECK(shards.shard_of("file:///src/main.cpp") == std::size_t{1});
+  CHECK(shards.shard_of("file:///src/vendor/x.h") == std::size_t{2});
+  CHECK(shards.shard_of("file:///srcs/y.cpp") == std::size_t{3});
+  CHECK(shards.shard_of("file:///srcx/y.cpp") == std::size_t{0});
+  CHECK(shards.shard_of("file:///other.cpp") == std::size_t{0});
+  CHECK(shards.root(1) == "file:///src");
+  CHECK(shards.root(0).empty());
+}
@@ -0,0 +1,458 @@
+#include <doctest/doctest.h>
+#include <lsplex/lsp.h>
+#include <lsplex/lsplex.h>
+
+#include <boost/asio.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/json.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <string_view>
+#include <vector>
+
+#include "session.h"
+
+namespace asio = boost::asio;
+namespace fs = boost::filesystem;
+namespace json = boost::json;
+namespace lsp = lsplex::lsp;
+
+namespace {
+
+/** A session, with the client and each backend faked by looking at
+ *  what's queued for them and handing it their messages.
+ */
+struct peers {
+  asio::io_context ioc;
+  lsplex::client_out_t client{lsplex::jsonrpc::pal::asio_stdout{ioc},
+                              lsplex::jsonrpc::framing::content_length};
+  std::deque<lsplex::server_out_t> servers;
+  lsplex::session s;
+
+  explicit peers(const lsplex::LsOptions& options = {})
+      : s{ioc.get_executor(), client, options, "fake"} {
+    for (std::size_t b = 0; b < s.backends(); ++b) start(b);
+  }
+
+  /** Backend B's process is (again) running. */
+  void start(std::size_t b, bool respawned = false) {
+    servers.emplace_back(asio::writable_pipe{ioc},
+                         lsplex::jsonrpc::framing::content_length);
+    s.server_started(b, servers.back(), respawned);
+  }
+
+  std::vector<json::object> to_client() { return objects(s.to_client()); }
+  std::vector<json::object> to_server(std::size_t b) {
+    return objects(s.to_server(b));
+  }
+
+  /** Do the handshake, forgetting what it took. */
+  void initialize() {
+    s.from_client(lsp::make_request(0, "initialize",
+                                    json::object{{"capabilities", {}}}));
+    for (std::size_t b = 0; b < s.backends(); ++b)
+      for (const auto& m : to_server(b))
+        s.from_server(b, lsp::make_response(
+                             m.at("id"), json::object{{"capabilities", {}}}));
+    s.from_client(lsp::make_notification("initialized", json::object{}));
+    s.from_client(lsp::make_notification(
+        "textDocument/didOpen",
+        json::object{{"textDocument",
+                      {{"uri", "file:///a.cpp"},
+                       {"languageId", "cpp"},
+                       {"version", 1},
+                       {"text", "int x;\n"}}}}));
+    to_client();
+    for (std::size_t b = 0; b < s.backends(); ++b) to_server(b);
+  }
+
+  template <typename Outbox> static std::vector<json::object> objects(
+      Outbox& out) {
+    std::vector<json::object> ret;
+    for (auto& v : out.take())
+      if (v.is_object()) ret.push_back(std::move(v.get_object()));
+    return ret;
+  }
+};
+
+json::object at_a(std::int64_t line = 0, std::int64_t character = 4) {
+  return json::object{
+      {"textDocument", {{"uri", "file:///a.cpp"}}},
+      {"position", {{"line", line}, {"character", character}}}};
+}
+
+std::vector<std::string_view> methods(const std::vector<json::object>& msgs) {
+  std::vector<std::string_view> ret;
+  for (const auto& m : msgs)
+    ret.push_back(lsp::get_string(m, "method").value_or(""));
+  return ret;
+}
+
+}  // namespace
+
+TEST_CASE("A respawned server is brought up to date before anything else") {
+  peers p;
+  p.initialize();
+  p.s.from_client(lsp::make_request(1, "textDocument/hover", at_a()));
+  p.s.from_client(lsp::make_request(
+      2, "workspace/executeCommand", json::object{{"command", "fix"}}));
+  CHECK(p.to_server(0).size() == 2);
+
+  // Read-only requests are sent again; others may have been carried
+  // out, and fail.
+  p.s.server_exited(0);
+  p.start(0, true);
+  auto failed = p.to_client();
+  REQUIRE(failed.size() == 1);
+  CHECK(failed[0].at("id") == 2);
+  CHECK(failed[0].contains("error"));
+
+  // Until the new process answers initialize, traffic waits.
+  auto init = p.to_server(0);
+  REQUIRE(init.size() == 1);
+  CHECK(methods(init)[0] == "initialize");
+  p.s.from_client(lsp::make_notification(
+      "textDocument/didClose",
+      json::object{{"textDocument", {{"uri", "file:///a.cpp"}}}}));
+  CHECK(p.to_server(0).empty());
+
+  p.s.from_server(0, lsp::make_response(init[0].at("id"),
+                                        json::object{{"capabilities", {}}}));
+  auto replayed = p.to_server(0);
+  CHECK(methods(replayed)
+        == std::vector<std::string_view>{"initialized",
+                                         "textDocument/didOpen",
+                                         "textDocument/hover",
+                                         "textDocument/didClose"});
+  // The client never hears of the second initialize.
+  CHECK(p.to_client().empty());
+}
+
+TEST_CASE("A hedged request goes to a second replica, and the loser is "
+          "cancelled") {
+  lsplex::LsOptions options;
+  options.replicas = 2;
+  options.hedge_delay = std::chrono::milliseconds{1};
+  peers p{options};
+  p.initialize();
+  p.s.from_client(lsp::make_request(1, "textDocument/hover", at_a()));
+  auto first = p.to_server(0);
+  REQUIRE(first.size() == 1);
+  CHECK(p.to_server(1).empty());
+
+  // No answer in time: the other replica is asked too.
+  p.ioc.run_for(std::chrono::milliseconds{200});
+  auto second = p.to_server(1);
+  REQUIRE(second.size() == 1);
+  CHECK(second[0].at("id") == 1);
+
+  // The second answers first, and the first is told to stop.
+  p.s.from_server(1, lsp::make_response(1, "from 1"));
+  auto answers = p.to_client();
+  REQUIRE(answers.size() == 1);
+  CHECK(answers[0].at("result") == "from 1");
+  auto cancel = p.to_server(0);
+  REQUIRE(cancel.size() == 1);
+  CHECK(methods(cancel)[0] == "$/cancelRequest");
+  CHECK(cancel[0].at("params").as_object().at("id") == 1);
+  CHECK(p.to_server(1).empty());
+
+  // Its answer, if it comes anyway, goes nowhere.
+  p.s.from_server(0, lsp::make_response(1, "from 0"));
+  CHECK(p.to_client().empty());
+}
+
+TEST_CASE("Hedged requests answered in time go to one replica") {
+  lsplex::LsOptions options;
+  options.replicas = 2;
+  options.hedge_delay = std::chrono::milliseconds{1};
+  peers p{options};
+  p.initialize();
+  p.s.from_client(lsp::make_request(1, "textDocument/hover", at_a()));
+  REQUIRE(p.to_server(0).size() == 1);
+  p.s.from_server(0, lsp::make_response(1, nullptr));
+  CHECK(p.to_client().size() == 1);
+  p.ioc.run_for(std::chrono::milliseconds{200});
+  CHECK(p.to_server(0).empty());
+  CHECK(p.to_server(1).empty());
+}
+
+TEST_CASE("Capabilities the cache lacked are registered if the client can") {
+  auto dir = fs::temp_directory_path() / fs::unique_path();
+  lsplex::LsOptions options;
+  options.init_cache = dir.string();
+  lsplex::init_cache cache{options.init_cache};
+  auto key = lsplex::init_cache::key("fake", "file:///src");
+  json::value stale = {{"capabilities", json::object{}}};
+  json::value real = {
+      {"capabilities",
+       {{"hoverProvider", true}, {"definitionProvider", true}}}};
+
+  auto handshake = [&](json::object client) -> std::vector<json::object> {
+    cache.store(key, stale);
+    peers p{options};
+    p.s.from_client(lsp::make_request(
+        0, "initialize",
+        json::object{{"rootUri", "file:///src"},
+                     {"capabilities", std::move(client)}}));
+    auto answered = p.to_client();
+    CHECK(answered.size() == 1);
+    CHECK(answered.at(0).at("result") == stale);
+    auto init = p.to_server(0);
+    CHECK(init.size() == 1);
+    p.s.from_server(0, lsp::make_response(init.at(0).at("id"), real));
+    auto told = p.to_client();
+    CHECK(cache.load(key) == real);
+
+    // Once answered, the client may use the id again.
+    p.s.from_client(lsp::make_request(0, "textDocument/hover", at_a()));
+    CHECK(p.to_server(0).size() == 1);
+    p.s.from_server(0, lsp::make_response(0, "hover"));
+    auto answer = p.to_client();
+    CHECK(answer.size() == 1);
+    CHECK(answer.at(0).at("result") == "hover");
+    CHECK(cache.load(key) == real);
+    return told;
+  };
+
+  // Only those the client can register dynamically
+  auto told = handshake(json::object{
+      {"textDocument", {{"hover", {{"dynamicRegistration", true}}}}}});
+  REQUIRE(told.size() == 1);
+  CHECK(methods(told)[0] == "client/registerCapability");
+  const auto& registrations
+      = told[0].at("params").as_object().at("registrations").as_array();
+  REQUIRE(registrations.size() == 1);
+  CHECK(registrations[0].as_object().at("method") == "textDocument/hover");
+  CHECK(handshake(json::object{}).empty());
+  fs::remove_all(dir);
+}
+
+TEST_CASE("Identical requests are sent once and answered under each id") {
+  peers p;
+  p.initialize();
+  p.s.from_client(lsp::make_request(1, "textDocument/hover", at_a()));
+  p.s.from_client(lsp::make_request("two", "textDocument/hover", at_a()));
+  // Asking about somewhere else isn't the same.
+  p.s.from_client(lsp::make_request(3, "textDocument/hover", at_a(0, 2)));
+  auto sent = p.to_server(0);
+  REQUIRE(sent.size() == 2);
+  CHECK(sent[0].at("id") == 1);
+  CHECK(sent[1].at("id") == 3);
+
+  p.s.from_server(0, lsp::make_response(1, "x"));
+  auto answers = p.to_client();
+  REQUIRE(answers.size() == 2);
+  CHECK(answers[0].at("id") == "two");
+  CHECK(answers[1].at("id") == 1);
+  for (const auto& a : answers) CHECK(a.at("result") == "x");
+
+  // Landed: the same again starts a new flight.
+  p.s.from_client(lsp::make_request(4, "textDocument/hover", at_a()));
+  CHECK(p.to_server(0).size() == 1);
+}
+
+TEST_CASE("Only when every waiter cancels is the server told") {
+  peers p;
+  p.initialize();
+  auto cancel = [&p](json::value id) {
+    p.s.from_client(lsp::make_notification(
+        "$/cancelRequest", json::object{{"id", std::move(id)}}));
+  };
+  p.s.from_client(lsp::make_request(1, "textDocument/hover", at_a()));
+  p.s.from_client(lsp::make_request(2, "textDocument/hover", at_a()));
+  p.s.from_client(lsp::make_request(3, "textDocument/hover", at_a()));
+  CHECK(p.to_server(0).size() == 1);
+
+  // Each waiter that cancels gets its own error, and the others wait.
+  cancel(2);
+  auto cancelled = p.to_client();
+  REQUIRE(cancelled.size() == 1);
+  CHECK(cancelled[0].at("id") == 2);
+  CHECK(cancelled[0].at("error").as_object().at("code")
+        == lsp::request_cancelled);
+  cancel(1);
+  cancelled = p.to_client();
+  REQUIRE(cancelled.size() == 1);
+  CHECK(cancelled[0].at("id") == 1);
+  CHECK(p.to_server(0).empty());
+
+  // The last one to go cancels the request under the id it was sent
+  // with.
+  cancel(3);
+  CHECK(p.to_client().size() == 1);
+  auto told = p.to_server(0);
+  REQUIRE(told.size() == 1);
+  CHECK(methods(told)[0] == "$/cancelRequest");
+  CHECK(told[0].at("params").as_object().at("id") == 1);
+
+  // Nobody hears the late answer.
+  p.s.from_server(0, lsp::make_response(1, "x"));
+  CHECK(p.to_client().empty());
+}
+
+TEST_CASE("A cancelled leader's answer still goes to who waits") {
+  peers p;
+  p.initialize();
+  p.s.from_client(lsp::make_request(1, "textDocument/hover", at_a()));
+  p.s.from_client(lsp::make_request(2, "textDocument/hover", at_a()));
+  p.to_server(0);
+  p.s.from_client(lsp::make_notification("$/cancelRequest",
+                                         json::object{{"id", 1}}));
+  CHECK(p.to_client().size() == 1);
+  CHECK(p.to_server(0).empty());
+  p.s.from_server(0, lsp::make_response(1, "x"));
+  auto answers = p.to_client();
+  REQUIRE(answers.size() == 1);
+  CHECK(answers[0].at("id") == 2);
+  CHECK(answers[0].at("result") == "x");
+}
+
+TEST_CASE("A hibernating server is woken by a request for it") {
+  peers p;
+  p.initialize();
+  p.s.hibernate(0, false, 0);
+  CHECK(p.s.asleep(0));
+  auto shutdown = p.to_server(0);
+  REQUIRE(shutdown.size() == 1);
+  CHECK(methods(shutdown)[0] == "shutdown");
+  p.s.from_server(0, lsp::make_response(shutdown[0].at("id"), nullptr));
+  CHECK(methods(p.to_server(0)) == std::vector<std::string_view>{"exit"});
+  p.s.server_exited(0);
+
+  bool needed = false;
+  asio::co_spawn(p.ioc, p.s.until_needed(0),
+                 [&needed](const std::exception_ptr&) { needed = true; });
+  // What it misses is replayed when it's back.
+  p.s.from_client(lsp::make_notification(
+      "textDocument/didChange",
+      json::object{{"textDocument", {{"uri", "file:///a.cpp"}, {"version", 2}}},
+                   {"contentChanges", json::array{{{"text", "int y;\n"}}}}}));
+  p.ioc.poll();
+  CHECK_FALSE(needed);
+
+  p.s.from_client(lsp::make_request(1, "textDocument/hover", at_a()));
+  p.ioc.poll();
+  CHECK(needed);
+  CHECK(p.to_server(0).empty());
+
+  p.start(0, true);
+  CHECK_FALSE(p.s.asleep(0));
+  auto init = p.to_server(0);
+  REQUIRE(init.size() == 1);
+  p.s.from_server(0, lsp::make_response(init[0].at("id"),
+                                        json::object{{"capabilities", {}}}));
+  auto replayed = p.to_server(0);
+  REQUIRE(methods(replayed)
+          == std::vector<std::string_view>{"initialized",
+                                           "textDocument/didOpen",
+                                           "textDocument/hover"});
+  const auto& doc
+      = replayed[1].at("params").as_object().at("textDocument").as_object();
+  CHECK(doc.at("version") == 2);
+  CHECK(doc.at("text") == "int y;\n");
+}
+
+TEST_CASE("A suspended server keeps its traffic and is woken on request") {
+  peers p;
+  p.initialize();
+  p.s.hibernate(0, true, 0);
+  CHECK(p.to_server(0).empty());
+  bool needed = false;
+  asio::co_spawn(p.ioc, p.s.until_needed(0),
+                 [&needed](const std::exception_ptr&) { needed = true; });
+  p.ioc.poll();
+  CHECK_FALSE(needed);
+
+  p.s.from_client(lsp::make_request(1, "textDocument/hover", at_a()));
+  p.ioc.poll();
+  CHECK(needed);
+  // Frozen, not gone: it gets the request once thawed.
+  CHECK(p.to_server(0).size() == 1);
+  p.s.resumed(0, 0);
+  CHECK_FALSE(p.s.asleep(0));
+}
+
+TEST_CASE("Long results are streamed to clients that take partial ones") {
+  lsplex::LsOptions options;
+  options.partial_results = 2;
+  peers p{options};
+  p.initialize();
+  auto references = [&](int id, std::int64_t found) {
+    auto params = at_a();
+    params["partialResultToken"] = "t";
+    params["context"] = {{"includeDeclaration", true}};
+    p.s.from_client(
+        lsp::make_request(id, "textDocument/references", std::move(params)));
+    auto sent = p.to_server(0);
+    CHECK(sent.size() == 1);
+    json::array locations;
+    for (std::int64_t i = 0; i < found; ++i) locations.emplace_back(i);
+    p.s.from_server(0, lsp::make_response(sent.at(0).at("id"), locations));
+    return p.to_client();
+  };
+
+  auto streamed = references(1, 5);
+  REQUIRE(methods(streamed)
+          == std::vector<std::string_view>{"$/progress", "$/progress",
+                                           "$/progress", ""});
+  std::vector<json::value> parts;
+  for (std::size_t i = 0; i < 3; ++i) {
+    const auto& params = streamed[i].at("params").as_object();
+    CHECK(params.at("token") == "t");
+    parts.push_back(params.at("value"));
+  }
+  CHECK(parts[0] == json::array{0, 1});
+  CHECK(parts[1] == json::array{2, 3});
+  CHECK(parts[2] == json::array{4});
+  CHECK(streamed[3].at("id") == 1);
+  CHECK(streamed[3].at("result") == json::array{});
+
+  // What fits in one part comes as it is.
+  auto whole = references(2, 2);
+  REQUIRE(whole.size() == 1);
+  CHECK(whole[0].at("result") == json::array{0, 1});
+}
+
+TEST_CASE("Completions from the cache are slimmed as they were") {
+  lsplex::LsOptions options;
+  options.slim = true;
+  peers p{options};
+  p.initialize();
+  p.s.from_client(
+      lsp::make_request(1, "textDocument/completion", at_a(0, 5)));
+  auto sent = p.to_server(0);
+  REQUIRE(sent.size() == 1);
+  p.s.from_server(
+      0, lsp::make_response(
+             sent[0].at("id"),
+             json::parse(R"({"isIncomplete": false, "items": [
+               {"label": "x", "documentation": "Long", "data": 7}]})")));
+  auto first = p.to_client();
+  REQUIRE(first.size() == 1);
+
+  p.s.from_client(
+      lsp::make_request(2, "textDocument/completion", at_a(0, 5)));
+  CHECK(p.to_server(0).empty());
+  auto again = p.to_client();
+  REQUIRE(again.size() == 1);
+  auto data = [](const json::object& msg) -> json::value {
+    const auto& items = msg.at("result").as_object().at("items").as_array();
+    return items.at(0).as_object().at("data");
+  };
+  CHECK(data(again[0]) == data(first[0]));
+  CHECK(data(first[0]).is_string());
+
+  // And resolved by the proxy, as the server doesn't.
+  json::object item;
+  item["label"] = "x";
+  item["data"] = data(first[0]);
+  p.s.from_client(lsp::make_request(3, "completionItem/resolve", item));
+  auto resolved = p.to_client();
+  REQUIRE(resolved.size() == 1);
+  const auto& result = resolved[0].at("result").as_object();
+  CHECK(result.at("documentation") == "Long");
+  CHECK(result.at("data") == 7);
+}
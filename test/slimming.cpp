@@ -0,0 +1,143 @@
+#include <doctest/doctest.h>
+#include <lsplex/slimming.h>
+
+#include <boost/json.hpp>
+#include <string>
+
+namespace json = boost::json;
+using lsplex::slimmer;
+using lsplex::lsp::method;
+
+namespace {
+// A client that resolves completion items and knows diagnostic tags
+json::object capabilities() {
+  return json::parse(R"({"textDocument": {
+    "completion": {"completionItem": {"snippetSupport": true}},
+    "publishDiagnostics": {"tagSupport": {"valueSet": [1, 2]}}}})")
+      .as_object();
+}
+
+json::object response(int id, json::value result) {
+  return json::object{{"jsonrpc", "2.0"}, {"id", id}, {"result", result}};
+}
+
+const json::object& item(const json::object& msg, std::size_t i) {
+  return msg.at("result").as_object().at("items").as_array()[i].as_object();
+}
+}  // namespace
+
+TEST_CASE("Completion items lose what the client can't use") {
+  slimmer s{capabilities(), {}};
+  json::object params;
+  CHECK(s.request("1", method::completion, params));
+  auto msg = response(1, json::parse(R"({"isIncomplete": false, "items": [
+    {"label": "a", "documentation": "Long text", "data": {"id": 7},
+     "deprecated": false, "detail": null},
+    {"label": "b"}]})"));
+  s.slim(msg);
+  const auto& a = item(msg, 0);
+  CHECK_FALSE(a.contains("documentation"));
+  CHECK_FALSE(a.contains("deprecated"));
+  CHECK_FALSE(a.contains("detail"));
+  CHECK(a.at("data").is_string());
+  CHECK(item(msg, 1).size() == 1);
+  CHECK(s.kept() == 1);
+
+  // The server doesn't resolve items: the proxy does.
+  auto resolve = a;
+  CHECK_FALSE(s.request("2", method::completion_resolve, resolve));
+  CHECK(resolve.at("documentation") == "Long text");
+  CHECK(resolve.at("data") == json::object{{"id", 7}});
+}
+
+TEST_CASE("Resolved completion items get their documentation back") {
+  slimmer s{capabilities(), {}};
+  json::object params;
+  s.request("0", method::initialize, params);
+  auto init = response(0, json::parse(R"({"capabilities": {
+    "completionProvider": {"resolveProvider": true}}})"));
+  s.slim(init);
+  s.request("1", method::completion, params);
+  auto msg = response(1, json::parse(R"({"items": [
+    {"label": "a", "documentation": "Long text"}],
+    "itemDefaults": {"data": 3}})"));
+  s.slim(msg);
+
+  // The server sees the item as it sent it, and may add nothing.
+  auto resolve = item(msg, 0);
+  CHECK(s.request("2", method::completion_resolve, resolve));
+  CHECK(resolve.at("data") == 3);
+  auto resolved = response(2, json::object{{"label", "a"}, {"detail", "int"}});
+  s.slim(resolved);
+  CHECK(resolved.at("result").as_object().at("documentation") == "Long text");
+}
+
+TEST_CASE("Diagnostics lose unsupported fields, nulls and nothing else") {
+  slimmer s{capabilities(), {"relatedInformation"}};
+  auto msg = json::parse(R"({"jsonrpc": "2.0",
+    "method": "textDocument/publishDiagnostics",
+    "params": {"uri": "file:///a.cpp", "version": null, "diagnostics": [
+      {"message": "unused", "tags": [1], "source": null,
+       "codeDescription": {"href": "https://example.com/unused"},
+       "relatedInformation": [], "data": {"fix": null}}]}})")
+                 .as_object();
+  s.slim(msg);
+  const auto& params = msg.at("params").as_object();
+  CHECK(params.contains("version"));
+  const auto& d = params.at("diagnostics").as_array()[0].as_object();
+  CHECK(d.contains("tags"));
+  CHECK(d.contains("relatedInformation"));
+  CHECK_FALSE(d.contains("codeDescription"));
+  CHECK_FALSE(d.contains("source"));
+  CHECK_FALSE(d.contains("data"));
+}
+
+TEST_CASE("Completion items are kept aside by list") {
+  slimmer s{capabilities(), {}, 1};
+  json::object params;
+  s.request("0", method::initialize, params);
+  auto init = response(0, json::parse(R"({"capabilities": {
+    "completionProvider": {"resolveProvider": true}}})"));
+  s.slim(init);
+  auto list = json::parse(R"({"items": [
+    {"label": "a", "documentation": "A"},
+    {"label": "b", "documentation": "B"}]})");
+  s.request("1", method::completion, params);
+  auto first = response(1, list);
+  s.slim(first);
+  CHECK(s.kept() == 1);
+
+  // Served again from a cache, as slimmed: the same tokens.
+  s.request("2", method::completion, params);
+  auto again = response(2, first.at("result"));
+  s.slim(again);
+  CHECK(s.kept() == 1);
+  CHECK(item(again, 1).at("data") == item(first, 1).at("data"));
+
+  // A new list pushes the old one out, and the server is asked.
+  s.request("3", method::completion, params);
+  auto second = response(3, list);
+  s.slim(second);
+  CHECK(s.kept() == 1);
+  auto resolve = item(first, 1);
+  CHECK(s.request("4", method::completion_resolve, resolve));
+  CHECK(resolve.at("data") == item(first, 1).at("data"));
+  CHECK_FALSE(resolve.contains("documentation"));
+  resolve = item(second, 1);
+  CHECK(s.request("5", method::completion_resolve, resolve));
+  CHECK_FALSE(resolve.contains("data"));
+}
+
+TEST_CASE("Only what's slimmed loses its nulls") {
+  slimmer s{capabilities(), {}};
+  auto log = json::parse(R"({"jsonrpc": "2.0", "method": "$/progress",
+    "params": {"token": "t", "value": {"message": null}}})")
+                 .as_object();
+  auto original = log;
+  s.slim(log);
+  CHECK(log == original);
+  auto unknown = response(7, json::object{{"range", nullptr}});
+  original = unknown;
+  s.slim(unknown);
+  CHECK(unknown == original);
+}
@@ -0,0 +1,89 @@
+#include <doctest/doctest.h>
+#include <lsplex/trace.h>
+
+#include <boost/json.hpp>
+#include <chrono>
+#include <cstdint>
+#include <string_view>
+
+namespace json = boost::json;
+using lsplex::tracer;
+using point = tracer::point;
+
+namespace {
+tracer::clock::time_point at(int ms) {
+  static const auto t0 = tracer::clock::now();
+  return t0 + std::chrono::milliseconds{ms};
+}
+
+const json::value& field(const json::value& event, std::string_view name) {
+  return event.as_object().at(name);
+}
+
+std::int64_t ts(const json::value& event) {
+  return field(event, "ts").as_int64();
+}
+}  // namespace
+
+TEST_CASE("A request is traced from its arrival to its reply") {
+  tracer t{10};
+  json::value req = {{"jsonrpc", "2.0"},
+                     {"id", 1},
+                     {"method", "textDocument/hover"},
+                     {"params", json::object{}}};
+  json::value resp = {{"jsonrpc", "2.0"}, {"id", 1}, {"result", nullptr}};
+  t.received(req, at(0), at(1));
+  t.mark(req, point::sent, at(2));
+  // The server's own request, with the same id, isn't the answer.
+  t.mark(json::object{{"id", 1}, {"method", "workspace/configuration"}},
+         point::answered, at(3));
+  t.mark(resp, point::answered, at(5));
+  CHECK(t.size() == 0);
+  t.mark(resp, point::replied, at(6));
+  CHECK(t.size() == 1);
+
+  auto trace = json::parse(t.chrome_json());
+  const auto& events = field(trace, "traceEvents").as_array();
+  // Process name, then the request and its 4 phases, begun and ended.
+  REQUIRE(events.size() == 1 + 2 * 5);
+  CHECK(field(events[1], "name") == "textDocument/hover");
+  CHECK(field(events[1], "ph") == "b");
+  CHECK(field(field(events[1], "args"), "id") == "1");
+  CHECK(field(events[2], "ph") == "e");
+  CHECK(ts(events[2]) - ts(events[1]) == 6000);
+  CHECK(field(events[7], "name") == "server");
+  CHECK(ts(events[8]) - ts(events[7]) == 3000);
+}
+
+TEST_CASE("Requests the proxy answers itself have fewer phases") {
+  tracer t{10};
+  json::value req = {{"id", "a"}, {"method", "textDocument/documentSymbol"}};
+  t.received(json::array{req}, at(0), at(1));
+  t.mark(json::array{json::object{{"id", "a"}, {"result", json::array{}}}},
+         point::replied, at(2));
+  auto trace = json::parse(t.chrome_json());
+  const auto& events = field(trace, "traceEvents").as_array();
+  REQUIRE(events.size() == 1 + 2 * 3);
+  CHECK(field(events[3], "name") == "read");
+  CHECK(field(events[5], "name") == "proxy");
+}
+
+TEST_CASE("Only the latest requests are traced") {
+  tracer t{2};
+  for (int i = 0; i < 3; ++i) {
+    json::value req = {{"id", i}, {"method", "textDocument/hover"}};
+    t.received(req, at(i), at(i));
+    t.mark(json::object{{"id", i}, {"result", nullptr}}, point::replied,
+           at(i + 1));
+  }
+  CHECK(t.size() == 2);
+
+  // Never answered, then forgotten.
+  t.received(json::object{{"id", 7}, {"method", "a"}}, at(0), at(0));
+  t.received(json::object{{"id", 8}, {"method", "b"}}, at(0), at(0));
+  t.received(json::object{{"id", 9}, {"method", "c"}}, at(0), at(0));
+  t.mark(json::object{{"id", 7}, {"result", nullptr}}, point::replied, at(1));
+  auto trace = json::parse(t.chrome_json());
+  for (const auto& e : field(trace, "traceEvents").as_array())
+    CHECK(field(e, "name") != "a");
+}
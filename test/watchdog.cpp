@@ -0,0 +1,42 @@
+#include <doctest/doctest.h>
+#include <lsplex/watchdog.h>
+
+#include <chrono>
+
+using lsplex::stall_watch;
+using std::chrono::milliseconds;
+
+TEST_CASE("Late probes are stalls, blamed on the longest run") {
+  stall_watch w{milliseconds{100}};
+  auto due = stall_watch::clock::now();
+  w.ran("textDocument/hover", "the client", milliseconds{5});
+  CHECK_FALSE(w.probe(due, due + milliseconds{10}));
+
+  w.ran("parsing", "a server", milliseconds{30});
+  w.ran("textDocument/references", "a server", milliseconds{240});
+  w.ran("textDocument/hover", "the client", milliseconds{2});
+  auto stall = w.probe(due, due + milliseconds{250});
+  REQUIRE(stall);
+  CHECK(stall->find("textDocument/references from a server")
+        != std::string::npos);
+
+  // Runs before the previous probe aren't to blame.
+  stall = w.probe(due, due + milliseconds{150});
+  REQUIRE(stall);
+  CHECK(stall->find("not by handling a message") != std::string::npos);
+}
+
+TEST_CASE("Lag percentiles cover the latest probes") {
+  stall_watch w{milliseconds{1000}, 100};
+  auto due = stall_watch::clock::now();
+  CHECK(w.percentile(0.5) == stall_watch::clock::duration::zero());
+  for (int i = 1; i <= 200; ++i) w.probe(due, due + milliseconds{i});
+  CHECK(w.probes() == 200);
+  // Only 101 to 200 are left.
+  CHECK(w.percentile(0.0) == milliseconds{101});
+  CHECK(w.percentile(0.5) == milliseconds{151});
+  CHECK(w.percentile(1.0) == milliseconds{200});
+  // A probe can't fire early: that's no lag.
+  w.probe(due, due - milliseconds{5});
+  CHECK(w.percentile(0.0) == stall_watch::clock::duration::zero());
+}
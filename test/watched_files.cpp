@@ -0,0 +1,61 @@
+#include <doctest/doctest.h>
+#include <lsplex/watched_files.h>
+
+#include <boost/json.hpp>
+
+namespace json = boost::json;
+using lsplex::watched_changes;
+
+namespace {
+json::object event(std::string_view uri, std::int64_t type) {
+  return json::object{{"uri", uri}, {"type", type}};
+}
+}  // namespace
+
+TEST_CASE("Watched file events net out per URI") {
+  watched_changes w;
+  CHECK(w.empty());
+  w.add(json::array{event("file:///a.h", watched_changes::created),
+                    event("file:///b.h", watched_changes::changed),
+                    event("file:///c.h", watched_changes::deleted)});
+  w.add(json::array{event("file:///a.h", watched_changes::changed),
+                    event("file:///b.h", watched_changes::changed),
+                    event("file:///c.h", watched_changes::created),
+                    event("file:///d.h", watched_changes::created),
+                    event("file:///b.h", watched_changes::deleted)});
+  w.add(json::array{event("file:///d.h", watched_changes::deleted)});
+  CHECK(w.size() == 3);
+  auto events = w.take();
+  CHECK(events
+        == json::array{event("file:///a.h", watched_changes::created),
+                       event("file:///b.h", watched_changes::deleted),
+                       event("file:///c.h", watched_changes::changed)});
+  CHECK(w.empty());
+  CHECK(w.take().empty());
+}
+
+TEST_CASE("Events after netting to nothing start afresh") {
+  watched_changes w;
+  w.add(json::array{event("file:///a.h", watched_changes::created),
+                    event("file:///b.h", watched_changes::changed),
+                    event("file:///a.h", watched_changes::deleted)});
+  CHECK(w.size() == 1);
+  w.add(json::array{event("file:///a.h", watched_changes::changed),
+                    json::object{{"uri", "file:///bad.h"}}});
+  CHECK(w.take()
+        == json::array{event("file:///b.h", watched_changes::changed),
+                       event("file:///a.h", watched_changes::changed)});
+}
+
+TEST_CASE("Events of unknown types are left out") {
+  watched_changes w;
+  w.add(json::array{event("file:///a.h", 0), event("file:///b.h", 7)});
+  CHECK(w.empty());
+  CHECK(w.size() == 0);
+  CHECK(w.take().empty());
+  w.add(json::array{event("file:///a.h", watched_changes::created),
+                    event("file:///a.h", 0)});
+  CHECK(w.size() == 1);
+  CHECK(w.take()
+        == json::array{event("file:///a.h", watched_changes::created)});
+}